@@ -7,9 +7,11 @@ import re
 import os
 import hashlib
 
-from tiny_test_fw import Utility
+from tiny_test_fw import DUT, Utility
 import ttfw_idf
 
+HID_BENCH_PATHS = ("keyboard", "mouse", "consumer")
+
 
 def verify_elf_sha256_embedding(dut):
     elf_file = os.path.join(dut.app.binary_path, "blink.elf")
@@ -28,6 +30,39 @@ def verify_elf_sha256_embedding(dut):
         raise ValueError('ELF file SHA256 mismatch')
 
 
+def hid_bench_built(dut):
+    # Only builds with HID_BENCH_ENABLED wait for a host, they say so before
+    # advertising starts.
+    try:
+        dut.expect("hid_bench: waiting for a host", timeout=10)
+    except DUT.ExpectTimeout:
+        Utility.console_log("HID benchmarks not built in, skipped")
+        return False
+    return True
+
+
+def log_boot_time(dut):
+    # Advertising needs no host, so every run gets this one.
+    adv_ms = dut.expect(re.compile(r"boot: advertising (\d+) ms after"), timeout=10)[0]
+    ttfw_idf.log_performance("blink_boot_to_advertising", "{}ms".format(adv_ms))
+
+
+def log_hid_benchmarks(dut):
+    # Only with a host connected do the benchmarks get to measure anything.
+    for path in HID_BENCH_PATHS:
+        try:
+            rate, cpu, p50, p99 = dut.expect(re.compile(
+                r"hid_bench: {}: \d+ reports, (\d+) reports/s, (\d+) us/report, "
+                r"latency p50 (\d+) us p99 (\d+) us".format(path)), timeout=120)
+        except DUT.ExpectTimeout:
+            Utility.console_log("No HID benchmark result for {}, is a host connected?".format(path))
+            return
+        ttfw_idf.log_performance("hid_{}_reports_per_s".format(path), rate)
+        ttfw_idf.log_performance("hid_{}_cpu_per_report".format(path), "{}us".format(cpu))
+        ttfw_idf.log_performance("hid_{}_latency_p50".format(path), "{}us".format(p50))
+        ttfw_idf.log_performance("hid_{}_latency_p99".format(path), "{}us".format(p99))
+
+
 @ttfw_idf.idf_example_test(env_tag="Example_WIFI")
 def test_examples_blink(env, extra_data):
     dut = env.get_dut("blink", "examples/get-started/blink", dut_class=ttfw_idf.ESP32DUT)
@@ -39,6 +74,10 @@ def test_examples_blink(env, extra_data):
     dut.start_app()
 
     verify_elf_sha256_embedding(dut)
+    bench = hid_bench_built(dut)
+    log_boot_time(dut)
+    if bench:
+        log_hid_benchmarks(dut)
 
 
 if __name__ == '__main__':
@@ -0,0 +1,16 @@
+#ifndef BENCH_H__
+#define BENCH_H__
+
+#include <stdio.h>
+#include "fake_idf.h"
+
+// Host benchmarks print one "bench: <name>: <value> <unit>" line per
+// figure. They time host CPU with fake_host_ns(), so compare the figures
+// of one run with each other, not with the target.
+#define BENCH_LOG(name, fmt, ...) printf("bench: %s: " fmt "\n", name, ##__VA_ARGS__)
+
+static inline double bench_ns_per(int64_t start_ns, long n){
+	return (double)(fake_host_ns()-start_ns)/n;
+}
+
+#endif /* BENCH_H__ */
@@ -0,0 +1,116 @@
+// Cost of finding a report's handle on the send path, before and after the
+// direct-indexed table. The before figure is the linear scan hid_dev used
+// to do on every hid_dev_send_report, the after one the [id][type] table
+// hid_dev_build_ntf_tbl now fills, both over the report map as
+// hid_add_id_tbl lays it out. hid_dev_report_enabled is the real lookup
+// with its lock and connection search, for scale.
+#include "bench.h"
+#include "check.h"
+#include "hidd_host.h"
+
+#define CONN_ID 0
+#define ROUNDS 2000000
+
+// Keyboard, mouse and consumer input reports, then the boot keyboard.
+static const struct {
+	uint8_t id, type, mode;
+} lookups[]={
+	{HID_RPT_ID_KEY_IN,HID_TYPE_INPUT,HID_PROTOCOL_MODE_REPORT},
+	{HID_RPT_ID_MOUSE_IN,HID_TYPE_INPUT,HID_PROTOCOL_MODE_REPORT},
+	{HID_RPT_ID_CC_IN,HID_TYPE_INPUT,HID_PROTOCOL_MODE_REPORT},
+	{HID_RPT_ID_KEY_IN,HID_TYPE_INPUT,HID_PROTOCOL_MODE_BOOT},
+};
+#define NUM_LOOKUPS (sizeof(lookups)/sizeof(lookups[0]))
+
+static hid_report_map_t rpt_map[HID_NUM_REPORTS];
+static uint8_t rpt_map_len;
+static hid_report_map_t *ntf_tbl[2][HID_RPT_ID_MAX][HID_TYPE_FEATURE + 1];
+
+static void add_rpt(uint8_t id, uint8_t type, int val_idx, int ccc_idx, uint8_t mode){
+	rpt_map[rpt_map_len++]=(hid_report_map_t){
+		.handle=hidd_host_handle(val_idx),
+		.cccdHandle=ccc_idx?hidd_host_handle(ccc_idx):0,
+		.id=id,.type=type,.mode=mode,
+	};
+}
+
+// hid_dev_rpt_by_id before the table, with the protocol mode passed in
+// instead of read from the link.
+__attribute__((noinline))
+static hid_report_map_t *rpt_by_id_scan(uint8_t id, uint8_t type, uint8_t mode){
+	hid_report_map_t *rpt=rpt_map;
+	for(uint8_t i=rpt_map_len;i>0;i--,rpt++){
+		if(rpt->id==id&&rpt->type==type&&rpt->mode==mode)return rpt;
+	}
+	return NULL;
+}
+
+__attribute__((noinline))
+static hid_report_map_t *rpt_by_id_table(uint8_t id, uint8_t type, uint8_t mode){
+	if(id>=HID_RPT_ID_MAX||type>HID_TYPE_FEATURE)return NULL;
+	return ntf_tbl[mode][id][type];
+}
+
+static void hidd_event(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param){
+	(void)event;
+	(void)param;
+}
+
+int main(void){
+	const esp_bd_addr_t host={0x11,0x22,0x33,0x44,0x55,0x66};
+	uint32_t sum_scan=0, sum_table=0, enabled=0;
+
+	hidd_host_up(hidd_event);
+	fake_bt_connect(CONN_ID,host);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_KEY_IN_CCC,true);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_MOUSE_IN_CCC,true);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_CC_IN_CCC,true);
+
+	// Same order as hid_add_id_tbl, the scan cost depends on it.
+	add_rpt(HID_RPT_ID_MOUSE_IN,HID_TYPE_INPUT,HIDD_LE_IDX_REPORT_MOUSE_IN_VAL,HIDD_LE_IDX_REPORT_MOUSE_IN_CCC,HID_PROTOCOL_MODE_REPORT);
+	add_rpt(HID_RPT_ID_KEY_IN,HID_TYPE_INPUT,HIDD_LE_IDX_REPORT_KEY_IN_VAL,HIDD_LE_IDX_REPORT_KEY_IN_CCC,HID_PROTOCOL_MODE_REPORT);
+	add_rpt(HID_RPT_ID_CC_IN,HID_TYPE_INPUT,HIDD_LE_IDX_REPORT_CC_IN_VAL,HIDD_LE_IDX_REPORT_CC_IN_CCC,HID_PROTOCOL_MODE_REPORT);
+	add_rpt(HID_RPT_ID_LED_OUT,HID_TYPE_OUTPUT,HIDD_LE_IDX_REPORT_LED_OUT_VAL,0,HID_PROTOCOL_MODE_REPORT);
+	add_rpt(HID_RPT_ID_KEY_IN,HID_TYPE_INPUT,HIDD_LE_IDX_BOOT_KB_IN_REPORT_VAL,HIDD_LE_IDX_BOOT_KB_IN_REPORT_NTF_CFG,HID_PROTOCOL_MODE_BOOT);
+	add_rpt(HID_RPT_ID_LED_OUT,HID_TYPE_OUTPUT,HIDD_LE_IDX_BOOT_KB_OUT_REPORT_VAL,0,HID_PROTOCOL_MODE_BOOT);
+	add_rpt(HID_RPT_ID_MOUSE_IN,HID_TYPE_INPUT,HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_VAL,HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_NTF_CFG,HID_PROTOCOL_MODE_BOOT);
+	add_rpt(HID_RPT_ID_FEATURE,HID_TYPE_FEATURE,HIDD_LE_IDX_REPORT_VAL,0,HID_PROTOCOL_MODE_REPORT);
+	add_rpt(HID_RPT_ID_NKRO_IN,HID_TYPE_INPUT,HIDD_LE_IDX_REPORT_NKRO_IN_VAL,HIDD_LE_IDX_REPORT_NKRO_IN_CCC,HID_PROTOCOL_MODE_REPORT);
+	CHECK_EQ(rpt_map_len,HID_NUM_REPORTS);
+	for(int i=0;i<rpt_map_len;i++){
+		hid_report_map_t *rpt=&rpt_map[i];
+		ntf_tbl[rpt->mode][rpt->id][rpt->type]=rpt;
+	}
+
+	// Both find the same entries.
+	for(size_t i=0;i<NUM_LOOKUPS;i++){
+		hid_report_map_t *rpt=rpt_by_id_scan(lookups[i].id,lookups[i].type,lookups[i].mode);
+		CHECK(rpt&&rpt==rpt_by_id_table(lookups[i].id,lookups[i].type,lookups[i].mode));
+	}
+
+	int64_t start=fake_host_ns();
+	for(long r=0;r<ROUNDS;r++){
+		size_t i=r%NUM_LOOKUPS;
+		sum_scan+=rpt_by_id_scan(lookups[i].id,lookups[i].type,lookups[i].mode)->handle;
+	}
+	BENCH_LOG("hid_dev dispatch scan","%.1f ns/report",bench_ns_per(start,ROUNDS));
+
+	start=fake_host_ns();
+	for(long r=0;r<ROUNDS;r++){
+		size_t i=r%NUM_LOOKUPS;
+		sum_table+=rpt_by_id_table(lookups[i].id,lookups[i].type,lookups[i].mode)->handle;
+	}
+	BENCH_LOG("hid_dev dispatch table","%.1f ns/report",bench_ns_per(start,ROUNDS));
+
+	// Report mode lookups only, the link is in report mode.
+	start=fake_host_ns();
+	for(long r=0;r<ROUNDS;r++){
+		size_t i=r%(NUM_LOOKUPS-1);
+		enabled+=hid_dev_report_enabled(CONN_ID,lookups[i].id,lookups[i].type);
+	}
+	BENCH_LOG("hid_dev_report_enabled","%.1f ns/report",bench_ns_per(start,ROUNDS));
+
+	CHECK_EQ(sum_scan,sum_table);
+	CHECK_EQ(enabled,ROUNDS);
+	CHECK_DONE();
+}
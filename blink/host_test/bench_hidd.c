@@ -0,0 +1,116 @@
+// The keyboard, mouse and consumer report paths through esp_hidd_send_*,
+// hid_dev and the profile, down to the fake GATT server. Per path:
+//   reports/s  notifications the stack took per second of host time,
+//              with the link congesting after LINK_WINDOW of them and
+//              one confirmed per report sent, so the queue is in use
+//   ns/report  host time spent in the send call, per notification
+//   latency    send call to the stack taking the notification, one
+//              report in flight at a time
+// Fails if a path loses a report or the last one is not the last state.
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "check.h"
+#include "hidd_host.h"
+#include "hid_usage.h"
+
+#define CONN_ID 0
+#define REPORTS 20000
+#define LATENCY_SAMPLES 2000
+#define LINK_WINDOW 4
+
+typedef esp_err_t (*send_fn)(int i);
+
+static esp_err_t send_keyboard(int i){
+	// Press and release, every report differs from the one before.
+	uint8_t key=HID_KEY_A+i%26;
+	return esp_hidd_send_keyboard_value(CONN_ID,0,&key,i&1);
+}
+
+static esp_err_t send_mouse(int i){
+	return esp_hidd_send_mouse_value(CONN_ID,i&1,1,-1,0,0);
+}
+
+static esp_err_t send_consumer(int i){
+	return esp_hidd_send_consumer_value(CONN_ID,HID_CONSUMER_VOLUME_UP,i&1);
+}
+
+static void hidd_event(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param){
+	(void)event;
+	(void)param;
+}
+
+static int cmp_ns(const void *a, const void *b){
+	int64_t x=*(const int64_t *)a, y=*(const int64_t *)b;
+	return (x>y)-(x<y);
+}
+
+static void bench_path(const char *name, send_fn send, uint16_t handle, bool coalesces,
+	const uint8_t *last_value, uint16_t len){
+	static int64_t latency[LATENCY_SAMPLES];
+	hid_dev_tx_stats_t before, after;
+	int64_t in_send=0;
+
+	fake_bt_ntf_clear();
+	fake_bt_window(LINK_WINDOW);
+	hid_dev_tx_get_stats(&before);
+	int64_t start=fake_host_ns();
+	for(int i=0;i<REPORTS;i++){
+		int64_t t=fake_host_ns();
+		esp_err_t err=send(i);
+		in_send+=fake_host_ns()-t;
+		// The keyboard FIFO only fills if the host stops confirming.
+		CHECK_EQ(err,ESP_OK);
+		if(fake_bt_unconfirmed(CONN_ID)>=LINK_WINDOW)fake_bt_confirm(CONN_ID);
+	}
+	while(fake_bt_confirm(CONN_ID));
+	int64_t elapsed=fake_host_ns()-start;
+	hid_dev_tx_get_stats(&after);
+
+	size_t sent=fake_bt_ntf_count();
+	uint32_t coalesced=after.coalesced-before.coalesced;
+	CHECK_EQ(sent+coalesced,REPORTS);
+	CHECK(coalesces||coalesced==0);
+	CHECK_EQ(after.dropped-before.dropped,0);
+	const fake_bt_ntf_t *last=fake_bt_ntf(sent-1);
+	CHECK(last&&last->handle==handle&&last->len==len&&!memcmp(last->value,last_value,len));
+
+	fake_bt_ntf_clear();
+	fake_bt_window(0);
+	for(int i=0;i<LATENCY_SAMPLES;i++){
+		int64_t t=fake_host_ns();
+		CHECK_EQ(send(i),ESP_OK);
+		const fake_bt_ntf_t *n=fake_bt_ntf(i);
+		latency[i]=n?n->host_ns-t:0;
+		fake_bt_confirm(CONN_ID);
+	}
+	qsort(latency,LATENCY_SAMPLES,sizeof(latency[0]),cmp_ns);
+
+	BENCH_LOG(name,"%.0f reports/s, %.0f ns/report, latency p50 %lld ns p99 %lld ns max %lld ns",
+		sent*1e9/elapsed,(double)in_send/sent,
+		(long long)latency[LATENCY_SAMPLES/2],(long long)latency[LATENCY_SAMPLES*99/100],
+		(long long)latency[LATENCY_SAMPLES-1]);
+}
+
+int main(void){
+	const esp_bd_addr_t host={0x11,0x22,0x33,0x44,0x55,0x66};
+
+	hidd_host_up(hidd_event);
+	fake_bt_connect(CONN_ID,host);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_KEY_IN_CCC,true);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_MOUSE_IN_CCC,true);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_CC_IN_CCC,true);
+
+	// What the last of REPORTS sends carries, REPORTS-1 is odd.
+	const uint8_t key[HID_KEYBOARD_IN_RPT_LEN]={0,0,HID_KEY_A+(REPORTS-1)%26};
+	const uint8_t mouse[HID_MOUSE_IN_RPT_LEN]={1,1,0xff};
+	const uint8_t consumer[HID_CC_IN_RPT_LEN]={HID_CC_RPT_VOLUME_UP};
+
+	bench_path("hidd keyboard",send_keyboard,hidd_host_handle(HIDD_LE_IDX_REPORT_KEY_IN_VAL),false,
+		key,sizeof(key));
+	bench_path("hidd mouse",send_mouse,hidd_host_handle(HIDD_LE_IDX_REPORT_MOUSE_IN_VAL),true,
+		mouse,sizeof(mouse));
+	bench_path("hidd consumer",send_consumer,hidd_host_handle(HIDD_LE_IDX_REPORT_CC_IN_VAL),true,
+		consumer,sizeof(consumer));
+	CHECK_DONE();
+}
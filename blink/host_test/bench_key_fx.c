@@ -0,0 +1,38 @@
+// Render time per frame for strips of 100 LEDs and more, in the worst
+// case: every ripple running and every key fading.
+#include "bench.h"
+#include "key_fx.h"
+#include "apa102_frame.h"
+
+#define FRAMES 2000
+
+static key_fx_t fx;
+static uint8_t frame[APA102_FRAME_LEN(KEY_FX_MAX_LEDS)];
+
+static void bench(uint16_t leds){
+	key_fx_init(&fx,leds,255);
+	apa102_frame_init(frame,leds);
+	uint32_t now=0;
+	int64_t start=fake_host_ns();
+	for(int f=0;f<FRAMES;f++,now+=16){
+		// Keep KEY_FX_RIPPLES ripples alive and every LED fading.
+		if(f%(KEY_FX_RIPPLE_MS/16/KEY_FX_RIPPLES)==0){
+			for(uint16_t i=0;i<leds;i++){
+				key_fx_key(&fx,i,true,now);
+				key_fx_key(&fx,i,false,now);
+			}
+		}
+		key_fx_render(&fx,frame,now);
+	}
+	double per=bench_ns_per(start,FRAMES);
+	char name[32];
+	snprintf(name,sizeof(name),"key_fx %u leds",leds);
+	BENCH_LOG(name,"%.0f ns/frame, %.1f ns/led",per,per/leds);
+}
+
+int main(void){
+	bench(100);
+	bench(128);
+	bench(KEY_FX_MAX_LEDS);
+	return 0;
+}
@@ -0,0 +1,43 @@
+// Cost per key event of the SPSC ring against the FreeRTOS queue it
+// replaced, one push and a batch pop of 16 per round. The fake queue
+// locks a mutex where the real one takes a critical section.
+#include "bench.h"
+#include "key_ring.h"
+#include "freertos/queue.h"
+
+#define ROUNDS 200000
+#define BATCH 16
+
+static key_ring_t ring;
+
+int main(void){
+	key_event_t ev={.key=4,.flags=KEY_EVENT_DOWN};
+	key_event_t out[BATCH];
+	const long events=(long)ROUNDS*BATCH;
+	uint32_t sum=0;
+
+	int64_t start=fake_host_ns();
+	for(int r=0;r<ROUNDS;r++){
+		for(int i=0;i<BATCH;i++){
+			ev.time_us=i;
+			key_ring_push(&ring,&ev);
+		}
+		size_t n=key_ring_pop(&ring,out,BATCH);
+		for(size_t i=0;i<n;i++)sum+=out[i].time_us;
+	}
+	BENCH_LOG("key_ring","%.1f ns/event",bench_ns_per(start,events));
+
+	QueueHandle_t q=xQueueCreate(KEY_RING_SIZE,sizeof(key_event_t));
+	start=fake_host_ns();
+	for(int r=0;r<ROUNDS;r++){
+		for(int i=0;i<BATCH;i++){
+			ev.time_us=i;
+			xQueueSendToBack(q,&ev,0);
+		}
+		while(xQueueReceive(q,&out[0],0))sum-=out[0].time_us;
+	}
+	BENCH_LOG("key_ring queue","%.1f ns/event",bench_ns_per(start,events));
+
+	// Both moved the same events.
+	return sum!=0||key_ring_overflows(&ring)!=0;
+}
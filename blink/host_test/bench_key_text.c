@@ -0,0 +1,67 @@
+// Cost per character of typing a macro: the layout table streaming into
+// the report builder, against the old app_main way of pushing a press and
+// a release (and Shift around them) per character through a queue that
+// the sender then drains into the same builder.
+#include "bench.h"
+#include "key_text.h"
+#include "hid_usage.h"
+#include "freertos/queue.h"
+
+#define RUNS 20000
+
+static const char text[]="Hello, world!\n";
+
+typedef struct {
+	bool down;
+	uint8_t key;
+} key_press;
+
+static uint32_t reports;
+
+static void count(const kbd_state_t *s){
+	(void)s;
+	reports++;
+}
+
+static void push(QueueHandle_t q, uint8_t key, bool down){
+	key_press k={.down=down,.key=key};
+	xQueueSendToBackFromISR(q,&k,NULL);
+}
+
+int main(void){
+	const long chars=RUNS*(long)(sizeof(text)-1);
+	kbd_report_t r;
+
+	kbd_report_init(&r,count);
+	int64_t start=fake_host_ns();
+	for(int i=0;i<RUNS;i++)key_text_type(&r,key_text_layout_us,text);
+	double table_ns=bench_ns_per(start,chars);
+	uint32_t table_reports=reports;
+
+	QueueHandle_t q=xQueueCreate(1<<7,sizeof(key_press));
+	kbd_report_init(&r,count);
+	reports=0;
+	start=fake_host_ns();
+	for(int i=0;i<RUNS;i++){
+		for(const char *c=text;*c;c++){
+			uint8_t code=key_text_layout_us[(uint8_t)*c];
+			uint8_t key=code&~KEY_TEXT_SHIFT;
+			if(code&KEY_TEXT_SHIFT)push(q,HID_KEY_LEFT_SHIFT,true);
+			push(q,key,true);
+			push(q,key,false);
+			if(code&KEY_TEXT_SHIFT)push(q,HID_KEY_LEFT_SHIFT,false);
+		}
+		key_press k;
+		while(xQueueReceive(q,&k,0))kbd_report_apply(&r,k.key,k.down);
+	}
+	double queue_ns=bench_ns_per(start,chars);
+
+	BENCH_LOG("key_text table","%.1f ns/char",table_ns);
+	BENCH_LOG("key_text queue","%.1f ns/char",queue_ns);
+	// Both ways have to build the same reports.
+	if(reports!=table_reports){
+		fprintf(stderr,"table sent %u reports, queue %u\n",table_reports,reports);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef CHECK_H__
+#define CHECK_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Checks keep going after a failure so one run shows all of them, the
+// test's exit status comes from CHECK_DONE().
+static int check_failures;
+
+#define CHECK(cond) do{ \
+	if(!(cond)){ \
+		fprintf(stderr,"%s:%d: check failed: %s\n",__FILE__,__LINE__,#cond); \
+		check_failures++; \
+	} \
+}while(0)
+
+#define CHECK_EQ(a,b) do{ \
+	long long a__=(long long)(a),b__=(long long)(b); \
+	if(a__!=b__){ \
+		fprintf(stderr,"%s:%d: check failed: %s == %s (%lld != %lld)\n", \
+			__FILE__,__LINE__,#a,#b,a__,b__); \
+		check_failures++; \
+	} \
+}while(0)
+
+#define CHECK_DONE() do{ \
+	if(check_failures)fprintf(stderr,"%d check(s) failed\n",check_failures); \
+	return check_failures?EXIT_FAILURE:EXIT_SUCCESS; \
+}while(0)
+
+#endif /* CHECK_H__ */
@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fake_bt.h"
+#include "fake_idf.h"
+#include "esp_timer.h"
+#include "esp_gatt_common_api.h"
+#include "esp_gap_ble_api.h"
+
+#define MAX_LINKS     8
+#define MAX_PENDING   32 // events raised and not delivered yet
+#define MAX_TABLE     64 // attributes per create_attr_tab
+#define MAX_HANDLES   256
+#define MAX_UNCONFIRMED 64 // per link, older handles are forgotten past this
+
+typedef struct {
+	esp_gatts_cb_event_t event;
+	esp_gatt_if_t gatts_if;
+	esp_ble_gatts_cb_param_t param;
+	// What the param points to, set up on delivery.
+	uint16_t handles[MAX_TABLE];
+	uint8_t value[FAKE_BT_VALUE_MAX];
+} event_t;
+
+typedef struct {
+	bool in_use;
+	bool congested;
+	uint16_t conn_id;
+	int unconfirmed;
+	uint16_t unconfirmed_handle[MAX_UNCONFIRMED]; // oldest at unconfirmed_head
+	int unconfirmed_head;
+} link_t;
+
+static esp_gatts_cb_t gatts_cb;
+static event_t pending[MAX_PENDING];
+static int pending_head, pending_count;
+static bool delivering;
+
+static fake_bt_ntf_t ntf_log[FAKE_BT_NTF_LOG];
+static size_t ntf_count;
+static int refuse;
+static uint32_t refused;
+static int window;
+static link_t links[MAX_LINKS];
+
+static uint32_t next_trans_id=1;
+// Response to the read fake_bt_read() is waiting on.
+static struct {
+	uint32_t trans_id;
+	bool answered;
+	esp_gatt_status_t status;
+	uint16_t len;
+	uint8_t value[FAKE_BT_VALUE_MAX];
+} rsp;
+
+static uint16_t next_handle=1;
+static struct {
+	uint16_t len;
+	uint8_t value[FAKE_BT_VALUE_MAX];
+} attr_values[MAX_HANDLES];
+
+static event_t *raise_event(esp_gatts_cb_event_t event){
+	if(pending_count==MAX_PENDING){
+		fprintf(stderr,"fake_bt: more than %d events pending\n",MAX_PENDING);
+		abort();
+	}
+	event_t *e=&pending[(pending_head+pending_count++)%MAX_PENDING];
+	memset(e,0,sizeof(*e));
+	e->event=event;
+	e->gatts_if=FAKE_BT_GATTS_IF;
+	return e;
+}
+
+// Deliver everything raised so far, unless a callback further up the
+// stack already is.
+static void deliver(void){
+	if(delivering)return;
+	delivering=true;
+	while(pending_count){
+		event_t e=pending[pending_head];
+		pending_head=(pending_head+1)%MAX_PENDING;
+		pending_count--;
+		if(e.event==ESP_GATTS_CREAT_ATTR_TAB_EVT)e.param.add_attr_tab.handles=e.handles;
+		if(e.event==ESP_GATTS_WRITE_EVT)e.param.write.value=e.value;
+		if(gatts_cb)gatts_cb(e.event,e.gatts_if,&e.param);
+	}
+	delivering=false;
+}
+
+static link_t *link_find(uint16_t conn_id){
+	for(int i=0;i<MAX_LINKS;i++)
+		if(links[i].in_use&&links[i].conn_id==conn_id)return &links[i];
+	return NULL;
+}
+
+/* GATT server */
+
+esp_err_t esp_ble_gatts_register_callback(esp_gatts_cb_t callback){
+	gatts_cb=callback;
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_app_register(uint16_t app_id){
+	event_t *e=raise_event(ESP_GATTS_REG_EVT);
+	e->param.reg.status=ESP_GATT_OK;
+	e->param.reg.app_id=app_id;
+	deliver();
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_app_unregister(esp_gatt_if_t gatts_if){
+	return gatts_if==FAKE_BT_GATTS_IF?ESP_OK:ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_ble_gatts_create_attr_tab(const esp_gatts_attr_db_t *db, esp_gatt_if_t gatts_if,
+	uint8_t max_nb_attr, uint8_t srvc_inst_id){
+	if(max_nb_attr>MAX_TABLE||next_handle+max_nb_attr>MAX_HANDLES)return ESP_ERR_NO_MEM;
+	event_t *e=raise_event(ESP_GATTS_CREAT_ATTR_TAB_EVT);
+	e->gatts_if=gatts_if;
+	e->param.add_attr_tab.status=ESP_GATT_OK;
+	e->param.add_attr_tab.svc_inst_id=srvc_inst_id;
+	e->param.add_attr_tab.num_handle=max_nb_attr;
+	// The first attribute declares the service, its value is the UUID.
+	const esp_attr_desc_t *svc=&db[0].att_desc;
+	e->param.add_attr_tab.svc_uuid.len=svc->length;
+	if(svc->length==ESP_UUID_LEN_16)e->param.add_attr_tab.svc_uuid.uuid.uuid16=svc->value[0]|svc->value[1]<<8;
+	else if(svc->length<=ESP_UUID_LEN_128)memcpy(e->param.add_attr_tab.svc_uuid.uuid.uuid128,svc->value,svc->length);
+	for(int i=0;i<max_nb_attr;i++)e->handles[i]=next_handle++;
+	deliver();
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_start_service(uint16_t service_handle){
+	return service_handle&&service_handle<next_handle?ESP_OK:ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_ble_gatts_stop_service(uint16_t service_handle){
+	return esp_ble_gatts_start_service(service_handle);
+}
+
+esp_err_t esp_ble_gatts_delete_service(uint16_t service_handle){
+	return esp_ble_gatts_start_service(service_handle);
+}
+
+esp_err_t esp_ble_gatts_set_attr_value(uint16_t attr_handle, uint16_t length, const uint8_t *value){
+	if(attr_handle>=next_handle||length>FAKE_BT_VALUE_MAX)return ESP_ERR_INVALID_ARG;
+	attr_values[attr_handle].len=length;
+	memcpy(attr_values[attr_handle].value,value,length);
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_get_attr_value(uint16_t attr_handle, uint16_t *length, const uint8_t **value){
+	if(attr_handle>=next_handle)return ESP_ERR_INVALID_ARG;
+	*length=attr_values[attr_handle].len;
+	*value=attr_values[attr_handle].value;
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t attr_handle,
+	uint16_t value_len, uint8_t *value, bool need_confirm){
+	(void)need_confirm;
+	int64_t host_ns=fake_host_ns();
+	link_t *link=link_find(conn_id);
+	if(!link||value_len>FAKE_BT_VALUE_MAX)return ESP_ERR_INVALID_ARG;
+	if(refuse){
+		refuse--;
+		refused++;
+		return ESP_FAIL;
+	}
+	fake_bt_ntf_t *n=&ntf_log[ntf_count++%FAKE_BT_NTF_LOG];
+	n->host_ns=host_ns;
+	n->time_us=esp_timer_get_time();
+	n->gatts_if=gatts_if;
+	n->conn_id=conn_id;
+	n->handle=attr_handle;
+	n->len=value_len;
+	memcpy(n->value,value,value_len);
+	link->unconfirmed_handle[(link->unconfirmed_head+link->unconfirmed)%MAX_UNCONFIRMED]=attr_handle;
+	link->unconfirmed++;
+	if(window&&link->unconfirmed>=window&&!link->congested){
+		link->congested=true;
+		event_t *e=raise_event(ESP_GATTS_CONGEST_EVT);
+		e->param.congest.conn_id=conn_id;
+		e->param.congest.congested=true;
+		deliver();
+	}
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_send_response(esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id,
+	esp_gatt_status_t status, esp_gatt_rsp_t *rsp_value){
+	if(gatts_if!=FAKE_BT_GATTS_IF||!link_find(conn_id)||trans_id!=rsp.trans_id||rsp.answered)return ESP_ERR_INVALID_ARG;
+	if(rsp_value&&rsp_value->attr_value.len>FAKE_BT_VALUE_MAX)return ESP_ERR_INVALID_ARG;
+	rsp.answered=true;
+	rsp.status=status;
+	rsp.len=rsp_value?rsp_value->attr_value.len:0;
+	if(rsp_value)memcpy(rsp.value,rsp_value->attr_value.value,rsp.len);
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu){
+	return mtu>=ESP_GATT_DEF_BLE_MTU_SIZE&&mtu<=ESP_GATT_MAX_MTU_SIZE?ESP_OK:ESP_ERR_INVALID_ARG;
+}
+
+/* GAP */
+
+esp_err_t esp_ble_gap_config_local_icon(uint16_t icon){
+	(void)icon;
+	return ESP_OK;
+}
+
+esp_err_t esp_ble_set_encryption(esp_bd_addr_t bd_addr, esp_ble_sec_act_t sec_act){
+	(void)bd_addr;
+	(void)sec_act;
+	return ESP_OK;
+}
+
+/* Test side */
+
+size_t fake_bt_ntf_count(void){
+	return ntf_count;
+}
+
+const fake_bt_ntf_t *fake_bt_ntf(size_t i){
+	return i<ntf_count&&ntf_count-i<=FAKE_BT_NTF_LOG?&ntf_log[i%FAKE_BT_NTF_LOG]:NULL;
+}
+
+void fake_bt_ntf_clear(void){
+	ntf_count=0;
+}
+
+void fake_bt_refuse(int n){
+	refuse=n;
+}
+
+uint32_t fake_bt_refused(void){
+	return refused;
+}
+
+void fake_bt_window(int notifications){
+	window=notifications;
+}
+
+void fake_bt_connect(uint16_t conn_id, const esp_bd_addr_t bda){
+	link_t *link=NULL;
+	for(int i=0;i<MAX_LINKS&&!link;i++)
+		if(!links[i].in_use)link=&links[i];
+	if(!link||link_find(conn_id)){
+		fprintf(stderr,"fake_bt: cannot connect conn_id %u\n",conn_id);
+		abort();
+	}
+	memset(link,0,sizeof(*link));
+	link->in_use=true;
+	link->conn_id=conn_id;
+	event_t *e=raise_event(ESP_GATTS_CONNECT_EVT);
+	e->param.connect.conn_id=conn_id;
+	memcpy(e->param.connect.remote_bda,bda,sizeof(esp_bd_addr_t));
+	e->param.connect.conn_params.interval=6; // 7.5 ms
+	e->param.connect.conn_params.timeout=400;
+	deliver();
+}
+
+void fake_bt_disconnect(uint16_t conn_id){
+	link_t *link=link_find(conn_id);
+	if(link)link->in_use=false;
+	event_t *e=raise_event(ESP_GATTS_DISCONNECT_EVT);
+	e->param.disconnect.conn_id=conn_id;
+	e->param.disconnect.reason=0x13; // remote user terminated
+	deliver();
+}
+
+void fake_bt_mtu(uint16_t conn_id, uint16_t mtu){
+	event_t *e=raise_event(ESP_GATTS_MTU_EVT);
+	e->param.mtu.conn_id=conn_id;
+	e->param.mtu.mtu=mtu;
+	deliver();
+}
+
+void fake_bt_write(uint16_t conn_id, uint16_t handle, const uint8_t *value, uint16_t len){
+	if(len>FAKE_BT_VALUE_MAX){
+		fprintf(stderr,"fake_bt: %u byte write\n",len);
+		abort();
+	}
+	event_t *e=raise_event(ESP_GATTS_WRITE_EVT);
+	e->param.write.conn_id=conn_id;
+	e->param.write.handle=handle;
+	e->param.write.len=len;
+	memcpy(e->value,value,len);
+	deliver();
+}
+
+esp_gatt_status_t fake_bt_read(uint16_t conn_id, uint16_t handle, uint8_t *value, uint16_t *len){
+	memset(&rsp,0,sizeof(rsp));
+	rsp.trans_id=next_trans_id++;
+	event_t *e=raise_event(ESP_GATTS_READ_EVT);
+	e->param.read.conn_id=conn_id;
+	e->param.read.trans_id=rsp.trans_id;
+	e->param.read.handle=handle;
+	e->param.read.need_rsp=true;
+	deliver();
+	*len=rsp.len;
+	memcpy(value,rsp.value,rsp.len);
+	return rsp.answered?rsp.status:ESP_GATT_ERROR;
+}
+
+void fake_bt_congest(uint16_t conn_id, bool congested){
+	link_t *link=link_find(conn_id);
+	if(link)link->congested=congested;
+	event_t *e=raise_event(ESP_GATTS_CONGEST_EVT);
+	e->param.congest.conn_id=conn_id;
+	e->param.congest.congested=congested;
+	deliver();
+}
+
+bool fake_bt_confirm(uint16_t conn_id){
+	link_t *link=link_find(conn_id);
+	if(!link||!link->unconfirmed)return false;
+	event_t *e=raise_event(ESP_GATTS_CONF_EVT);
+	e->param.conf.status=ESP_GATT_OK;
+	e->param.conf.conn_id=conn_id;
+	e->param.conf.handle=link->unconfirmed_handle[link->unconfirmed_head];
+	link->unconfirmed_head=(link->unconfirmed_head+1)%MAX_UNCONFIRMED;
+	link->unconfirmed--;
+	if(link->congested&&link->unconfirmed<window){
+		link->congested=false;
+		e=raise_event(ESP_GATTS_CONGEST_EVT);
+		e->param.congest.conn_id=conn_id;
+		e->param.congest.congested=false;
+	}
+	deliver();
+	return true;
+}
+
+int fake_bt_unconfirmed(uint16_t conn_id){
+	link_t *link=link_find(conn_id);
+	return link?link->unconfirmed:0;
+}
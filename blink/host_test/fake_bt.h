@@ -0,0 +1,64 @@
+#ifndef FAKE_BT_H__
+#define FAKE_BT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_gatts_api.h"
+
+// Test side of the fake Bluedroid GATT server behind esp_gatts_api.h.
+//
+// Events go to the registered callback on the calling thread, in the order
+// they were raised, the way the BTC task delivers them. Events raised
+// from inside a callback (a table created on REG_EVT, say) are delivered
+// after it returns. The fake_bt_* calls below raise one event each and
+// return once everything pending has been delivered.
+
+#define FAKE_BT_GATTS_IF 3   // interface every app registration gets
+#define FAKE_BT_NTF_LOG  4096
+#define FAKE_BT_VALUE_MAX 32 // longest notification or write kept
+
+// One notification the stack took.
+typedef struct {
+	int64_t host_ns;  // fake_host_ns() at the esp_ble_gatts_send_indicate() call
+	int64_t time_us;  // esp_timer clock then
+	esp_gatt_if_t gatts_if;
+	uint16_t conn_id;
+	uint16_t handle;
+	uint16_t len;
+	uint8_t value[FAKE_BT_VALUE_MAX];
+} fake_bt_ntf_t;
+
+// Notifications taken since the last clear, oldest first. Only the last
+// FAKE_BT_NTF_LOG are kept, fake_bt_ntf() returns NULL for older ones.
+size_t fake_bt_ntf_count(void);
+const fake_bt_ntf_t *fake_bt_ntf(size_t i);
+void fake_bt_ntf_clear(void);
+
+// Refuse the next n notifications with ESP_FAIL, as Bluedroid does when
+// it is out of buffers. Refused ones are not logged.
+void fake_bt_refuse(int n);
+uint32_t fake_bt_refused(void);
+
+// Congest a link once this many of its notifications wait for their
+// ESP_GATTS_CONF_EVT, and clear it when one is confirmed. 0, the default,
+// never congests.
+void fake_bt_window(int notifications);
+
+// Host side of a link.
+void fake_bt_connect(uint16_t conn_id, const esp_bd_addr_t bda);
+void fake_bt_disconnect(uint16_t conn_id);
+void fake_bt_mtu(uint16_t conn_id, uint16_t mtu);
+void fake_bt_write(uint16_t conn_id, uint16_t handle, const uint8_t *value, uint16_t len);
+void fake_bt_congest(uint16_t conn_id, bool congested);
+// Read an attribute answered by the app. Returns the status it responded
+// with, ESP_GATT_ERROR if it did not respond, and the value in value.
+esp_gatt_status_t fake_bt_read(uint16_t conn_id, uint16_t handle, uint8_t *value, uint16_t *len);
+
+// Deliver ESP_GATTS_CONF_EVT for the oldest unconfirmed notification of
+// a link, returns false if there was none.
+bool fake_bt_confirm(uint16_t conn_id);
+// Notifications of a link waiting for their confirm.
+int fake_bt_unconfirmed(uint16_t conn_id);
+
+#endif /* FAKE_BT_H__ */
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "fake_idf.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "soc/gpio_struct.h"
+#include "esp32/rom/ets_sys.h"
+
+static pthread_mutex_t critical=PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+const char *esp_err_to_name(esp_err_t code){
+	switch(code){
+	case ESP_OK: return "ESP_OK";
+	case ESP_FAIL: return "ESP_FAIL";
+	case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+	case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+	case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+	case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+	case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+	case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+	}
+	return "UNKNOWN ERROR";
+}
+
+void fake_error_check_failed(esp_err_t rc, const char *file, int line, const char *expr){
+	fprintf(stderr,"%s:%d: ESP_ERROR_CHECK(%s) failed: %s (0x%x)\n",file,line,expr,esp_err_to_name(rc),rc);
+	abort();
+}
+
+int64_t fake_host_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (int64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+/* Logging */
+
+uint32_t esp_log_timestamp(void){
+	return (uint32_t)(esp_timer_get_time()/1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...){
+	(void)level;
+	(void)tag;
+	va_list ap;
+	va_start(ap,format);
+	vfprintf(stderr,format,ap);
+	va_end(ap);
+}
+
+/* Critical sections */
+
+void vPortEnterCritical(portMUX_TYPE *mux){
+	pthread_mutex_lock(&critical);
+	mux->depth++;
+}
+
+void vPortExitCritical(portMUX_TYPE *mux){
+	mux->depth--;
+	pthread_mutex_unlock(&critical);
+}
+
+static uint32_t isr_yields;
+
+void portYIELD_FROM_ISR(void){
+	isr_yields++;
+}
+
+uint32_t fake_isr_yields(void){
+	uint32_t n=isr_yields;
+	isr_yields=0;
+	return n;
+}
+
+BaseType_t xPortGetCoreID(void){
+	return 0;
+}
+
+/* esp_timer */
+
+struct esp_timer {
+	esp_timer_create_args_t args;
+	int64_t due_us;  // -1 while stopped
+	uint64_t period_us;
+	struct esp_timer *next;
+};
+
+static int64_t now_us;
+static struct esp_timer *timers;
+
+int64_t esp_timer_get_time(void){
+	return now_us;
+}
+
+void fake_time_set(int64_t us){
+	now_us=us;
+}
+
+void fake_time_advance(int64_t us){
+	int64_t end=now_us+us;
+	for(;;){
+		struct esp_timer *first=NULL;
+		for(struct esp_timer *t=timers;t;t=t->next)
+			if(t->due_us>=0&&t->due_us<=end&&(!first||t->due_us<first->due_us))first=t;
+		if(!first)break;
+		if(first->due_us>now_us)now_us=first->due_us;
+		first->due_us=first->period_us?first->due_us+(int64_t)first->period_us:-1;
+		first->args.callback(first->args.arg);
+	}
+	now_us=end;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out){
+	struct esp_timer *t=calloc(1,sizeof(*t));
+	if(!t)return ESP_ERR_NO_MEM;
+	t->args=*args;
+	t->due_us=-1;
+	t->next=timers;
+	timers=t;
+	*out=t;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t timeout_us){
+	if(t->due_us>=0)return ESP_ERR_INVALID_STATE;
+	t->due_us=now_us+(int64_t)timeout_us;
+	t->period_us=0;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t period_us){
+	if(t->due_us>=0)return ESP_ERR_INVALID_STATE;
+	t->due_us=now_us+(int64_t)period_us;
+	t->period_us=period_us;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t){
+	if(t->due_us<0)return ESP_ERR_INVALID_STATE;
+	t->due_us=-1;
+	return ESP_OK;
+}
+
+/* Queues */
+
+struct fake_queue {
+	pthread_mutex_t lock;
+	UBaseType_t depth;
+	UBaseType_t size;
+	UBaseType_t head; // next item out
+	UBaseType_t count;
+	uint8_t items[];
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t depth, UBaseType_t size){
+	QueueHandle_t q=calloc(1,sizeof(*q)+(size_t)depth*size);
+	if(!q)return NULL;
+	pthread_mutex_init(&q->lock,NULL);
+	q->depth=depth;
+	q->size=size;
+	return q;
+}
+
+void vQueueDelete(QueueHandle_t q){
+	pthread_mutex_destroy(&q->lock);
+	free(q);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t wait){
+	(void)wait;
+	BaseType_t ret=pdFALSE;
+	pthread_mutex_lock(&q->lock);
+	if(q->count<q->depth){
+		memcpy(q->items+(size_t)((q->head+q->count)%q->depth)*q->size,item,q->size);
+		q->count++;
+		ret=pdTRUE;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return ret;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait){
+	return xQueueSendToBack(q,item,wait);
+}
+
+BaseType_t xQueueSendToBackFromISR(QueueHandle_t q, const void *item, BaseType_t *woken){
+	BaseType_t ret=xQueueSendToBack(q,item,0);
+	// A waiting receiver would be woken, the host has none but says so
+	// like the real queue does for a higher priority one.
+	if(ret&&woken)*woken=pdTRUE;
+	return ret;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken){
+	return xQueueSendToBackFromISR(q,item,woken);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait){
+	(void)wait;
+	BaseType_t ret=pdFALSE;
+	pthread_mutex_lock(&q->lock);
+	if(q->count){
+		memcpy(item,q->items+(size_t)q->head*q->size,q->size);
+		q->head=(q->head+1)%q->depth;
+		q->count--;
+		ret=pdTRUE;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return ret;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q){
+	pthread_mutex_lock(&q->lock);
+	UBaseType_t n=q->count;
+	pthread_mutex_unlock(&q->lock);
+	return n;
+}
+
+/* Semaphores */
+
+struct fake_semaphore {
+	pthread_mutex_t lock;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void){
+	SemaphoreHandle_t sem=calloc(1,sizeof(*sem));
+	if(!sem)return NULL;
+	pthread_mutex_init(&sem->lock,NULL);
+	return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait){
+	(void)wait;
+	pthread_mutex_lock(&sem->lock);
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem){
+	pthread_mutex_unlock(&sem->lock);
+	return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem){
+	pthread_mutex_destroy(&sem->lock);
+	free(sem);
+}
+
+/* GPIO */
+
+static struct {
+	gpio_mode_t mode;
+	gpio_int_type_t intr;
+	gpio_isr_t isr;
+	void *arg;
+	bool intr_off;
+	int level;
+	uint32_t writes;
+} pins[GPIO_NUM_MAX];
+static bool isr_service;
+
+static bool gpio_valid(gpio_num_t gpio){
+	return gpio>=0&&gpio<GPIO_NUM_MAX;
+}
+
+void gpio_pad_select_gpio(uint8_t gpio){
+	(void)gpio;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode){
+	if(!gpio_valid(gpio))return ESP_ERR_INVALID_ARG;
+	pins[gpio].mode=mode;
+	return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level){
+	if(!gpio_valid(gpio))return ESP_ERR_INVALID_ARG;
+	pins[gpio].level=level!=0;
+	pins[gpio].writes++;
+	return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio){
+	return gpio_valid(gpio)?pins[gpio].level:0;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio, gpio_pull_mode_t pull){
+	if(!gpio_valid(gpio))return ESP_ERR_INVALID_ARG;
+	if(pull==GPIO_PULLUP_ONLY)pins[gpio].level=1;
+	return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type){
+	if(!gpio_valid(gpio))return ESP_ERR_INVALID_ARG;
+	pins[gpio].intr=type;
+	return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio){
+	if(!gpio_valid(gpio))return ESP_ERR_INVALID_ARG;
+	pins[gpio].intr_off=false;
+	return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio){
+	if(!gpio_valid(gpio))return ESP_ERR_INVALID_ARG;
+	pins[gpio].intr_off=true;
+	return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t *cfg){
+	if(cfg->pin_bit_mask>>GPIO_NUM_MAX)return ESP_ERR_INVALID_ARG;
+	for(int gpio=0;gpio<GPIO_NUM_MAX;gpio++){
+		if(!(cfg->pin_bit_mask>>gpio&1))continue;
+		pins[gpio].mode=cfg->mode;
+		pins[gpio].intr=cfg->intr_type;
+		pins[gpio].intr_off=cfg->intr_type==GPIO_INTR_DISABLE;
+		if(cfg->pull_up_en)pins[gpio].level=1;
+	}
+	return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags){
+	(void)flags;
+	if(isr_service)return ESP_ERR_INVALID_STATE;
+	isr_service=true;
+	return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t isr, void *arg){
+	if(!isr_service)return ESP_ERR_INVALID_STATE;
+	if(!gpio_valid(gpio))return ESP_ERR_INVALID_ARG;
+	pins[gpio].isr=isr;
+	pins[gpio].arg=arg;
+	return ESP_OK;
+}
+
+void fake_gpio_edge(int gpio, bool level){
+	if(!gpio_valid(gpio)||pins[gpio].level==level)return;
+	pins[gpio].level=level;
+	gpio_int_type_t intr=pins[gpio].intr;
+	bool fire=intr==GPIO_INTR_ANYEDGE||
+		(intr==GPIO_INTR_POSEDGE&&level)||(intr==GPIO_INTR_NEGEDGE&&!level);
+	if(fire&&!pins[gpio].intr_off&&pins[gpio].isr)pins[gpio].isr(pins[gpio].arg);
+}
+
+int fake_gpio_out(int gpio){
+	return gpio_valid(gpio)?pins[gpio].level:-1;
+}
+
+uint32_t fake_gpio_writes(int gpio){
+	return gpio_valid(gpio)?pins[gpio].writes:0;
+}
+
+gpio_dev_t GPIO;
+static uint64_t (*matrix_read)(uint32_t driven);
+
+void fake_gpio_matrix(uint64_t (*read)(uint32_t driven)){
+	matrix_read=read;
+}
+
+void ets_delay_us(uint32_t us){
+	(void)us;
+	if(!matrix_read)return;
+	uint64_t in=matrix_read(GPIO.out_w1ts);
+	GPIO.in=(uint32_t)in;
+	GPIO.in1.data=in>>32;
+}
+
+int rtc_io_number_get(gpio_num_t gpio){
+	// GPIO of each RTC pin, RTC pin 0 first.
+	static const uint8_t rtc_gpio[]={36,37,38,39,34,35,25,26,33,32,4,0,2,15,13,12,14,27};
+	for(int n=0;n<(int)sizeof(rtc_gpio);n++)
+		if(rtc_gpio[n]==gpio)return n;
+	return -1;
+}
+
+esp_err_t rtc_gpio_init(gpio_num_t gpio){ return gpio_valid(gpio)?ESP_OK:ESP_ERR_INVALID_ARG; }
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio){ return gpio_valid(gpio)?ESP_OK:ESP_ERR_INVALID_ARG; }
+esp_err_t rtc_gpio_set_direction(gpio_num_t gpio, rtc_gpio_mode_t mode){ (void)mode; return rtc_gpio_init(gpio); }
+esp_err_t rtc_gpio_set_level(gpio_num_t gpio, uint32_t level){ return gpio_set_level(gpio,level); }
+esp_err_t rtc_gpio_pullup_en(gpio_num_t gpio){ return rtc_gpio_init(gpio); }
+esp_err_t rtc_gpio_pullup_dis(gpio_num_t gpio){ return rtc_gpio_init(gpio); }
+esp_err_t rtc_gpio_pulldown_en(gpio_num_t gpio){ return rtc_gpio_init(gpio); }
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t gpio){ return rtc_gpio_init(gpio); }
+esp_err_t rtc_gpio_hold_en(gpio_num_t gpio){ return rtc_gpio_init(gpio); }
+esp_err_t rtc_gpio_hold_dis(gpio_num_t gpio){ return rtc_gpio_init(gpio); }
+
+/* Sleep */
+
+static esp_sleep_wakeup_cause_t wakeup_cause;
+
+void fake_sleep_wakeup(int cause){
+	wakeup_cause=cause;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void){
+	return wakeup_cause;
+}
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode){
+	(void)mode;
+	return mask>>GPIO_NUM_MAX?ESP_ERR_INVALID_ARG:ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ulp_wakeup(void){
+	return ESP_OK;
+}
+
+/* System */
+
+esp_reset_reason_t esp_reset_reason(void){
+	return ESP_RST_POWERON;
+}
+
+uint32_t esp_get_free_heap_size(void){
+	return 200*1024;
+}
+
+/* NVS */
+
+#define NVS_MAX_NAMESPACES 4
+#define NVS_MAX_KEYS 16
+
+static struct {
+	char name[16];
+	struct {
+		char key[16];
+		uint64_t value;
+	} keys[NVS_MAX_KEYS];
+	int count;
+} nvs_spaces[NVS_MAX_NAMESPACES];
+
+// Handles are the namespace index plus one, so 0 is never valid.
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle){
+	for(int i=0;i<NVS_MAX_NAMESPACES;i++){
+		if(!strcmp(nvs_spaces[i].name,name)){
+			*out_handle=i+1;
+			return ESP_OK;
+		}
+	}
+	// Like on flash, a namespace only comes into being when opened for writing.
+	if(open_mode==NVS_READONLY)return ESP_ERR_NVS_NOT_FOUND;
+	for(int i=0;i<NVS_MAX_NAMESPACES;i++){
+		if(!nvs_spaces[i].name[0]){
+			snprintf(nvs_spaces[i].name,sizeof(nvs_spaces[i].name),"%s",name);
+			*out_handle=i+1;
+			return ESP_OK;
+		}
+	}
+	return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out_value){
+	if(handle<1||handle>NVS_MAX_NAMESPACES)return ESP_ERR_INVALID_ARG;
+	for(int i=0;i<nvs_spaces[handle-1].count;i++){
+		if(!strcmp(nvs_spaces[handle-1].keys[i].key,key)){
+			*out_value=nvs_spaces[handle-1].keys[i].value;
+			return ESP_OK;
+		}
+	}
+	return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value){
+	if(handle<1||handle>NVS_MAX_NAMESPACES)return ESP_ERR_INVALID_ARG;
+	int i;
+	for(i=0;i<nvs_spaces[handle-1].count;i++)
+		if(!strcmp(nvs_spaces[handle-1].keys[i].key,key))break;
+	if(i==NVS_MAX_KEYS)return ESP_ERR_NO_MEM;
+	if(i==nvs_spaces[handle-1].count){
+		snprintf(nvs_spaces[handle-1].keys[i].key,sizeof(nvs_spaces[handle-1].keys[i].key),"%s",key);
+		nvs_spaces[handle-1].count++;
+	}
+	nvs_spaces[handle-1].keys[i].value=value;
+	return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle){
+	return handle>=1&&handle<=NVS_MAX_NAMESPACES?ESP_OK:ESP_ERR_INVALID_ARG;
+}
+
+void nvs_close(nvs_handle_t handle){
+	(void)handle;
+}
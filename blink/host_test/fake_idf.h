@@ -0,0 +1,35 @@
+#ifndef FAKE_IDF_H__
+#define FAKE_IDF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Test side controls of the fakes behind stubs/.
+
+// Fake esp_timer clock. Advancing it runs every esp_timer that came due,
+// in deadline order, with the clock set to its deadline.
+void fake_time_set(int64_t now_us);
+void fake_time_advance(int64_t us);
+
+// Drive an input pin, runs its ISR handler if it has an edge interrupt
+// armed and the level changed.
+void fake_gpio_edge(int gpio, bool level);
+// Level an output was last set to, and how many times it was written.
+int fake_gpio_out(int gpio);
+uint32_t fake_gpio_writes(int gpio);
+
+// Key matrix wiring: returns the levels of all input pins, GPIO0 in bit 0,
+// while the output pins in driven (GPIO.out_w1ts) are high. GPIO.in/in1
+// are refreshed from it on every ets_delay_us().
+void fake_gpio_matrix(uint64_t (*read)(uint32_t driven));
+
+// Cause esp_sleep_get_wakeup_cause() reports.
+void fake_sleep_wakeup(int cause);
+
+// Yields requested with portYIELD_FROM_ISR since the last call.
+uint32_t fake_isr_yields(void);
+
+// Monotonic host time for the benchmarks, not the fake clock.
+int64_t fake_host_ns(void);
+
+#endif /* FAKE_IDF_H__ */
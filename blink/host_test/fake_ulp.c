@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "fake_ulp.h"
+#include "esp32/ulp.h"
+#include "soc/rtc_io_reg.h"
+
+#define MAX_LABELS 64
+#define MAX_STEPS  10000 // per run, a program that never halts fails the test
+
+uint32_t fake_rtc_slow_mem[RTC_SLOW_MEM_WORDS];
+
+static uint32_t (*pins_read)(uint32_t driven);
+static uint32_t entry;
+static uint32_t period_us;
+static bool timer_en;
+static uint32_t rtc_gpio_out; // RTC_GPIO_OUT_REG
+
+static void fail(const char *what, uint32_t pc, uint32_t word){
+	fprintf(stderr,"fake_ulp: %s at %u (0x%08x)\n",what,(unsigned)pc,(unsigned)word);
+	abort();
+}
+
+/* Loader */
+
+static int label_find(const uint16_t label[], int n, uint16_t num){
+	for(int i=0;i<n;i++)
+		if(label[i]==num)return i;
+	return -1;
+}
+
+esp_err_t ulp_process_macros_and_load(uint32_t load_addr, const ulp_insn_t *program, size_t *psize){
+	uint16_t label[MAX_LABELS], label_addr[MAX_LABELS];
+	int labels=0;
+	uint32_t words=0;
+
+	if(load_addr>=RTC_SLOW_MEM_WORDS)return ESP_ERR_ULP_INVALID_LOAD_ADDR;
+	for(size_t i=0;i<*psize;i++){
+		const ulp_insn_t *in=&program[i];
+		if(in->macro.opcode!=OPCODE_MACRO)words++;
+		else if(in->macro.sub_opcode==SUB_OPCODE_MACRO_LABEL){
+			if(label_find(label,labels,in->macro.label)>=0)return ESP_ERR_ULP_DUPLICATE_LABEL;
+			if(labels==MAX_LABELS)return ESP_ERR_NO_MEM;
+			label[labels]=in->macro.label;
+			label_addr[labels++]=load_addr+words;
+		}
+	}
+	if(load_addr+words>RTC_SLOW_MEM_WORDS)return ESP_ERR_ULP_SIZE_TOO_BIG;
+
+	uint32_t pc=load_addr;
+	int branch=-1; // label the next instruction branches to
+	for(size_t i=0;i<*psize;i++){
+		ulp_insn_t in=program[i];
+		if(in.macro.opcode==OPCODE_MACRO){
+			if(in.macro.sub_opcode==SUB_OPCODE_MACRO_BRANCH){
+				if((branch=label_find(label,labels,in.macro.label))<0)return ESP_ERR_ULP_UNDEFINED_LABEL;
+			}
+			continue;
+		}
+		if(branch>=0){
+			if(in.b.opcode!=OPCODE_BRANCH)return ESP_ERR_INVALID_ARG;
+			if(in.b.sub_opcode==SUB_OPCODE_BX)in.bx.addr=label_addr[branch];
+			else{
+				int offset=(int)label_addr[branch]-(int)pc;
+				if(abs(offset)>127)return ESP_ERR_ULP_BRANCH_OUT_OF_RANGE;
+				in.b.offset=abs(offset);
+				in.b.sign=offset<0;
+			}
+			branch=-1;
+		}
+		RTC_SLOW_MEM[pc++]=in.instruction;
+	}
+	*psize=words;
+	return ESP_OK;
+}
+
+esp_err_t ulp_run(uint32_t entry_point){
+	if(entry_point>=RTC_SLOW_MEM_WORDS)return ESP_ERR_INVALID_ARG;
+	entry=entry_point;
+	timer_en=true;
+	return ESP_OK;
+}
+
+esp_err_t ulp_set_wakeup_period(size_t period_index, uint32_t period){
+	if(period_index>4)return ESP_ERR_INVALID_ARG;
+	if(period_index==0)period_us=period;
+	return ESP_OK;
+}
+
+/* Registers */
+
+static uint32_t reg_addr(uint32_t periph_sel, uint32_t addr){
+	static const uint32_t base[]={DR_REG_RTCCNTL_BASE,DR_REG_RTCIO_BASE,DR_REG_SENS_BASE,DR_REG_RTC_I2C_BASE};
+	return base[periph_sel]+addr*4;
+}
+
+static uint32_t reg_read(uint32_t reg, uint32_t pc, uint32_t word){
+	if(reg==RTC_GPIO_OUT_REG)return rtc_gpio_out;
+	if(reg==RTC_GPIO_IN_REG){
+		uint32_t in=pins_read?pins_read(rtc_gpio_out>>RTC_GPIO_OUT_DATA_S):0;
+		return in<<RTC_GPIO_IN_NEXT_S;
+	}
+	fail("read of an unmodelled register",pc,word);
+	return 0;
+}
+
+// Write val into the bits under mask, as WR_REG does.
+static void reg_write(uint32_t reg, uint32_t mask, uint32_t val, uint32_t pc, uint32_t word){
+	if(reg==RTC_GPIO_OUT_REG)rtc_gpio_out=(rtc_gpio_out&~mask)|val;
+	else if(reg==RTC_GPIO_OUT_W1TS_REG)rtc_gpio_out|=val;
+	else if(reg==RTC_GPIO_OUT_W1TC_REG)rtc_gpio_out&=~val;
+	else if(reg==RTC_CNTL_STATE0_REG&&mask==1u<<RTC_CNTL_ULP_CP_SLP_TIMER_EN_S)timer_en=val!=0;
+	else fail("write to an unmodelled register",pc,word);
+}
+
+static uint32_t field_mask(uint32_t low, uint32_t high){
+	uint32_t bits=high-low+1;
+	return (bits>=32?0xffffffffu:(1u<<bits)-1)<<low;
+}
+
+/* Interpreter */
+
+bool fake_ulp_tick(void){
+	uint16_t r[4]={0};
+	bool zero=false, overflow=false, woke=false;
+	uint32_t pc=entry;
+
+	if(!timer_en)return false;
+	for(int step=0;;step++){
+		if(step==MAX_STEPS)fail("no halt",pc,0);
+		if(pc>=RTC_SLOW_MEM_WORDS)fail("pc out of memory",pc,0);
+		ulp_insn_t in={ .instruction=RTC_SLOW_MEM[pc] };
+		uint32_t next=pc+1;
+		switch(in.halt.opcode){
+		case OPCODE_WR_REG:{
+			if(in.wr_reg.high<in.wr_reg.low)fail("bad field",pc,in.instruction);
+			uint32_t mask=field_mask(in.wr_reg.low,in.wr_reg.high);
+			reg_write(reg_addr(in.wr_reg.periph_sel,in.wr_reg.addr),mask,
+				((uint32_t)in.wr_reg.data<<in.wr_reg.low)&mask,pc,in.instruction);
+			break;
+		}
+		case OPCODE_RD_REG:
+			if(in.rd_reg.high<in.rd_reg.low)fail("bad field",pc,in.instruction);
+			r[R0]=(reg_read(reg_addr(in.rd_reg.periph_sel,in.rd_reg.addr),pc,in.instruction)
+				&field_mask(in.rd_reg.low,in.rd_reg.high))>>in.rd_reg.low;
+			break;
+		case OPCODE_DELAY:
+			break;
+		case OPCODE_ST:{
+			if(in.st.sub_opcode!=SUB_OPCODE_ST)fail("unsupported store",pc,in.instruction);
+			uint32_t addr=r[in.st.sreg]+in.st.offset;
+			if(addr>=RTC_SLOW_MEM_WORDS)fail("store out of memory",pc,in.instruction);
+			// The upper half gets the PC and the address register.
+			RTC_SLOW_MEM[addr]=r[in.st.dreg]|(pc<<5|in.st.sreg)<<16;
+			break;
+		}
+		case OPCODE_LD:{
+			uint32_t addr=r[in.ld.sreg]+in.ld.offset;
+			if(addr>=RTC_SLOW_MEM_WORDS)fail("load out of memory",pc,in.instruction);
+			r[in.ld.dreg]=RTC_SLOW_MEM[addr]&0xffff;
+			break;
+		}
+		case OPCODE_ALU:{
+			uint32_t a, b, dreg, res;
+			if(in.alu_reg.sub_opcode==SUB_OPCODE_ALU_REG){
+				a=r[in.alu_reg.sreg];
+				b=r[in.alu_reg.treg];
+				dreg=in.alu_reg.dreg;
+			}else if(in.alu_imm.sub_opcode==SUB_OPCODE_ALU_IMM){
+				a=r[in.alu_imm.sreg];
+				b=in.alu_imm.imm;
+				dreg=in.alu_imm.dreg;
+			}else{
+				fail("unsupported ALU op",pc,in.instruction);
+				break;
+			}
+			switch(in.alu_reg.sel){
+			case ALU_SEL_ADD: res=a+b; break;
+			case ALU_SEL_SUB: res=a-b; break;
+			case ALU_SEL_AND: res=a&b; break;
+			case ALU_SEL_OR:  res=a|b; break;
+			// The immediate form moves imm, the register form sreg.
+			case ALU_SEL_MOV: res=in.alu_reg.sub_opcode==SUB_OPCODE_ALU_IMM?b:a; break;
+			case ALU_SEL_LSH: res=b<16?a<<b:0; break;
+			case ALU_SEL_RSH: res=b<16?a>>b:0; break;
+			default: fail("unsupported ALU op",pc,in.instruction); res=0;
+			}
+			r[dreg]=res&0xffff;
+			zero=r[dreg]==0;
+			overflow=res>0xffff;
+			break;
+		}
+		case OPCODE_BRANCH:
+			if(in.bx.sub_opcode==SUB_OPCODE_BX){
+				uint32_t to=in.bx.reg?r[in.bx.dreg]:in.bx.addr;
+				if(in.bx.type==BX_JUMP_TYPE_DIRECT||(in.bx.type==BX_JUMP_TYPE_ZERO&&zero)
+					||(in.bx.type==BX_JUMP_TYPE_OVF&&overflow))next=to;
+				else if(in.bx.type>BX_JUMP_TYPE_OVF)fail("bad jump type",pc,in.instruction);
+			}else if(in.b.sub_opcode==SUB_OPCODE_B){
+				bool taken=in.b.cmp==B_CMP_L?r[R0]<in.b.imm:r[R0]>=in.b.imm;
+				if(taken)next=in.b.sign?pc-in.b.offset:pc+in.b.offset;
+			}else fail("unsupported branch",pc,in.instruction);
+			break;
+		case OPCODE_END:
+			if(in.end.sub_opcode!=SUB_OPCODE_END)fail("unsupported end",pc,in.instruction);
+			woke|=in.end.wakeup;
+			break;
+		case OPCODE_HALT:
+			return woke;
+		default:
+			fail("unsupported instruction",pc,in.instruction);
+		}
+		pc=next;
+	}
+}
+
+/* Test side */
+
+void fake_ulp_pins(uint32_t (*read)(uint32_t driven)){
+	pins_read=read;
+}
+
+bool fake_ulp_running(void){
+	return timer_en;
+}
+
+uint32_t fake_ulp_period_us(void){
+	return period_us;
+}
+
+uint32_t fake_ulp_driven(void){
+	return rtc_gpio_out>>RTC_GPIO_OUT_DATA_S;
+}
@@ -0,0 +1,31 @@
+#ifndef FAKE_ULP_H__
+#define FAKE_ULP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Test side of the fake ULP coprocessor behind esp32/ulp.h.
+//
+// ulp_process_macros_and_load() encodes the program into RTC_SLOW_MEM the
+// way IDF does, and fake_ulp_tick() interprets the words found there. Of
+// the RTC registers only the GPIO output and input registers and the ULP
+// timer enable exist, anything else aborts the test.
+
+// RTC pin wiring: returns the levels of the RTC input pins, RTC pin 0 in
+// bit 0, while the RTC pins in driven (RTC_GPIO_OUT) are high.
+void fake_ulp_pins(uint32_t (*read)(uint32_t driven));
+
+// One ULP timer expiry: runs the program from the ulp_run() entry point
+// until it halts, if ulp_run() started it and it has not stopped the
+// timer since. Returns true if it woke the CPU.
+bool fake_ulp_tick(void);
+
+// Whether the ULP timer still runs, and the period ulp_set_wakeup_period()
+// set for it.
+bool fake_ulp_running(void);
+uint32_t fake_ulp_period_us(void);
+
+// RTC pins driven high when the last run halted.
+uint32_t fake_ulp_driven(void);
+
+#endif /* FAKE_ULP_H__ */
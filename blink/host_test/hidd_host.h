@@ -0,0 +1,28 @@
+#ifndef HIDD_HOST_H__
+#define HIDD_HOST_H__
+
+#include "fake_bt.h"
+#include "esp_hidd_prf_api.h"
+#include "hidd_le_prf_int.h"
+#include "hid_dev.h"
+
+// The HID profile on the fake stack, brought up in the order blink.c
+// does it. Registering creates the battery and HID tables.
+static inline void hidd_host_up(esp_hidd_event_cb_t cb){
+	ESP_ERROR_CHECK(hid_dev_init());
+	ESP_ERROR_CHECK(esp_hidd_profile_init());
+	ESP_ERROR_CHECK(esp_hidd_register_callbacks(cb));
+}
+
+// Handle of a HIDD_LE_IDX_* attribute.
+static inline uint16_t hidd_host_handle(int idx){
+	return hidd_le_env.hidd_inst.att_tbl[idx];
+}
+
+// The host writes a CCCD, HIDD_LE_IDX_*_CCC or _NTF_CFG.
+static inline void hidd_host_subscribe(uint16_t conn_id, int ccc_idx, bool on){
+	uint8_t value[2]={on,0};
+	fake_bt_write(conn_id,hidd_host_handle(ccc_idx),value,sizeof(value));
+}
+
+#endif /* HIDD_HOST_H__ */
@@ -0,0 +1,28 @@
+#ifndef RTC_IO_H__
+#define RTC_IO_H__
+
+#include "driver/gpio.h"
+
+typedef enum {
+	RTC_GPIO_MODE_INPUT_ONLY,
+	RTC_GPIO_MODE_OUTPUT_ONLY,
+	RTC_GPIO_MODE_INPUT_OUTPUT,
+	RTC_GPIO_MODE_DISABLED,
+} rtc_gpio_mode_t;
+
+// RTC pin number of an RTC capable GPIO, -1 for the others.
+int rtc_io_number_get(gpio_num_t gpio);
+
+// Accept everything, the pins keep their fake GPIO state.
+esp_err_t rtc_gpio_init(gpio_num_t gpio);
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio);
+esp_err_t rtc_gpio_set_direction(gpio_num_t gpio, rtc_gpio_mode_t mode);
+esp_err_t rtc_gpio_set_level(gpio_num_t gpio, uint32_t level);
+esp_err_t rtc_gpio_pullup_en(gpio_num_t gpio);
+esp_err_t rtc_gpio_pullup_dis(gpio_num_t gpio);
+esp_err_t rtc_gpio_pulldown_en(gpio_num_t gpio);
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t gpio);
+esp_err_t rtc_gpio_hold_en(gpio_num_t gpio);
+esp_err_t rtc_gpio_hold_dis(gpio_num_t gpio);
+
+#endif /* RTC_IO_H__ */
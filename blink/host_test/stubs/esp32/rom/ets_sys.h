@@ -0,0 +1,9 @@
+#ifndef ETS_SYS_H__
+#define ETS_SYS_H__
+
+#include <stdint.h>
+
+// Does not move the fake clock, it samples the GPIO input model instead.
+void ets_delay_us(uint32_t us);
+
+#endif /* ETS_SYS_H__ */
@@ -0,0 +1,241 @@
+#ifndef ULP_H__
+#define ULP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "soc/soc.h"
+#include "soc/rtc_cntl_reg.h"
+
+// The ULP FSM instruction set of IDF's esp32/ulp.h, same encoding, for
+// the instructions the fake in fake_ulp.c runs: no ADC, I2C, TSENS, stage
+// counter or sleep register select.
+
+#define R0 0
+#define R1 1
+#define R2 2
+#define R3 3
+
+#define OPCODE_WR_REG 1
+#define OPCODE_RD_REG 2
+#define RD_REG_PERIPH_RTC_CNTL 0
+#define RD_REG_PERIPH_RTC_IO   1
+#define RD_REG_PERIPH_SENS     2
+#define RD_REG_PERIPH_RTC_I2C  3
+#define OPCODE_DELAY 4
+#define OPCODE_ST 6
+#define SUB_OPCODE_ST 4
+#define OPCODE_ALU 7
+#define SUB_OPCODE_ALU_REG 0
+#define SUB_OPCODE_ALU_IMM 1
+#define ALU_SEL_ADD 0
+#define ALU_SEL_SUB 1
+#define ALU_SEL_AND 2
+#define ALU_SEL_OR  3
+#define ALU_SEL_MOV 4
+#define ALU_SEL_LSH 5
+#define ALU_SEL_RSH 6
+#define OPCODE_BRANCH 8
+#define SUB_OPCODE_BX 0
+#define BX_JUMP_TYPE_DIRECT 0
+#define BX_JUMP_TYPE_ZERO   1
+#define BX_JUMP_TYPE_OVF    2
+#define SUB_OPCODE_B 1
+#define B_CMP_L  0
+#define B_CMP_GE 1
+#define OPCODE_END 9
+#define SUB_OPCODE_END 0
+#define OPCODE_HALT 11
+#define OPCODE_LD 13
+#define OPCODE_MACRO 15
+#define SUB_OPCODE_MACRO_LABEL  0
+#define SUB_OPCODE_MACRO_BRANCH 1
+
+#define ESP_ERR_ULP_BASE                0x1200
+#define ESP_ERR_ULP_SIZE_TOO_BIG        (ESP_ERR_ULP_BASE+1)
+#define ESP_ERR_ULP_INVALID_LOAD_ADDR   (ESP_ERR_ULP_BASE+2)
+#define ESP_ERR_ULP_DUPLICATE_LABEL     (ESP_ERR_ULP_BASE+3)
+#define ESP_ERR_ULP_UNDEFINED_LABEL     (ESP_ERR_ULP_BASE+4)
+#define ESP_ERR_ULP_BRANCH_OUT_OF_RANGE (ESP_ERR_ULP_BASE+5)
+
+typedef union {
+	struct {
+		uint32_t cycles:16;
+		uint32_t unused:12;
+		uint32_t opcode:4;
+	} delay;
+	struct {
+		uint32_t dreg:2;       // register with the value
+		uint32_t sreg:2;       // register with the word address
+		uint32_t unused1:6;
+		uint32_t offset:11;
+		uint32_t unused2:4;
+		uint32_t sub_opcode:3;
+		uint32_t opcode:4;
+	} st;
+	struct {
+		uint32_t dreg:2;
+		uint32_t sreg:2;
+		uint32_t unused1:6;
+		uint32_t offset:11;
+		uint32_t unused2:7;
+		uint32_t opcode:4;
+	} ld;
+	struct {
+		uint32_t unused:28;
+		uint32_t opcode:4;
+	} halt;
+	struct {
+		uint32_t dreg:2;
+		uint32_t addr:11;      // in words
+		uint32_t unused:8;
+		uint32_t reg:1;        // target in dreg instead of addr
+		uint32_t type:3;
+		uint32_t sub_opcode:3;
+		uint32_t opcode:4;
+	} bx;
+	struct {
+		uint32_t imm:16;
+		uint32_t cmp:1;
+		uint32_t offset:7;
+		uint32_t sign:1;
+		uint32_t sub_opcode:3;
+		uint32_t opcode:4;
+	} b;
+	struct {
+		uint32_t dreg:2;
+		uint32_t sreg:2;
+		uint32_t treg:2;
+		uint32_t unused:15;
+		uint32_t sel:4;
+		uint32_t sub_opcode:3;
+		uint32_t opcode:4;
+	} alu_reg;
+	struct {
+		uint32_t dreg:2;
+		uint32_t sreg:2;
+		uint32_t imm:16;
+		uint32_t unused:1;
+		uint32_t sel:4;
+		uint32_t sub_opcode:3;
+		uint32_t opcode:4;
+	} alu_imm;
+	struct {
+		uint32_t addr:8;       // in words from the peripheral base
+		uint32_t periph_sel:2;
+		uint32_t data:8;
+		uint32_t low:5;
+		uint32_t high:5;
+		uint32_t opcode:4;
+	} wr_reg;
+	struct {
+		uint32_t addr:8;
+		uint32_t periph_sel:2;
+		uint32_t unused:8;
+		uint32_t low:5;
+		uint32_t high:5;
+		uint32_t opcode:4;
+	} rd_reg;
+	struct {
+		uint32_t wakeup:1;
+		uint32_t unused:24;
+		uint32_t sub_opcode:3;
+		uint32_t opcode:4;
+	} end;
+	struct {
+		uint32_t label:16;
+		uint32_t unused:8;
+		uint32_t sub_opcode:4;
+		uint32_t opcode:4;
+	} macro;
+	uint32_t instruction;
+} ulp_insn_t;
+
+static inline uint32_t SOC_REG_TO_ULP_PERIPH_SEL(uint32_t reg){
+	uint32_t ret=3;
+	if(reg<DR_REG_RTCCNTL_BASE)assert(0 && "invalid register base");
+	else if(reg<DR_REG_RTCIO_BASE)ret=RD_REG_PERIPH_RTC_CNTL;
+	else if(reg<DR_REG_SENS_BASE)ret=RD_REG_PERIPH_RTC_IO;
+	else if(reg<DR_REG_RTC_I2C_BASE)ret=RD_REG_PERIPH_SENS;
+	else if(reg<DR_REG_IO_MUX_BASE)ret=RD_REG_PERIPH_RTC_I2C;
+	else assert(0 && "invalid register base");
+	return ret;
+}
+
+#define I_DELAY(cycles_) { .delay={ .cycles=cycles_, .unused=0, .opcode=OPCODE_DELAY } }
+#define I_HALT() { .halt={ .unused=0, .opcode=OPCODE_HALT } }
+
+#define I_WR_REG(reg, low_bit, high_bit, val) { .wr_reg={ \
+	.addr=((reg)&0xff)/sizeof(uint32_t), .periph_sel=SOC_REG_TO_ULP_PERIPH_SEL(reg), \
+	.data=val, .low=low_bit, .high=high_bit, .opcode=OPCODE_WR_REG } }
+#define I_RD_REG(reg, low_bit, high_bit) { .rd_reg={ \
+	.addr=((reg)&0xff)/sizeof(uint32_t), .periph_sel=SOC_REG_TO_ULP_PERIPH_SEL(reg), \
+	.unused=0, .low=low_bit, .high=high_bit, .opcode=OPCODE_RD_REG } }
+#define I_WR_REG_BIT(reg, shift, val) I_WR_REG(reg, shift, shift, val)
+
+#define I_WAKE() { .end={ .wakeup=1, .unused=0, .sub_opcode=SUB_OPCODE_END, .opcode=OPCODE_END } }
+#define I_END() I_WR_REG_BIT(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN_S, 0)
+
+#define I_ST(reg_val, reg_addr, offset_) { .st={ .dreg=reg_val, .sreg=reg_addr, .unused1=0, \
+	.offset=offset_, .unused2=0, .sub_opcode=SUB_OPCODE_ST, .opcode=OPCODE_ST } }
+#define I_LD(reg_dest, reg_addr, offset_) { .ld={ .dreg=reg_dest, .sreg=reg_addr, .unused1=0, \
+	.offset=offset_, .unused2=0, .opcode=OPCODE_LD } }
+
+#define I_B_(pc_offset, imm_value, cmp_) { .b={ .imm=imm_value, .cmp=cmp_, .offset=abs(pc_offset), \
+	.sign=(pc_offset)>=0?0:1, .sub_opcode=SUB_OPCODE_B, .opcode=OPCODE_BRANCH } }
+#define I_BL(pc_offset, imm_value) I_B_(pc_offset, imm_value, B_CMP_L)
+#define I_BGE(pc_offset, imm_value) I_B_(pc_offset, imm_value, B_CMP_GE)
+
+#define I_BX_(reg_pc, imm_pc, reg_, type_) { .bx={ .dreg=reg_pc, .addr=imm_pc, .unused=0, \
+	.reg=reg_, .type=type_, .sub_opcode=SUB_OPCODE_BX, .opcode=OPCODE_BRANCH } }
+#define I_BXR(reg_pc) I_BX_(reg_pc, 0, 1, BX_JUMP_TYPE_DIRECT)
+#define I_BXI(imm_pc) I_BX_(0, imm_pc, 0, BX_JUMP_TYPE_DIRECT)
+#define I_BXZR(reg_pc) I_BX_(reg_pc, 0, 1, BX_JUMP_TYPE_ZERO)
+#define I_BXZI(imm_pc) I_BX_(0, imm_pc, 0, BX_JUMP_TYPE_ZERO)
+#define I_BXFR(reg_pc) I_BX_(reg_pc, 0, 1, BX_JUMP_TYPE_OVF)
+#define I_BXFI(imm_pc) I_BX_(0, imm_pc, 0, BX_JUMP_TYPE_OVF)
+
+#define I_ALUR_(sel_, reg_dest, reg_src1, reg_src2) { .alu_reg={ .dreg=reg_dest, .sreg=reg_src1, \
+	.treg=reg_src2, .unused=0, .sel=sel_, .sub_opcode=SUB_OPCODE_ALU_REG, .opcode=OPCODE_ALU } }
+#define I_ADDR(reg_dest, reg_src1, reg_src2) I_ALUR_(ALU_SEL_ADD, reg_dest, reg_src1, reg_src2)
+#define I_SUBR(reg_dest, reg_src1, reg_src2) I_ALUR_(ALU_SEL_SUB, reg_dest, reg_src1, reg_src2)
+#define I_ANDR(reg_dest, reg_src1, reg_src2) I_ALUR_(ALU_SEL_AND, reg_dest, reg_src1, reg_src2)
+#define I_ORR(reg_dest, reg_src1, reg_src2) I_ALUR_(ALU_SEL_OR, reg_dest, reg_src1, reg_src2)
+#define I_MOVR(reg_dest, reg_src) I_ALUR_(ALU_SEL_MOV, reg_dest, reg_src, 0)
+#define I_LSHR(reg_dest, reg_src, reg_shift) I_ALUR_(ALU_SEL_LSH, reg_dest, reg_src, reg_shift)
+#define I_RSHR(reg_dest, reg_src, reg_shift) I_ALUR_(ALU_SEL_RSH, reg_dest, reg_src, reg_shift)
+
+#define I_ALUI_(sel_, reg_dest, reg_src, imm_) { .alu_imm={ .dreg=reg_dest, .sreg=reg_src, \
+	.imm=imm_, .unused=0, .sel=sel_, .sub_opcode=SUB_OPCODE_ALU_IMM, .opcode=OPCODE_ALU } }
+#define I_ADDI(reg_dest, reg_src, imm_) I_ALUI_(ALU_SEL_ADD, reg_dest, reg_src, imm_)
+#define I_SUBI(reg_dest, reg_src, imm_) I_ALUI_(ALU_SEL_SUB, reg_dest, reg_src, imm_)
+#define I_ANDI(reg_dest, reg_src, imm_) I_ALUI_(ALU_SEL_AND, reg_dest, reg_src, imm_)
+#define I_ORI(reg_dest, reg_src, imm_) I_ALUI_(ALU_SEL_OR, reg_dest, reg_src, imm_)
+#define I_MOVI(reg_dest, imm_) I_ALUI_(ALU_SEL_MOV, reg_dest, 0, imm_)
+#define I_LSHI(reg_dest, reg_src, imm_) I_ALUI_(ALU_SEL_LSH, reg_dest, reg_src, imm_)
+#define I_RSHI(reg_dest, reg_src, imm_) I_ALUI_(ALU_SEL_RSH, reg_dest, reg_src, imm_)
+
+// Labels and branches to them, resolved by ulp_process_macros_and_load().
+#define M_LABEL(label_num) { .macro={ .label=label_num, .unused=0, \
+	.sub_opcode=SUB_OPCODE_MACRO_LABEL, .opcode=OPCODE_MACRO } }
+#define M_BRANCH(label_num) { .macro={ .label=label_num, .unused=0, \
+	.sub_opcode=SUB_OPCODE_MACRO_BRANCH, .opcode=OPCODE_MACRO } }
+#define M_BL(label_num, imm_value) M_BRANCH(label_num), I_BL(0, imm_value)
+#define M_BGE(label_num, imm_value) M_BRANCH(label_num), I_BGE(0, imm_value)
+#define M_BX(label_num) M_BRANCH(label_num), I_BXI(0)
+#define M_BXZ(label_num) M_BRANCH(label_num), I_BXZI(0)
+#define M_BXF(label_num) M_BRANCH(label_num), I_BXFI(0)
+
+// RTC slow memory, 8 KB, plain memory here.
+#define RTC_SLOW_MEM_WORDS 2048
+extern uint32_t fake_rtc_slow_mem[RTC_SLOW_MEM_WORDS];
+#define RTC_SLOW_MEM fake_rtc_slow_mem
+
+// load_addr and *psize in words, *psize counts the macros going in and
+// only the instructions coming out.
+esp_err_t ulp_process_macros_and_load(uint32_t load_addr, const ulp_insn_t *program, size_t *psize);
+esp_err_t ulp_run(uint32_t entry_point);
+esp_err_t ulp_set_wakeup_period(size_t period_index, uint32_t period_us);
+
+#endif /* ULP_H__ */
@@ -0,0 +1,10 @@
+#ifndef ESP_ATTR_H__
+#define ESP_ATTR_H__
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define WORD_ALIGNED_ATTR __attribute__((aligned(4)))
+
+#endif /* ESP_ATTR_H__ */
@@ -0,0 +1,28 @@
+#ifndef ESP_ERR_H__
+#define ESP_ERR_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                0
+#define ESP_FAIL              -1
+#define ESP_ERR_NO_MEM        0x101
+#define ESP_ERR_INVALID_ARG   0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE  0x104
+#define ESP_ERR_NOT_FOUND     0x105
+#define ESP_ERR_TIMEOUT       0x107
+
+const char *esp_err_to_name(esp_err_t code);
+
+void fake_error_check_failed(esp_err_t rc, const char *file, int line, const char *expr);
+
+#define ESP_ERROR_CHECK(x) do{ \
+	esp_err_t rc__=(x); \
+	if(rc__!=ESP_OK)fake_error_check_failed(rc__,__FILE__,__LINE__,#x); \
+}while(0)
+
+#endif /* ESP_ERR_H__ */
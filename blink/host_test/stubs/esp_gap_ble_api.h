@@ -0,0 +1,18 @@
+#ifndef ESP_GAP_BLE_API_H__
+#define ESP_GAP_BLE_API_H__
+
+#include "esp_bt_defs.h"
+
+// Only what the HID profile calls, the fake accepts everything.
+#define ESP_BLE_APPEARANCE_GENERIC_HID 0x03C0
+
+typedef enum {
+	ESP_BLE_SEC_ENCRYPT = 1,
+	ESP_BLE_SEC_ENCRYPT_NO_MITM,
+	ESP_BLE_SEC_ENCRYPT_MITM,
+} esp_ble_sec_act_t;
+
+esp_err_t esp_ble_gap_config_local_icon(uint16_t icon);
+esp_err_t esp_ble_set_encryption(esp_bd_addr_t bd_addr, esp_ble_sec_act_t sec_act);
+
+#endif /* ESP_GAP_BLE_API_H__ */
@@ -0,0 +1,109 @@
+#ifndef ESP_GATTS_API_H__
+#define ESP_GATTS_API_H__
+
+#include "esp_gatt_defs.h"
+
+typedef enum {
+	ESP_GATTS_REG_EVT,
+	ESP_GATTS_READ_EVT,
+	ESP_GATTS_WRITE_EVT,
+	ESP_GATTS_EXEC_WRITE_EVT,
+	ESP_GATTS_MTU_EVT,
+	ESP_GATTS_CONF_EVT,
+	ESP_GATTS_UNREG_EVT,
+	ESP_GATTS_CREATE_EVT,
+	ESP_GATTS_START_EVT,
+	ESP_GATTS_CONNECT_EVT,
+	ESP_GATTS_DISCONNECT_EVT,
+	ESP_GATTS_CLOSE_EVT,
+	ESP_GATTS_CONGEST_EVT,
+	ESP_GATTS_CREAT_ATTR_TAB_EVT,
+} esp_gatts_cb_event_t;
+
+typedef struct {
+	uint16_t interval;
+	uint16_t latency;
+	uint16_t timeout;
+} esp_gatt_conn_params_t;
+
+// The events the fake stack in fake_bt.c delivers.
+typedef union {
+	struct gatts_reg_evt_param {
+		esp_gatt_status_t status;
+		uint16_t app_id;
+	} reg;
+	struct gatts_read_evt_param {
+		uint16_t conn_id;
+		uint32_t trans_id;
+		esp_bd_addr_t bda;
+		uint16_t handle;
+		uint16_t offset;
+		bool is_long;
+		bool need_rsp;
+	} read;
+	struct gatts_write_evt_param {
+		uint16_t conn_id;
+		uint32_t trans_id;
+		esp_bd_addr_t bda;
+		uint16_t handle;
+		uint16_t offset;
+		bool need_rsp;
+		bool is_prep;
+		uint16_t len;
+		uint8_t *value;
+	} write;
+	struct gatts_mtu_evt_param {
+		uint16_t conn_id;
+		uint16_t mtu;
+	} mtu;
+	struct gatts_conf_evt_param {
+		esp_gatt_status_t status;
+		uint16_t conn_id;
+		uint16_t handle;
+		uint16_t len;
+		uint8_t *value;
+	} conf;
+	struct gatts_connect_evt_param {
+		uint16_t conn_id;
+		uint8_t link_role;
+		esp_bd_addr_t remote_bda;
+		esp_gatt_conn_params_t conn_params;
+	} connect;
+	struct gatts_disconnect_evt_param {
+		uint16_t conn_id;
+		esp_bd_addr_t remote_bda;
+		int reason;
+	} disconnect;
+	struct gatts_congest_evt_param {
+		uint16_t conn_id;
+		bool congested;
+	} congest;
+	struct gatts_add_attr_tab_evt_param {
+		esp_gatt_status_t status;
+		esp_bt_uuid_t svc_uuid;
+		uint8_t svc_inst_id;
+		uint16_t num_handle;
+		uint16_t *handles;
+	} add_attr_tab;
+} esp_ble_gatts_cb_param_t;
+
+typedef void (*esp_gatts_cb_t)(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+
+esp_err_t esp_ble_gatts_register_callback(esp_gatts_cb_t callback);
+esp_err_t esp_ble_gatts_app_register(uint16_t app_id);
+esp_err_t esp_ble_gatts_app_unregister(esp_gatt_if_t gatts_if);
+esp_err_t esp_ble_gatts_create_attr_tab(const esp_gatts_attr_db_t *gatts_attr_db, esp_gatt_if_t gatts_if,
+	uint8_t max_nb_attr, uint8_t srvc_inst_id);
+esp_err_t esp_ble_gatts_start_service(uint16_t service_handle);
+esp_err_t esp_ble_gatts_stop_service(uint16_t service_handle);
+esp_err_t esp_ble_gatts_delete_service(uint16_t service_handle);
+esp_err_t esp_ble_gatts_set_attr_value(uint16_t attr_handle, uint16_t length, const uint8_t *value);
+esp_err_t esp_ble_gatts_get_attr_value(uint16_t attr_handle, uint16_t *length, const uint8_t **value);
+// Recorded with a timestamp, see fake_bt.h.
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t attr_handle,
+	uint16_t value_len, uint8_t *value, bool need_confirm);
+// Answers a read or write of an ESP_GATT_RSP_BY_APP attribute, see fake_bt_read().
+esp_err_t esp_ble_gatts_send_response(esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id,
+	esp_gatt_status_t status, esp_gatt_rsp_t *rsp);
+
+#endif /* ESP_GATTS_API_H__ */
@@ -0,0 +1,48 @@
+#ifndef ESP_LOG_H__
+#define ESP_LOG_H__
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef enum {
+	ESP_LOG_NONE,
+	ESP_LOG_ERROR,
+	ESP_LOG_WARN,
+	ESP_LOG_INFO,
+	ESP_LOG_DEBUG,
+	ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL CONFIG_LOG_DEFAULT_LEVEL
+#endif
+
+#define LOG_COLOR_E
+#define LOG_COLOR_W
+#define LOG_COLOR_I
+#define LOG_COLOR_D
+#define LOG_COLOR_V
+#define LOG_RESET_COLOR
+#define LOG_FORMAT(letter, format) LOG_COLOR_ ## letter #letter " (%u) %s: " format LOG_RESET_COLOR "\n"
+
+// Milliseconds of the fake esp_timer clock.
+uint32_t esp_log_timestamp(void);
+
+// Lines go to stderr, so benchmark figures on stdout stay clean.
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+	__attribute__((format(printf,3,4)));
+
+#define ESP_LOG_LEVEL_LOCAL(level, letter, tag, format, ...) do{ \
+	if(LOG_LOCAL_LEVEL>=level) \
+		esp_log_write(level,tag,LOG_FORMAT(letter,format),esp_log_timestamp(),tag,##__VA_ARGS__); \
+}while(0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR,E,tag,format,##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN,W,tag,format,##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO,I,tag,format,##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG,D,tag,format,##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE,V,tag,format,##__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX(tag, buf, len) do{(void)(tag);(void)(buf);(void)(len);}while(0)
+
+#endif /* ESP_LOG_H__ */
@@ -0,0 +1,28 @@
+#ifndef ESP_SLEEP_H__
+#define ESP_SLEEP_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+	ESP_SLEEP_WAKEUP_UNDEFINED,
+	ESP_SLEEP_WAKEUP_ALL,
+	ESP_SLEEP_WAKEUP_EXT0,
+	ESP_SLEEP_WAKEUP_EXT1,
+	ESP_SLEEP_WAKEUP_TIMER,
+	ESP_SLEEP_WAKEUP_TOUCHPAD,
+	ESP_SLEEP_WAKEUP_ULP,
+	ESP_SLEEP_WAKEUP_GPIO,
+} esp_sleep_wakeup_cause_t;
+
+typedef enum {
+	ESP_EXT1_WAKEUP_ALL_LOW,
+	ESP_EXT1_WAKEUP_ANY_HIGH,
+} esp_sleep_ext1_wakeup_mode_t;
+
+// The cause is whatever the test set with fake_sleep_wakeup().
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void);
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode);
+esp_err_t esp_sleep_enable_ulp_wakeup(void);
+
+#endif /* ESP_SLEEP_H__ */
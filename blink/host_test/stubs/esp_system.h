@@ -0,0 +1,26 @@
+#ifndef ESP_SYSTEM_H__
+#define ESP_SYSTEM_H__
+
+#include <stdint.h>
+
+typedef enum {
+	ESP_RST_UNKNOWN,
+	ESP_RST_POWERON,
+	ESP_RST_EXT,
+	ESP_RST_SW,
+	ESP_RST_PANIC,
+	ESP_RST_INT_WDT,
+	ESP_RST_TASK_WDT,
+	ESP_RST_WDT,
+	ESP_RST_DEEPSLEEP,
+	ESP_RST_BROWNOUT,
+	ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+// Always a power on reset.
+esp_reset_reason_t esp_reset_reason(void);
+
+// What malloc has left, the fake never runs out.
+uint32_t esp_get_free_heap_size(void);
+
+#endif /* ESP_SYSTEM_H__ */
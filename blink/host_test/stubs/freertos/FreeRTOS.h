@@ -0,0 +1,47 @@
+#ifndef FREERTOS_H__
+#define FREERTOS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+
+#define portMAX_DELAY       ((TickType_t)0xffffffffu)
+#define portTICK_PERIOD_MS  (1000/CONFIG_FREERTOS_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)((ms)*CONFIG_FREERTOS_HZ/1000))
+#define portNUM_PROCESSORS  2
+#define tskNO_AFFINITY      0x7fffffff
+#define configMAX_PRIORITIES 25
+
+// Critical sections are one process wide lock, the host has no ISRs that
+// could preempt it.
+typedef struct {
+	int depth;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)      vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)  vPortExitCritical(mux)
+
+// Counts the yields requested from fake ISRs.
+void portYIELD_FROM_ISR(void);
+
+BaseType_t xPortGetCoreID(void);
+
+#endif /* FREERTOS_H__ */
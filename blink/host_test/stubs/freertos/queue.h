@@ -0,0 +1,19 @@
+#ifndef QUEUE_H__
+#define QUEUE_H__
+
+#include "FreeRTOS.h"
+
+typedef struct fake_queue *QueueHandle_t;
+
+// Copying FIFO of fixed size items. Nothing blocks on the host, a receive
+// from an empty queue returns pdFALSE whatever the timeout.
+QueueHandle_t xQueueCreate(UBaseType_t depth, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait);
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t wait);
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken);
+BaseType_t xQueueSendToBackFromISR(QueueHandle_t q, const void *item, BaseType_t *woken);
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+void vQueueDelete(QueueHandle_t q);
+
+#endif /* QUEUE_H__ */
@@ -0,0 +1,15 @@
+#ifndef SEMPHR_H__
+#define SEMPHR_H__
+
+#include "FreeRTOS.h"
+
+typedef struct fake_semaphore *SemaphoreHandle_t;
+
+// Mutexes are pthread mutexes, a take always waits for the holder
+// whatever the timeout.
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+#endif /* SEMPHR_H__ */
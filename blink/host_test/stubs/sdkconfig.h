@@ -0,0 +1,10 @@
+#ifndef SDKCONFIG_H__
+#define SDKCONFIG_H__
+
+// The options of blink/sdkconfig the host built sources look at.
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_BTDM_CTRL_BLE_MAX_CONN 3
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 160
+
+#endif /* SDKCONFIG_H__ */
@@ -0,0 +1,23 @@
+#ifndef GPIO_STRUCT_H__
+#define GPIO_STRUCT_H__
+
+#include <stdint.h>
+
+// The GPIO registers the matrix scan touches, as plain memory. in/in1 are
+// filled from the fake_gpio_matrix() model on every ets_delay_us().
+typedef struct {
+	uint32_t out_w1ts;
+	uint32_t out_w1tc;
+	uint32_t in;
+	union {
+		struct {
+			uint32_t data:8;
+			uint32_t reserved8:24;
+		};
+		uint32_t val;
+	} in1;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+#endif /* GPIO_STRUCT_H__ */
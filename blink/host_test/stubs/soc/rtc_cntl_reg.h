@@ -0,0 +1,10 @@
+#ifndef RTC_CNTL_REG_H__
+#define RTC_CNTL_REG_H__
+
+#include "soc/soc.h"
+
+// Only the ULP timer enable, I_END() clears it.
+#define RTC_CNTL_STATE0_REG (DR_REG_RTCCNTL_BASE+0x18)
+#define RTC_CNTL_ULP_CP_SLP_TIMER_EN_S 24
+
+#endif /* RTC_CNTL_REG_H__ */
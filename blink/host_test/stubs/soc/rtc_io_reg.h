@@ -0,0 +1,17 @@
+#ifndef RTC_IO_REG_H__
+#define RTC_IO_REG_H__
+
+#include "soc/soc.h"
+
+// RTC GPIO output and input, RTC pin n at bit 14+n. The fake ULP in
+// fake_ulp.c models these, the CPU side goes through driver/rtc_io.h.
+#define RTC_GPIO_OUT_REG (DR_REG_RTCIO_BASE+0x0)
+#define RTC_GPIO_OUT_DATA_S 14
+#define RTC_GPIO_OUT_W1TS_REG (DR_REG_RTCIO_BASE+0x4)
+#define RTC_GPIO_OUT_DATA_W1TS_S 14
+#define RTC_GPIO_OUT_W1TC_REG (DR_REG_RTCIO_BASE+0x8)
+#define RTC_GPIO_OUT_DATA_W1TC_S 14
+#define RTC_GPIO_IN_REG (DR_REG_RTCIO_BASE+0x24)
+#define RTC_GPIO_IN_NEXT_S 14
+
+#endif /* RTC_IO_REG_H__ */
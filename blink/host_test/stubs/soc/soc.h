@@ -0,0 +1,11 @@
+#ifndef SOC_H__
+#define SOC_H__
+
+// Bases of the RTC peripherals the ULP reaches, as on the ESP32.
+#define DR_REG_RTCCNTL_BASE 0x3ff48000
+#define DR_REG_RTCIO_BASE   0x3ff48400
+#define DR_REG_SENS_BASE    0x3ff48800
+#define DR_REG_RTC_I2C_BASE 0x3ff48C00
+#define DR_REG_IO_MUX_BASE  0x3ff49000
+
+#endif /* SOC_H__ */
@@ -0,0 +1,85 @@
+// APA102 frames byte for byte: 32 zero start bits, one 0xE0|brightness,
+// blue, green, red frame per LED, then enough zero end bits to clock the
+// data through the whole strip.
+#include <string.h>
+#include "check.h"
+#include "apa102_frame.h"
+
+#define CANARY 0xA5
+
+static void check_bytes(const uint8_t *got, const uint8_t *want, size_t len, const char *what){
+	if(!memcmp(got,want,len))return;
+	fprintf(stderr,"%s:\n",what);
+	for(size_t i=0;i<len;i++)
+		fprintf(stderr,"  [%2zu] %02x%s\n",i,got[i],got[i]!=want[i]?" <- wrong":"");
+	check_failures++;
+}
+
+int main(void){
+	uint8_t frame[APA102_FRAME_LEN(300)+8];
+
+	// Three LEDs, written out in full.
+	memset(frame,CANARY,sizeof(frame));
+	apa102_frame_init(frame,3);
+	static const uint8_t off3[]={
+		0x00,0x00,0x00,0x00,
+		0xE0,0x00,0x00,0x00,
+		0xE0,0x00,0x00,0x00,
+		0xE0,0x00,0x00,0x00,
+		0x00,0x00,0x00,0x00,
+		CANARY,
+	};
+	CHECK_EQ(APA102_FRAME_LEN(3),sizeof(off3)-1);
+	check_bytes(frame,off3,sizeof(off3),"3 LEDs off");
+
+	apa102_frame_set(frame,0,0x11,0x22,0x33,31);
+	apa102_frame_set(frame,2,0xFF,0x80,0x01,7);
+	// Brightness is 5 bits, higher bits must not reach the 0b111 marker.
+	apa102_frame_set(frame,1,0x01,0x02,0x03,0xFF);
+	static const uint8_t lit3[]={
+		0x00,0x00,0x00,0x00,
+		0xFF,0x33,0x22,0x11,
+		0xFF,0x03,0x02,0x01,
+		0xE7,0x01,0x80,0xFF,
+		0x00,0x00,0x00,0x00,
+		CANARY,
+	};
+	check_bytes(frame,lit3,sizeof(lit3),"3 LEDs lit");
+
+	// No LEDs is still a start and a 32 bit end frame.
+	memset(frame,CANARY,sizeof(frame));
+	apa102_frame_init(frame,0);
+	static const uint8_t none[]={0,0,0,0, 0,0,0,0, CANARY};
+	check_bytes(frame,none,sizeof(none),"0 LEDs");
+
+	// End frame: at least one clock per two LEDs and at least 32 bits,
+	// in whole bytes, and not a byte more.
+	for(size_t n=0;n<=300;n++){
+		size_t end=APA102_END_LEN(n);
+		size_t want=(n+1)/2>32?((n+1)/2+7)/8:4;
+		if(end!=want)fprintf(stderr,"%zu LEDs: end frame %zu bytes, want %zu\n",n,end,want);
+		CHECK_EQ(end,want);
+		CHECK_EQ(APA102_FRAME_LEN(n),4+4*n+want);
+
+		memset(frame,CANARY,sizeof(frame));
+		apa102_frame_init(frame,n);
+		int bad=0;
+		for(size_t i=0;i<4;i++)bad+=frame[i]!=0;
+		for(size_t i=0;i<n;i++){
+			const uint8_t *p=frame+4+4*i;
+			bad+=p[0]!=0xE0||p[1]||p[2]||p[3];
+		}
+		for(size_t i=4+4*n;i<4+4*n+want;i++)bad+=frame[i]!=0;
+		bad+=frame[APA102_FRAME_LEN(n)]!=CANARY;
+		if(bad)fprintf(stderr,"%zu LEDs: %d wrong bytes after init\n",n,bad);
+		CHECK_EQ(bad,0);
+	}
+
+	// Setting one LED leaves its neighbours and the end frame alone.
+	apa102_frame_init(frame,300);
+	apa102_frame_set(frame,299,1,2,3,4);
+	static const uint8_t last[]={0xE0,0,0,0, 0xE4,3,2,1, 0,0,0,0};
+	check_bytes(frame+4+4*298,last,sizeof(last),"last of 300 LEDs");
+
+	CHECK_DONE();
+}
@@ -0,0 +1,193 @@
+// A report the stack refuses stays at the head of its queue and goes out,
+// in order, on the next confirm, congestion clear or report queued.
+// Mouse reports keep only their newest state across a refusal. A FIFO
+// filled by refusals on a clear link is retried by the next send it turns
+// away, and the sender hears once it has room. Each host reads back the
+// protocol mode of its own link.
+#include <string.h>
+#include "check.h"
+#include "hidd_host.h"
+#include "hid_usage.h"
+
+#define CONN_ID 0
+
+static uint16_t key_handle, mouse_handle;
+
+static esp_err_t send_key(uint8_t key){
+	return esp_hidd_send_keyboard_value(CONN_ID,0,&key,1);
+}
+
+// The n-th notification since the last clear is a keyboard report of key.
+static bool sent_key(size_t n, uint8_t key){
+	const fake_bt_ntf_t *ntf=fake_bt_ntf(n);
+	return ntf&&ntf->handle==key_handle&&ntf->len==HID_KEYBOARD_IN_RPT_LEN&&ntf->value[2]==key;
+}
+
+static uint32_t refused(void){
+	hid_dev_tx_stats_t stats;
+	hid_dev_tx_get_stats(&stats);
+	return stats.refused;
+}
+
+static int space_calls;
+
+static void on_space(uint16_t conn_id){
+	CHECK_EQ(conn_id,CONN_ID);
+	space_calls++;
+}
+
+static void hidd_event(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param){
+	(void)event;
+	(void)param;
+}
+
+static void retried_on_confirm(void){
+	fake_bt_ntf_clear();
+	CHECK_EQ(send_key(HID_KEY_A),ESP_OK);
+	fake_bt_refuse(1);
+	CHECK_EQ(send_key(HID_KEY_B),ESP_OK);
+	CHECK_EQ(fake_bt_ntf_count(),1);
+	CHECK(hid_dev_tx_pending(CONN_ID,HID_RPT_ID_KEY_IN,HID_TYPE_INPUT));
+
+	// The host confirms A, B goes out.
+	CHECK(fake_bt_confirm(CONN_ID));
+	CHECK_EQ(fake_bt_ntf_count(),2);
+	CHECK(sent_key(1,HID_KEY_B));
+	CHECK(!hid_dev_tx_pending(CONN_ID,HID_RPT_ID_KEY_IN,HID_TYPE_INPUT));
+	while(fake_bt_confirm(CONN_ID));
+}
+
+static void retried_on_congest_clear(void){
+	fake_bt_ntf_clear();
+	fake_bt_refuse(1);
+	CHECK_EQ(send_key(HID_KEY_C),ESP_OK);
+	CHECK_EQ(fake_bt_ntf_count(),0);
+
+	// Nothing moves while the link is congested.
+	fake_bt_congest(CONN_ID,true);
+	CHECK_EQ(fake_bt_ntf_count(),0);
+	fake_bt_congest(CONN_ID,false);
+	CHECK_EQ(fake_bt_ntf_count(),1);
+	CHECK(sent_key(0,HID_KEY_C));
+	while(fake_bt_confirm(CONN_ID));
+}
+
+static void order_kept(void){
+	fake_bt_ntf_clear();
+	// Refused twice: on its own send and on the retry the next one makes.
+	fake_bt_refuse(2);
+	CHECK_EQ(send_key(HID_KEY_D),ESP_OK);
+	CHECK_EQ(send_key(HID_KEY_E),ESP_OK);
+	CHECK_EQ(fake_bt_ntf_count(),0);
+	CHECK_EQ(send_key(HID_KEY_F),ESP_OK);
+	CHECK_EQ(fake_bt_ntf_count(),3);
+	CHECK(sent_key(0,HID_KEY_D));
+	CHECK(sent_key(1,HID_KEY_E));
+	CHECK(sent_key(2,HID_KEY_F));
+	while(fake_bt_confirm(CONN_ID));
+}
+
+static void mouse_newest_state(void){
+	fake_bt_ntf_clear();
+	CHECK_EQ(send_key(HID_KEY_G),ESP_OK);
+	fake_bt_refuse(1);
+	CHECK_EQ(esp_hidd_send_mouse_value(CONN_ID,0,1,1,0,0),ESP_OK);
+	CHECK(esp_hidd_mouse_pending(CONN_ID));
+	// Refused again on the retry this send makes, and replaced by it.
+	fake_bt_refuse(1);
+	CHECK_EQ(esp_hidd_send_mouse_value(CONN_ID,1,5,-5,0,0),ESP_OK);
+	CHECK_EQ(fake_bt_ntf_count(),1);
+
+	CHECK(fake_bt_confirm(CONN_ID));
+	CHECK_EQ(fake_bt_ntf_count(),2);
+	const fake_bt_ntf_t *ntf=fake_bt_ntf(1);
+	const uint8_t newest[HID_MOUSE_IN_RPT_LEN]={1,5,0xfb,0,0};
+	CHECK(ntf&&ntf->handle==mouse_handle&&!memcmp(ntf->value,newest,sizeof(newest)));
+	CHECK(!esp_hidd_mouse_pending(CONN_ID));
+	while(fake_bt_confirm(CONN_ID));
+}
+
+// Unsubscribed while it waited, it is dropped instead of sent.
+static void dropped_once_unsubscribed(void){
+	hid_dev_tx_stats_t before, after;
+
+	fake_bt_ntf_clear();
+	hid_dev_tx_get_stats(&before);
+	fake_bt_refuse(1);
+	CHECK_EQ(send_key(HID_KEY_H),ESP_OK);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_KEY_IN_CCC,false);
+	fake_bt_congest(CONN_ID,false);
+	hid_dev_tx_get_stats(&after);
+	CHECK_EQ(fake_bt_ntf_count(),0);
+	CHECK_EQ(after.dropped-before.dropped,1);
+	CHECK(!hid_dev_tx_pending(CONN_ID,HID_RPT_ID_KEY_IN,HID_TYPE_INPUT));
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_KEY_IN_CCC,true);
+}
+
+// No congestion and nothing in flight, so no event ever comes. The sender
+// only has its own retries, the way blink.c waits on NO_MEM.
+static void full_from_refusals(void){
+	fake_bt_ntf_clear();
+	space_calls=0;
+	fake_bt_refuse(1000);
+	for(int i=0;i<HID_DEV_TX_QUEUE_LEN;i++)CHECK_EQ(send_key(HID_KEY_A+i),ESP_OK);
+	CHECK_EQ(send_key(HID_KEY_Z),ESP_ERR_NO_MEM);
+	CHECK_EQ(fake_bt_unconfirmed(CONN_ID),0);
+	CHECK_EQ(space_calls,0);
+
+	// The stack has buffers again, the turned away send retries the head.
+	fake_bt_refuse(0);
+	int tries=0;
+	while(send_key(HID_KEY_Z)==ESP_ERR_NO_MEM&&tries<10)tries++;
+	CHECK_EQ(tries,1);
+	CHECK_EQ(space_calls,1);
+	CHECK_EQ(fake_bt_ntf_count(),HID_DEV_TX_QUEUE_LEN+1);
+	for(int i=0;i<HID_DEV_TX_QUEUE_LEN;i++)CHECK(sent_key(i,HID_KEY_A+i));
+	CHECK(sent_key(HID_DEV_TX_QUEUE_LEN,HID_KEY_Z));
+	while(fake_bt_confirm(CONN_ID));
+}
+
+static uint8_t read_mode(uint16_t conn_id){
+	uint8_t value[FAKE_BT_VALUE_MAX]={0xff};
+	uint16_t len=0;
+	CHECK_EQ(fake_bt_read(conn_id,hidd_host_handle(HIDD_LE_IDX_PROTO_MODE_VAL),value,&len),ESP_GATT_OK);
+	CHECK_EQ(len,HID_PROTOCOL_MODE_LEN);
+	return value[0];
+}
+
+static void protocol_mode_per_link(void){
+	const esp_bd_addr_t other={0x66,0x55,0x44,0x33,0x22,0x11};
+	const uint8_t boot=HID_PROTOCOL_MODE_BOOT;
+
+	CHECK_EQ(read_mode(CONN_ID),HID_PROTOCOL_MODE_REPORT);
+	fake_bt_write(CONN_ID,hidd_host_handle(HIDD_LE_IDX_PROTO_MODE_VAL),&boot,1);
+	CHECK_EQ(read_mode(CONN_ID),HID_PROTOCOL_MODE_BOOT);
+
+	// A second host starts in report mode and leaves the first one's alone.
+	fake_bt_connect(CONN_ID+1,other);
+	CHECK_EQ(read_mode(CONN_ID+1),HID_PROTOCOL_MODE_REPORT);
+	CHECK_EQ(read_mode(CONN_ID),HID_PROTOCOL_MODE_BOOT);
+	fake_bt_disconnect(CONN_ID+1);
+}
+
+int main(void){
+	const esp_bd_addr_t host={0x11,0x22,0x33,0x44,0x55,0x66};
+
+	hidd_host_up(hidd_event);
+	hid_dev_tx_on_space(on_space);
+	fake_bt_connect(CONN_ID,host);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_KEY_IN_CCC,true);
+	hidd_host_subscribe(CONN_ID,HIDD_LE_IDX_REPORT_MOUSE_IN_CCC,true);
+	key_handle=hidd_host_handle(HIDD_LE_IDX_REPORT_KEY_IN_VAL);
+	mouse_handle=hidd_host_handle(HIDD_LE_IDX_REPORT_MOUSE_IN_VAL);
+
+	retried_on_confirm();
+	retried_on_congest_clear();
+	order_kept();
+	mouse_newest_state();
+	dropped_once_unsubscribed();
+	full_from_refusals();
+	CHECK_EQ(refused(),fake_bt_refused());
+	protocol_mode_per_link();
+	CHECK_DONE();
+}
@@ -0,0 +1,86 @@
+// Host LED writes to the LED output and boot keyboard output reports,
+// through the profile and kbd_leds to the indicator pin. Each write is
+// applied before its GATT write event returns, and the pin, the stats and
+// the strip's lock LEDs end on the last state the host wrote.
+#include "check.h"
+#include "fake_idf.h"
+#include "esp_timer.h"
+#include "hidd_host.h"
+#include "kbd_leds.h"
+#include "lighting.h"
+
+#define CONN_ID 0
+#define LED_GPIO 2
+#define WRITES 1000
+#define MAX_WRITE_NS 1000000 // far above a direct call, catches a deferral that blocks
+
+static uint8_t strip_locks;
+static int strip_updates;
+
+// The strip is not built here, only what kbd_leds hands it is kept.
+void lighting_locks(uint8_t locks){
+	strip_locks=locks;
+	strip_updates++;
+}
+
+// What ble_hidd.c does with the event for the active host.
+static void hidd_event(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param){
+	if(event==ESP_HIDD_EVENT_BLE_LED_REPORT_WRITE)kbd_leds_host(param->led_write.leds,esp_timer_get_time());
+}
+
+static int64_t write_leds(int handle_idx, uint8_t leds){
+	int64_t start=fake_host_ns();
+	fake_bt_write(CONN_ID,hidd_host_handle(handle_idx),&leds,1);
+	return fake_host_ns()-start;
+}
+
+int main(void){
+	const esp_bd_addr_t host={0x11,0x22,0x33,0x44,0x55,0x66};
+	kbd_leds_stats_t stats;
+	int64_t max_ns=0;
+	uint8_t leds=0;
+
+	CHECK_EQ(kbd_leds_init(LED_GPIO),ESP_OK);
+	hidd_host_up(hidd_event);
+	fake_bt_connect(CONN_ID,host);
+	fake_time_set(1000000);
+
+	// Every write shows on the pin as soon as the event is handled, the
+	// clock never moves in between.
+	uint32_t seed=1;
+	for(int i=0;i<WRITES;i++){
+		seed=seed*1103515245+12345;
+		leds=seed>>16&0x1f;
+		int idx=i&1?HIDD_LE_IDX_BOOT_KB_OUT_REPORT_VAL:HIDD_LE_IDX_REPORT_LED_OUT_VAL;
+		int64_t ns=write_leds(idx,leds);
+		if(ns>max_ns)max_ns=ns;
+		CHECK_EQ(fake_gpio_out(LED_GPIO),!!(leds&KBD_LED_CAPS_LOCK));
+		CHECK_EQ(strip_locks,leds);
+		fake_time_advance(10000);
+	}
+	CHECK(max_ns<MAX_WRITE_NS);
+	kbd_leds_get_stats(&stats);
+	CHECK_EQ(stats.writes,WRITES);
+	CHECK_EQ(stats.max_us,0);
+	CHECK_EQ(stats.leds,leds);
+	CHECK_EQ(strip_updates,WRITES);
+
+	// An empty write changes nothing.
+	fake_bt_write(CONN_ID,hidd_host_handle(HIDD_LE_IDX_REPORT_LED_OUT_VAL),&leds,0);
+	kbd_leds_get_stats(&stats);
+	CHECK_EQ(stats.writes,WRITES);
+
+	// The local owner lights it whatever the host says, and hands it back.
+	write_leds(HIDD_LE_IDX_REPORT_LED_OUT_VAL,KBD_LED_NUM_LOCK);
+	kbd_leds_local(true);
+	CHECK_EQ(fake_gpio_out(LED_GPIO),1);
+	write_leds(HIDD_LE_IDX_REPORT_LED_OUT_VAL,KBD_LED_CAPS_LOCK);
+	kbd_leds_local(false);
+	CHECK_EQ(fake_gpio_out(LED_GPIO),1);
+	write_leds(HIDD_LE_IDX_REPORT_LED_OUT_VAL,0);
+	CHECK_EQ(fake_gpio_out(LED_GPIO),0);
+	kbd_leds_get_stats(&stats);
+	CHECK_EQ(stats.leds,0);
+	CHECK_EQ(strip_locks,0);
+	CHECK_DONE();
+}
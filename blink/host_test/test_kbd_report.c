@@ -0,0 +1,130 @@
+// The report builder sends only real changes, and the exact state of each:
+// a press and release in one drain still reach the host as two reports,
+// modifiers go into the mask without taking a slot, a key past the sixth
+// waits in the NKRO bitmap and moves into the slot the next release frees.
+#include <string.h>
+#include "check.h"
+#include "kbd_report.h"
+#include "hid_usage.h"
+
+#define MAX_SENT 8
+
+static kbd_state_t sent[MAX_SENT];
+static int num_sent;
+
+static void record(const kbd_state_t *s){
+	if(num_sent<MAX_SENT)sent[num_sent]=*s;
+	num_sent++;
+}
+
+static void set_bit(kbd_state_t *s, uint8_t key){
+	s->bits[key/8]|=1<<(key%8);
+}
+
+// A report with mods down, the zero terminated keys in their slots and
+// the keys waiting for one, built up independently of kbd_report.c.
+static kbd_state_t state(uint8_t mods, const uint8_t *keys, const uint8_t *waiting){
+	kbd_state_t s={.mods=mods};
+	for(;*keys;keys++){
+		s.keys[s.num_keys++]=*keys;
+		set_bit(&s,*keys);
+	}
+	for(;waiting&&*waiting;waiting++)set_bit(&s,*waiting);
+	for(int m=0;m<8;m++)
+		if(mods&1<<m)set_bit(&s,HID_KEY_LEFT_CTRL+m);
+	return s;
+}
+
+#define KEYS(...) ((const uint8_t[]){__VA_ARGS__,0})
+#define NONE KEYS(0)
+
+static bool sent_is(int i, kbd_state_t want){
+	if(i>=num_sent||i>=MAX_SENT)return false;
+	if(!memcmp(&sent[i],&want,sizeof(want)))return true;
+	fprintf(stderr,"report %d: mods 0x%02x, %d keys 0x%02x 0x%02x ...\n",i,sent[i].mods,
+		sent[i].num_keys,sent[i].keys[0],sent[i].keys[1]);
+	return false;
+}
+
+static void start(kbd_report_t *r){
+	kbd_report_init(r,record);
+	num_sent=0;
+}
+
+int main(void){
+	kbd_report_t r;
+
+	// A tap inside one drain window is not folded away.
+	start(&r);
+	CHECK(kbd_report_apply(&r,HID_KEY_A,true));
+	CHECK(kbd_report_apply(&r,HID_KEY_A,false));
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,2);
+	CHECK(sent_is(0,state(0,KEYS(HID_KEY_A),NULL)));
+	CHECK(sent_is(1,state(0,NONE,NULL)));
+
+	// Presses that build on each other go out together, and nothing goes
+	// out for an unchanged state or a release of a key that is not down.
+	start(&r);
+	kbd_report_apply(&r,HID_KEY_B,true);
+	kbd_report_apply(&r,HID_KEY_C,true);
+	kbd_report_apply(&r,HID_KEY_D,false);
+	kbd_report_flush(&r);
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,1);
+	CHECK(sent_is(0,state(0,KEYS(HID_KEY_B,HID_KEY_C),NULL)));
+	// A resync sends it again anyway, for a host that was switched to.
+	kbd_report_resync(&r);
+	CHECK_EQ(num_sent,2);
+	CHECK(sent_is(1,state(0,KEYS(HID_KEY_B,HID_KEY_C),NULL)));
+
+	// Modifiers fold into the mask and leave the six slots to other keys.
+	uint8_t shift_gui=KBD_MODIFIER_BIT(HID_KEY_LEFT_SHIFT)|KBD_MODIFIER_BIT(HID_KEY_RIGHT_GUI);
+	start(&r);
+	CHECK(kbd_report_apply(&r,HID_KEY_LEFT_SHIFT,true));
+	CHECK(kbd_report_apply(&r,HID_KEY_RIGHT_GUI,true));
+	kbd_report_apply(&r,HID_KEY_E,true);
+	kbd_report_flush(&r);
+	kbd_report_apply(&r,HID_KEY_LEFT_SHIFT,false);
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,2);
+	CHECK(sent_is(0,state(shift_gui,KEYS(HID_KEY_E),NULL)));
+	CHECK(sent_is(1,state(KBD_MODIFIER_BIT(HID_KEY_RIGHT_GUI),KEYS(HID_KEY_E),NULL)));
+	// The modifiers are the last byte of the bitmap, right GUI its top bit.
+	CHECK_EQ(sent[0].bits[KBD_NKRO_BYTES-1],0x82);
+
+	// The seventh key waits in the bitmap, a second press of one already
+	// down changes nothing, and the first release hands G the freed slot
+	// at the end, after the keys held longer.
+	start(&r);
+	for(uint8_t key=HID_KEY_A;key<=HID_KEY_F;key++)CHECK(kbd_report_apply(&r,key,true));
+	CHECK(!kbd_report_apply(&r,HID_KEY_G,true));
+	CHECK(kbd_report_apply(&r,HID_KEY_A,true));
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,1);
+	CHECK(sent_is(0,state(0,KEYS(HID_KEY_A,HID_KEY_B,HID_KEY_C,HID_KEY_D,HID_KEY_E,HID_KEY_F),
+		KEYS(HID_KEY_G))));
+	CHECK_EQ(sent[0].bits[0],0xf0); // A..D, usages 4-7
+	CHECK_EQ(sent[0].bits[1],0x07); // E, F and G, usages 8-10
+	kbd_report_apply(&r,HID_KEY_C,false);
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,2);
+	CHECK(sent_is(1,state(0,KEYS(HID_KEY_A,HID_KEY_B,HID_KEY_D,HID_KEY_E,HID_KEY_F,HID_KEY_G),NULL)));
+
+	// A key let go while it still waits only leaves the bitmap, the slot
+	// keys are untouched.
+	start(&r);
+	for(uint8_t key=HID_KEY_A;key<=HID_KEY_F;key++)kbd_report_apply(&r,key,true);
+	kbd_report_apply(&r,HID_KEY_H,true);
+	kbd_report_flush(&r);
+	kbd_report_apply(&r,HID_KEY_H,false);
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,2);
+	CHECK(sent_is(1,state(0,KEYS(HID_KEY_A,HID_KEY_B,HID_KEY_C,HID_KEY_D,HID_KEY_E,HID_KEY_F),NULL)));
+	kbd_report_apply(&r,HID_KEY_A,false);
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,3);
+	CHECK(sent_is(2,state(0,KEYS(HID_KEY_B,HID_KEY_C,HID_KEY_D,HID_KEY_E,HID_KEY_F),NULL)));
+
+	CHECK_DONE();
+}
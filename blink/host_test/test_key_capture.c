@@ -0,0 +1,63 @@
+// Edge capture: every edge reaches the queue with the pin level and the
+// time of the interrupt, in order, and a full queue drops instead of
+// blocking the ISR.
+#include "check.h"
+#include "fake_idf.h"
+#include "key_capture.h"
+
+#define PIN_A 0
+#define PIN_B 4
+#define PIN_OFF 5 // not captured
+
+static void edge_at(int64_t us, int gpio, bool level){
+	fake_time_set(us);
+	fake_gpio_edge(gpio,level);
+}
+
+int main(void){
+	QueueHandle_t q=key_capture_init(4);
+	CHECK(q!=NULL);
+	CHECK_EQ(key_capture_add(PIN_A),ESP_OK);
+	CHECK_EQ(key_capture_add(PIN_B),ESP_OK);
+	CHECK_EQ(key_capture_add(GPIO_NUM_MAX),ESP_ERR_INVALID_ARG);
+
+	// Bouncy press on A interleaved with a press on B, plus a pin that
+	// was never added.
+	edge_at(1000,PIN_A,true);
+	edge_at(1013,PIN_A,false);
+	edge_at(1021,PIN_OFF,true);
+	edge_at(1040,PIN_A,true);
+	edge_at(1500,PIN_B,true);
+	CHECK_EQ(uxQueueMessagesWaiting(q),4);
+	CHECK_EQ(fake_isr_yields(),4);
+
+	static const key_edge_t want[]={
+		{.time_us=1000,.gpio=PIN_A,.level=true},
+		{.time_us=1013,.gpio=PIN_A,.level=false},
+		{.time_us=1040,.gpio=PIN_A,.level=true},
+		{.time_us=1500,.gpio=PIN_B,.level=true},
+	};
+	key_edge_t edge;
+	for(int i=0;i<4;i++){
+		CHECK(xQueueReceive(q,&edge,0));
+		CHECK_EQ(edge.time_us,want[i].time_us);
+		CHECK_EQ(edge.gpio,want[i].gpio);
+		CHECK_EQ(edge.level,want[i].level);
+	}
+	CHECK(!xQueueReceive(q,&edge,0));
+
+	// Six edges into four slots: the first four are kept, the late ones
+	// dropped without a yield, and the level read in the ISR still lets
+	// the reader resync.
+	for(int i=0;i<6;i++)edge_at(2000+i*100,PIN_B,i&1);
+	CHECK_EQ(uxQueueMessagesWaiting(q),4);
+	CHECK_EQ(fake_isr_yields(),4);
+	for(int i=0;i<4;i++){
+		CHECK(xQueueReceive(q,&edge,0));
+		CHECK_EQ(edge.time_us,2000+i*100);
+		CHECK_EQ(edge.level,i&1);
+	}
+	CHECK_EQ(gpio_get_level(PIN_B),1);
+
+	CHECK_DONE();
+}
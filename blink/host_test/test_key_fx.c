@@ -0,0 +1,100 @@
+// Effects: a released key fades over KEY_FX_FADE_MS counted from the
+// release even if frames stopped while it was held, ripples move outwards
+// and end, lock LEDs show the host's locks, and rendering reports when
+// nothing moves any more.
+#include <string.h>
+#include "check.h"
+#include "key_fx.h"
+#include "apa102_frame.h"
+
+#define LEDS 19 // the lighting strip: 16 keys and 3 locks
+
+static key_fx_t fx;
+static uint8_t frame[APA102_FRAME_LEN(KEY_FX_MAX_LEDS)];
+
+static const uint8_t *led(int i){
+	return frame+APA102_START_LEN+APA102_LED_LEN*i;
+}
+
+static bool dark(int i){
+	return !led(i)[1]&&!led(i)[2]&&!led(i)[3];
+}
+
+int main(void){
+	key_fx_init(&fx,LEDS,255);
+	apa102_frame_init(frame,LEDS);
+	CHECK(!key_fx_render(&fx,frame,1000));
+	for(int i=0;i<LEDS;i++){
+		CHECK(dark(i));
+		CHECK_EQ(led(i)[0],APA102_LED_HEADER|APA102_BRIGHTNESS_MAX);
+	}
+
+	// Press: full heat under the key and a ripple, which has moved
+	// KEY_FX_RIPPLE_LEDS_PER_S/4 LEDs out after 250 ms.
+	key_fx_key(&fx,8,true,10000);
+	CHECK(key_fx_render(&fx,frame,10000));
+	CHECK_EQ(fx.heat[8],255);
+	CHECK(!dark(8));
+	CHECK(dark(8+4));
+	CHECK(key_fx_render(&fx,frame,10250));
+	CHECK(!dark(8+KEY_FX_RIPPLE_LEDS_PER_S/4));
+	CHECK(!dark(8-KEY_FX_RIPPLE_LEDS_PER_S/4));
+	CHECK(dark(8+KEY_FX_RIPPLE_LEDS_PER_S/4+3));
+	CHECK_EQ(fx.heat[8],255);
+
+	// Ripple over, key still held: frames stop.
+	CHECK(!key_fx_render(&fx,frame,10000+KEY_FX_RIPPLE_MS));
+	for(int i=0;i<LEDS;i++)if(i!=8)CHECK(dark(i));
+	CHECK(!dark(8));
+
+	// Released 1.2 s later, with no frames in between. The first frame
+	// after the release starts the fade, the glow is gone KEY_FX_FADE_MS
+	// after that and not before.
+	key_fx_key(&fx,8,false,12000);
+	CHECK(key_fx_render(&fx,frame,12000));
+	CHECK_EQ(fx.heat[8],255);
+	uint32_t t=12000;
+	int frames=0;
+	while(key_fx_render(&fx,frame,t+=16))frames++;
+	CHECK_EQ(fx.heat[8],0);
+	CHECK(dark(8));
+	CHECK(t-12000>=KEY_FX_FADE_MS-16);
+	CHECK(t-12000<=KEY_FX_FADE_MS+16);
+	CHECK(frames>20);
+
+	// A tap between two frames shows at full heat, then fades frame by
+	// frame.
+	key_fx_key(&fx,3,true,20000);
+	key_fx_key(&fx,3,false,20010);
+	CHECK(key_fx_render(&fx,frame,20016));
+	CHECK_EQ(fx.heat[3],255);
+	CHECK(key_fx_render(&fx,frame,20032));
+	CHECK_EQ(fx.heat[3],255-16*255/KEY_FX_FADE_MS);
+
+	// Lock indicators are the last three LEDs, Num, Caps, Scroll, and do
+	// not keep frames going on their own.
+	key_fx_init(&fx,LEDS,255);
+	key_fx_locks(&fx,1<<1);
+	CHECK(!key_fx_render(&fx,frame,30000));
+	CHECK(dark(LEDS-3));
+	CHECK(!dark(LEDS-2));
+	CHECK(dark(LEDS-1));
+	CHECK(dark(0));
+
+	// Master brightness scales the output, 0 is off.
+	key_fx_set_brightness(&fx,0);
+	key_fx_render(&fx,frame,30016);
+	CHECK(dark(LEDS-2));
+	key_fx_set_brightness(&fx,64);
+	key_fx_render(&fx,frame,30032);
+	CHECK(led(LEDS-2)[3]>0&&led(LEDS-2)[3]<=64);
+
+	// Presses past the strip are ignored, a strip longer than the
+	// buffers is clamped.
+	key_fx_key(&fx,LEDS,true,40000);
+	CHECK(!key_fx_render(&fx,frame,40000));
+	key_fx_init(&fx,KEY_FX_MAX_LEDS+10,255);
+	CHECK_EQ(fx.num_leds,KEY_FX_MAX_LEDS);
+
+	CHECK_DONE();
+}
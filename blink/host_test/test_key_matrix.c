@@ -0,0 +1,176 @@
+// Matrix scan against a simulated 4x4 switch matrix: bouncy presses and
+// releases give exactly one event each, 4 scans after the contact settles,
+// short glitches give none, and the scan runs at 1 kHz only while keys are
+// down or settling.
+#include "check.h"
+#include "fake_idf.h"
+#include "esp_timer.h"
+#include "key_matrix.h"
+#include "key_ulp.h"
+#include "hid_usage.h"
+
+// Wiring and keymap of key_matrix.c.
+static const uint8_t row_gpio[KEY_MATRIX_ROWS]={13,14,15,4};
+static const uint8_t col_gpio[KEY_MATRIX_COLS]={25,26,27,33};
+#define KEY_ESC   0  // row 0 col 0
+#define KEY_Q     5  // row 1 col 1
+#define KEY_W     6  // row 1 col 2
+#define KEY_A     9  // row 2 col 1
+static const uint8_t usage[]={[KEY_ESC]=HID_KEY_ESCAPE,[KEY_Q]=HID_KEY_Q,[KEY_W]=HID_KEY_W,[KEY_A]=HID_KEY_A};
+
+static bool closed[KEY_MATRIX_ROWS*KEY_MATRIX_COLS];
+static uint32_t reads;
+
+static uint64_t matrix_read(uint32_t driven){
+	uint64_t in=0;
+	reads++;
+	for(int r=0;r<KEY_MATRIX_ROWS;r++){
+		if(!(driven>>row_gpio[r]&1))continue;
+		for(int c=0;c<KEY_MATRIX_COLS;c++)
+			if(closed[r*KEY_MATRIX_COLS+c])in|=1ULL<<col_gpio[c];
+	}
+	return in;
+}
+
+// Switch a contact, and the column pin with it as seen with every row
+// held high while the scan is idle.
+static void contact(int key, bool on){
+	closed[key]=on;
+	int c=key%KEY_MATRIX_COLS;
+	bool level=false;
+	for(int r=0;r<KEY_MATRIX_ROWS;r++)level|=closed[r*KEY_MATRIX_COLS+c];
+	fake_gpio_edge(col_gpio[c],level);
+}
+
+static void run_to(int64_t us){
+	fake_time_advance(us-esp_timer_get_time());
+}
+
+// Contact chatter: toggles every period_us for bounce_us, then settles on.
+static void bounce(int key, int64_t from, int64_t bounce_us, int64_t period_us, bool on){
+	bool level=on;
+	for(int64_t t=from;t<from+bounce_us;t+=period_us){
+		run_to(t);
+		contact(key,level);
+		level=!level;
+	}
+	run_to(from+bounce_us);
+	contact(key,on);
+}
+
+#define MAX_EVENTS 16
+
+static struct {
+	int64_t us;
+	uint8_t key;
+	bool down;
+} events[MAX_EVENTS];
+static int num_events;
+
+static void on_event(uint8_t key, bool down){
+	if(num_events<MAX_EVENTS){
+		events[num_events].us=esp_timer_get_time();
+		events[num_events].key=key;
+		events[num_events].down=down;
+	}
+	num_events++;
+}
+
+bool key_ulp_take(const uint8_t cols_gpio[KEY_MATRIX_COLS], uint32_t cols[KEY_MATRIX_ROWS]){
+	(void)cols_gpio;
+	(void)cols;
+	return false;
+}
+
+static void check_event(int i, int key, bool down, int64_t us){
+	CHECK(i<num_events);
+	CHECK_EQ(events[i].key,usage[key]);
+	CHECK_EQ(events[i].down,down);
+	CHECK_EQ(events[i].us,us);
+}
+
+int main(void){
+	fake_gpio_matrix(matrix_read);
+
+	// Held since before boot: no edge, the start reads the columns once.
+	closed[KEY_ESC]=true;
+	CHECK_EQ(key_matrix_start(on_event),ESP_OK);
+	run_to(10000);
+	CHECK_EQ(num_events,1);
+	check_event(0,KEY_ESC,true,4000);
+	contact(KEY_ESC,false);
+	run_to(20000);
+	CHECK_EQ(num_events,2);
+	check_event(1,KEY_ESC,false,14000);
+
+	// Released and settled, the scan stops until the next press.
+	uint32_t idle_reads=reads;
+	run_to(100000);
+	CHECK_EQ(reads,idle_reads);
+
+	// 3 ms of chatter every 300 us. The column edge wakes the scan, the
+	// first scan is 1 ms later and the key goes down on the 4th scan that
+	// sees it settled: at most 4 ms after the bounce ends.
+	num_events=0;
+	bounce(KEY_A,100000,3000,300,true);
+	run_to(110000);
+	CHECK_EQ(num_events,1);
+	CHECK(events[0].us>100000+3000);
+	CHECK(events[0].us<=100000+3000+4000);
+	CHECK_EQ(events[0].key,HID_KEY_A);
+	CHECK_EQ(events[0].down,true);
+
+	// Held for 1.5 s: 1000 scans in the full second, one read per row.
+	run_to(1200000);
+	key_matrix_stats_t stats;
+	key_matrix_get_stats(&stats);
+	CHECK_EQ(stats.scans,KEY_MATRIX_SCAN_HZ);
+	CHECK_EQ(num_events,1);
+
+	// Bouncy release, one event.
+	bounce(KEY_A,1200000,2000,250,false);
+	run_to(1300000);
+	CHECK_EQ(num_events,2);
+	CHECK_EQ(events[1].down,false);
+	CHECK(events[1].us>1200000+2000);
+	CHECK(events[1].us<=1200000+2000+4000);
+
+	// A 2.5 ms glitch is seen by at most 3 scans, no event.
+	run_to(1400000);
+	idle_reads=reads;
+	contact(KEY_W,true);
+	run_to(1402500);
+	contact(KEY_W,false);
+	run_to(1500000);
+	CHECK_EQ(num_events,2);
+	CHECK(reads>idle_reads);
+	idle_reads=reads;
+	run_to(1600000);
+	CHECK_EQ(reads,idle_reads);
+
+	// Two keys on one row chattering out of step, then settled together.
+	num_events=0;
+	run_to(1700000);
+	contact(KEY_Q,true);
+	run_to(1700400);
+	contact(KEY_W,true);
+	run_to(1700800);
+	contact(KEY_Q,false);
+	run_to(1701200);
+	contact(KEY_Q,true);
+	run_to(1710000);
+	CHECK_EQ(num_events,2);
+	CHECK_EQ(events[0].key,HID_KEY_W);
+	CHECK_EQ(events[1].key,HID_KEY_Q);
+	CHECK(events[0].down&&events[1].down);
+	contact(KEY_Q,false);
+	contact(KEY_W,false);
+	run_to(1720000);
+	CHECK_EQ(num_events,4);
+	CHECK(!events[2].down&&!events[3].down);
+
+	CHECK_EQ(key_matrix_index(HID_KEY_A),KEY_A);
+	CHECK_EQ(key_matrix_index(HID_KEY_Z),-1);
+
+	CHECK_DONE();
+}
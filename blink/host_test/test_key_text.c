@@ -0,0 +1,125 @@
+// Every printable ASCII character types as exactly its US layout key, with
+// Shift when needed, and a string streams into the report
+// builder as press/release reports, clear of the keys held around it.
+#include <string.h>
+#include "check.h"
+#include "key_text.h"
+#include "hid_usage.h"
+
+#define MAX_SENT 8
+
+static kbd_state_t sent[MAX_SENT];
+static int num_sent;
+
+static void record(const kbd_state_t *s){
+	if(num_sent<MAX_SENT)sent[num_sent]=*s;
+	num_sent++;
+}
+
+// Reference US layout, written out independently of key_text.c: the
+// unshifted and shifted character of every key that types one.
+static const struct {
+	uint8_t key;
+	char plain, shifted;
+} us_keys[]={
+	{HID_KEY_1,'1','!'}, {HID_KEY_2,'2','@'}, {HID_KEY_3,'3','#'},
+	{HID_KEY_4,'4','$'}, {HID_KEY_5,'5','%'}, {HID_KEY_6,'6','^'},
+	{HID_KEY_7,'7','&'}, {HID_KEY_8,'8','*'}, {HID_KEY_9,'9','('},
+	{HID_KEY_0,'0',')'}, {HID_KEY_MINUS,'-','_'}, {HID_KEY_EQUAL,'=','+'},
+	{HID_KEY_LEFT_BRKT,'[','{'}, {HID_KEY_RIGHT_BRKT,']','}'},
+	{HID_KEY_BACK_SLASH,'\\','|'}, {HID_KEY_SEMI_COLON,';',':'},
+	{HID_KEY_SGL_QUOTE,'\'','"'}, {HID_KEY_GRV_ACCENT,'`','~'},
+	{HID_KEY_COMMA,',','<'}, {HID_KEY_DOT,'.','>'},
+	{HID_KEY_FWD_SLASH,'/','?'}, {HID_KEY_SPACEBAR,' ',0},
+};
+
+static bool us_lookup(char c, uint8_t *key, bool *shift){
+	if(c>='a'&&c<='z'){*key=HID_KEY_A+(c-'a');*shift=false;return true;}
+	if(c>='A'&&c<='Z'){*key=HID_KEY_A+(c-'A');*shift=true;return true;}
+	for(size_t i=0;i<sizeof(us_keys)/sizeof(us_keys[0]);i++){
+		if(us_keys[i].plain==c){*key=us_keys[i].key;*shift=false;return true;}
+		if(us_keys[i].shifted&&us_keys[i].shifted==c){*key=us_keys[i].key;*shift=true;return true;}
+	}
+	return false;
+}
+
+static bool only_key(const kbd_state_t *s, uint8_t mods, uint8_t key){
+	if(s->mods!=mods)return false;
+	if(!key)return s->num_keys==0;
+	return s->num_keys==1&&s->keys[0]==key&&(s->bits[key>>3]&(1<<(key&7)));
+}
+
+int main(void){
+	kbd_report_t r;
+	const uint8_t shift=KBD_MODIFIER_BIT(HID_KEY_LEFT_SHIFT);
+
+	for(char c=' ';c<='~';c++){
+		uint8_t key;
+		bool shifted;
+		if(!us_lookup(c,&key,&shifted)){
+			fprintf(stderr,"no reference key for '%c'\n",c);
+			check_failures++;
+			continue;
+		}
+		uint8_t code=key_text_layout_us[(uint8_t)c];
+		if(code!=(key|(shifted?KEY_TEXT_SHIFT:0)))
+			fprintf(stderr,"'%c': table 0x%02x, want key 0x%02x%s\n",c,code,key,shifted?" + shift":"");
+		CHECK_EQ(code,key|(shifted?KEY_TEXT_SHIFT:0));
+
+		char text[2]={c,0};
+		kbd_report_init(&r,record);
+		num_sent=0;
+		key_text_type(&r,key_text_layout_us,text);
+		kbd_report_flush(&r);
+		// The builder only flushes when an event would undo something the
+		// host has not seen, so Shift goes out together with the key.
+		CHECK_EQ(num_sent,2);
+		CHECK(only_key(&sent[0],shifted?shift:0,key));
+		CHECK(only_key(&sent[1],0,0));
+	}
+
+	// Control characters type the keys that produce them, the rest of
+	// 0x00-0x1f and anything above 0x7f is skipped.
+	CHECK_EQ(key_text_layout_us['\n'],HID_KEY_RETURN);
+	CHECK_EQ(key_text_layout_us['\t'],HID_KEY_TAB);
+	CHECK_EQ(key_text_layout_us['\b'],HID_KEY_DELETE);
+	CHECK_EQ(key_text_layout_us['\x1b'],HID_KEY_ESCAPE);
+	CHECK_EQ(key_text_layout_us['\x7f'],HID_KEY_DELETE_FWD);
+	CHECK_EQ(key_text_layout_us['\x01'],0);
+	kbd_report_init(&r,record);
+	num_sent=0;
+	key_text_type(&r,key_text_layout_us,"\x01\xc3\xa9");
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,0);
+
+	// Repeated letters get a release between them, so the host sees both.
+	kbd_report_init(&r,record);
+	num_sent=0;
+	key_text_type(&r,key_text_layout_us,"oo");
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,4);
+	CHECK(only_key(&sent[0],0,HID_KEY_O));
+	CHECK(only_key(&sent[1],0,0));
+	CHECK(only_key(&sent[2],0,HID_KEY_O));
+	CHECK(only_key(&sent[3],0,0));
+
+	// Text typed over held Shift, Ctrl and A goes out without them, the A
+	// in it is a keystroke of its own, and they are held again after it.
+	uint8_t held=shift|KBD_MODIFIER_BIT(HID_KEY_LEFT_CTRL);
+	kbd_report_init(&r,record);
+	kbd_report_apply(&r,HID_KEY_LEFT_SHIFT,true);
+	kbd_report_apply(&r,HID_KEY_LEFT_CTRL,true);
+	kbd_report_apply(&r,HID_KEY_A,true);
+	kbd_report_flush(&r);
+	num_sent=0;
+	key_text_type(&r,key_text_layout_us,"a!");
+	kbd_report_flush(&r);
+	CHECK_EQ(num_sent,5);
+	CHECK(only_key(&sent[0],0,0));
+	CHECK(only_key(&sent[1],0,HID_KEY_A));
+	CHECK(only_key(&sent[2],shift,HID_KEY_1));
+	CHECK(only_key(&sent[3],0,0));
+	CHECK(only_key(&sent[4],held,HID_KEY_A));
+
+	CHECK_DONE();
+}
@@ -0,0 +1,115 @@
+// The ULP scan program key_ulp_start() loads, run instruction by
+// instruction on the fake ULP against recorded contact traces, one sample
+// per ULP timer expiry. It wakes the CPU on the KEY_ULP_DEBOUNCE-th
+// identical scan after the first one with a key down, bouncing or a
+// release starts the count over, and key_ulp_take() hands over the keys
+// of the scan that woke it.
+#include <stdio.h>
+#include "check.h"
+#include "fake_idf.h"
+#include "fake_ulp.h"
+#include "esp_sleep.h"
+#include "esp32/ulp.h"
+#include "key_ulp.h"
+
+// Wiring of key_matrix.c, with the RTC pin of each GPIO.
+static const uint8_t row_gpio[KEY_MATRIX_ROWS]={13,14,15,4};
+static const uint8_t row_rtc[KEY_MATRIX_ROWS]={14,16,13,10};
+static const uint8_t col_gpio[KEY_MATRIX_COLS]={25,26,27,33};
+static const uint8_t col_rtc[KEY_MATRIX_COLS]={6,7,17,8};
+#define RTC_GPIO32 9 // not wired, inside the column field
+
+#define K(r,c) (1u<<((r)*KEY_MATRIX_COLS+(c)))
+#define FLOAT  (1u<<16) // GPIO32 picks up noise
+#define TRACE_MAX 12
+
+_Static_assert(KEY_ULP_DEBOUNCE==2,"the traces were recorded with a debounce of 2");
+
+// Closed contacts at each 10 ms scan, and the scan the ULP wakes on.
+static const struct {
+	const char *name;
+	int wake; // -1 for none
+	int len;
+	uint32_t scan[TRACE_MAX];
+} traces[]={
+	{"clean press",4,6,{0,0,K(1,1),K(1,1),K(1,1),K(1,1)}},
+	{"bounce",6,7,{K(1,1),0,K(1,1),0,K(1,1),K(1,1),K(1,1)}},
+	{"chord",3,6,{K(1,1),K(1,1)|K(1,2),K(1,1)|K(1,2),K(1,1)|K(1,2),K(1,1)|K(1,2),K(1,1)|K(1,2)}},
+	{"tap",-1,8,{0,K(2,1),K(2,1),0,0,K(2,1),K(2,1),0}},
+	{"roll",-1,8,{K(0,0),K(0,0),K(0,1),K(0,1),K(0,2),K(0,2),K(0,3),K(0,3)}},
+	{"corners",2,3,{K(0,0)|K(3,3)|K(3,2),K(0,0)|K(3,3)|K(3,2),K(0,0)|K(3,3)|K(3,2)}},
+	{"floating pin",-1,6,{FLOAT,FLOAT,FLOAT,FLOAT,FLOAT,FLOAT}},
+	{"floating pin under a key",2,4,{K(2,3),FLOAT|K(2,3),K(2,3),FLOAT|K(2,3)}},
+};
+#define NUM_TRACES (sizeof(traces)/sizeof(traces[0]))
+
+static uint32_t closed;
+static uint32_t reads;
+
+static uint32_t pins_read(uint32_t driven){
+	uint32_t in=closed&FLOAT?1u<<RTC_GPIO32:0;
+	reads++;
+	for(int r=0;r<KEY_MATRIX_ROWS;r++){
+		if(!(driven>>row_rtc[r]&1))continue;
+		for(int c=0;c<KEY_MATRIX_COLS;c++)
+			if(closed&K(r,c))in|=1u<<col_rtc[c];
+	}
+	return in;
+}
+
+static void run_trace(int t){
+	uint32_t cols[KEY_MATRIX_ROWS];
+	int woke=-1;
+
+	fake_sleep_wakeup(ESP_SLEEP_WAKEUP_UNDEFINED);
+	CHECK_EQ(key_ulp_start(row_gpio,col_gpio),ESP_OK);
+	CHECK(fake_ulp_running());
+	CHECK_EQ(fake_ulp_period_us(),KEY_ULP_SCAN_MS*1000);
+	for(int i=0;i<traces[t].len;i++){
+		closed=traces[t].scan[i];
+		reads=0;
+		bool wake=fake_ulp_tick();
+		if(woke<0){
+			// Every row is read once and let go again.
+			CHECK_EQ(reads,KEY_MATRIX_ROWS);
+			CHECK_EQ(fake_ulp_driven(),0);
+			if(wake)woke=i;
+		}else{
+			// The timer stops with the wake, nothing runs after it.
+			CHECK(!wake);
+			CHECK_EQ(reads,0);
+		}
+	}
+	if(woke!=traces[t].wake)printf("%s: woke on scan %d, not %d\n",traces[t].name,woke,traces[t].wake);
+	CHECK_EQ(woke,traces[t].wake);
+	CHECK_EQ(fake_ulp_running(),woke<0);
+	CHECK(!key_ulp_take(col_gpio,cols));
+	if(woke<0)return;
+
+	fake_sleep_wakeup(ESP_SLEEP_WAKEUP_ULP);
+	CHECK(key_ulp_take(col_gpio,cols));
+	for(int r=0;r<KEY_MATRIX_ROWS;r++){
+		uint32_t want=0;
+		for(int c=0;c<KEY_MATRIX_COLS;c++)
+			if(traces[t].scan[woke]&K(r,c))want|=1<<c;
+		CHECK_EQ(cols[r],want);
+	}
+}
+
+int main(void){
+	fake_ulp_pins(pins_read);
+	for(size_t t=0;t<NUM_TRACES;t++)run_trace(t);
+
+	// The stores leave the PC in the upper half of each word.
+	uint32_t rows=0;
+	for(int r=0;r<KEY_MATRIX_ROWS;r++)rows|=RTC_SLOW_MEM[KEY_ULP_DATA+KEY_ULP_ROWS+r];
+	CHECK(rows>>16);
+
+	// Columns spread over more than 16 RTC pins cannot be read in one go,
+	// and a GPIO without an RTC pin not at all.
+	const uint8_t wide_cols[KEY_MATRIX_COLS]={36,26,27,33};
+	const uint8_t bad_rows[KEY_MATRIX_ROWS]={13,14,15,5};
+	CHECK_EQ(key_ulp_start(row_gpio,wide_cols),ESP_ERR_INVALID_ARG);
+	CHECK_EQ(key_ulp_start(bad_rows,col_gpio),ESP_ERR_INVALID_ARG);
+	CHECK_DONE();
+}
@@ -0,0 +1,92 @@
+// Replay a motion trace through the accumulator, one report per simulated
+// connection event, and check no count is lost: everything reported plus
+// what is left equals everything moved, on every axis.
+#include "check.h"
+#include "mouse_accum.h"
+
+#define SAMPLES 20000
+#define SAMPLES_PER_EVENT 3 // 1 kHz sensor, 7.5 ms interval with some jitter
+
+static uint32_t seed=12345;
+
+static int32_t rnd(int32_t range){
+	seed=seed*1103515245+12345;
+	return (int32_t)(seed>>8)%(2*range+1)-range;
+}
+
+int main(void){
+	mouse_accum_t m;
+	mouse_state_t s;
+	int64_t moved[MOUSE_AXES]={0}, reported[MOUSE_AXES]={0};
+	int reports=0, saturated=0;
+
+	mouse_accum_init(&m);
+	CHECK(!mouse_accum_take(&m,&s));
+	CHECK(!mouse_accum_pending(&m));
+
+	for(int n=0;n<SAMPLES;n++){
+		// Slow drift in fractions of a count, with fast flicks far past
+		// what one report can carry mixed in.
+		int32_t range=(n/500)%4==3?200000:600;
+		int32_t delta[MOUSE_AXES]={rnd(range),rnd(range),rnd(range/8),rnd(range/16)};
+		mouse_accum_move(&m,delta);
+		for(int i=0;i<MOUSE_AXES;i++)moved[i]+=delta[i];
+
+		if(n%SAMPLES_PER_EVENT||!mouse_accum_take(&m,&s))continue;
+		reports++;
+		for(int i=0;i<MOUSE_AXES;i++){
+			CHECK(s.axis[i]>=-MOUSE_ACCUM_MAX&&s.axis[i]<=MOUSE_ACCUM_MAX);
+			saturated+=s.axis[i]==MOUSE_ACCUM_MAX||s.axis[i]==-MOUSE_ACCUM_MAX;
+			reported[i]+=s.axis[i];
+		}
+	}
+	// Drain what the flicks left behind, one report per event.
+	while(mouse_accum_pending(&m)){
+		CHECK(mouse_accum_take(&m,&s));
+		reports++;
+		for(int i=0;i<MOUSE_AXES;i++)reported[i]+=s.axis[i];
+	}
+	CHECK(!mouse_accum_take(&m,&s));
+
+	for(int i=0;i<MOUSE_AXES;i++){
+		CHECK_EQ(reported[i]*(1<<MOUSE_ACCUM_SHIFT)+m.acc[i],moved[i]);
+		// Only a fraction of a count stays behind.
+		CHECK(m.acc[i]>-(1<<MOUSE_ACCUM_SHIFT)&&m.acc[i]<(1<<MOUSE_ACCUM_SHIFT));
+	}
+	CHECK(saturated>0);
+	printf("%d reports, %d saturated axes\n",reports,saturated);
+
+	// Fractions add up to a whole count only once they get there, and a
+	// move back through zero keeps the remainder.
+	mouse_accum_init(&m);
+	int32_t third[MOUSE_AXES]={100,-100,0,0};
+	mouse_accum_move(&m,third);
+	mouse_accum_move(&m,third);
+	CHECK(!mouse_accum_take(&m,&s));
+	mouse_accum_move(&m,third);
+	CHECK(mouse_accum_take(&m,&s));
+	CHECK_EQ(s.axis[MOUSE_X],1);
+	CHECK_EQ(s.axis[MOUSE_Y],-1);
+	CHECK_EQ(m.acc[MOUSE_X],44);
+	CHECK_EQ(m.acc[MOUSE_Y],-44);
+
+	// A button change is reported on its own, without motion, and only once.
+	mouse_accum_init(&m);
+	CHECK(mouse_accum_buttons(&m,1));
+	CHECK(mouse_accum_pending(&m));
+	CHECK(mouse_accum_take(&m,&s));
+	CHECK_EQ(s.buttons,1);
+	CHECK_EQ(s.axis[MOUSE_X],0);
+	CHECK(!mouse_accum_buttons(&m,1));
+	CHECK(!mouse_accum_take(&m,&s));
+	// Buttons go out with whatever motion is there.
+	int32_t right[MOUSE_AXES]={5<<MOUSE_ACCUM_SHIFT,0,0,0};
+	mouse_accum_move(&m,right);
+	CHECK(mouse_accum_buttons(&m,0));
+	CHECK(mouse_accum_take(&m,&s));
+	CHECK_EQ(s.buttons,0);
+	CHECK_EQ(s.axis[MOUSE_X],5);
+	CHECK(!mouse_accum_pending(&m));
+
+	CHECK_DONE();
+}
@@ -0,0 +1,110 @@
+// Every transition of the power state machine: each event and a tick
+// just before and at the timeout from every state, plus the deadline,
+// residency and current estimate, also across the ms counter wrap.
+#include "check.h"
+#include "power_state.h"
+
+// Put a fresh machine in a state by way of its events, at about t0.
+static void reach(power_sm_t *sm, power_state_t state, uint32_t t0){
+	power_sm_init(sm,state==POWER_IDLE?t0-POWER_IDLE_MS:t0);
+	switch(state){
+	case POWER_ADVERTISING:
+		break;
+	case POWER_ACTIVE:
+		power_sm_event(sm,POWER_EV_CONNECTED,t0);
+		break;
+	case POWER_IDLE:
+		power_sm_event(sm,POWER_EV_CONNECTED,t0-POWER_IDLE_MS);
+		power_sm_event(sm,POWER_EV_TICK,t0);
+		break;
+	case POWER_DEEP_SLEEP:
+		power_sm_event(sm,POWER_EV_TICK,t0+POWER_ADV_TIMEOUT_MS);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct {
+	power_state_t from;
+	power_event_t ev;
+	uint32_t after;  // ms after the last input
+	power_state_t to;
+} transitions[]={
+	{POWER_ADVERTISING,POWER_EV_INPUT,10,POWER_ADVERTISING},
+	{POWER_ADVERTISING,POWER_EV_CONNECTED,10,POWER_ACTIVE},
+	{POWER_ADVERTISING,POWER_EV_DISCONNECTED,10,POWER_ADVERTISING},
+	{POWER_ADVERTISING,POWER_EV_TICK,POWER_ADV_TIMEOUT_MS-1,POWER_ADVERTISING},
+	{POWER_ADVERTISING,POWER_EV_TICK,POWER_ADV_TIMEOUT_MS,POWER_DEEP_SLEEP},
+
+	{POWER_ACTIVE,POWER_EV_INPUT,10,POWER_ACTIVE},
+	{POWER_ACTIVE,POWER_EV_CONNECTED,10,POWER_ACTIVE},
+	{POWER_ACTIVE,POWER_EV_DISCONNECTED,10,POWER_ADVERTISING},
+	{POWER_ACTIVE,POWER_EV_TICK,POWER_IDLE_MS-1,POWER_ACTIVE},
+	{POWER_ACTIVE,POWER_EV_TICK,POWER_IDLE_MS,POWER_IDLE},
+
+	{POWER_IDLE,POWER_EV_INPUT,10,POWER_ACTIVE},
+	{POWER_IDLE,POWER_EV_CONNECTED,10,POWER_ACTIVE},
+	{POWER_IDLE,POWER_EV_DISCONNECTED,10,POWER_ADVERTISING},
+	{POWER_IDLE,POWER_EV_TICK,POWER_DEEP_SLEEP_MS-1,POWER_IDLE},
+	{POWER_IDLE,POWER_EV_TICK,POWER_DEEP_SLEEP_MS,POWER_DEEP_SLEEP},
+
+	{POWER_DEEP_SLEEP,POWER_EV_INPUT,10,POWER_DEEP_SLEEP},
+	{POWER_DEEP_SLEEP,POWER_EV_CONNECTED,10,POWER_DEEP_SLEEP},
+	{POWER_DEEP_SLEEP,POWER_EV_DISCONNECTED,10,POWER_DEEP_SLEEP},
+	{POWER_DEEP_SLEEP,POWER_EV_TICK,10,POWER_DEEP_SLEEP},
+};
+
+int main(void){
+	power_sm_t sm;
+	// Once from early on, once so the timeouts run across the wrap.
+	static const uint32_t starts[]={1000000,UINT32_MAX-POWER_IDLE_MS/2};
+
+	for(size_t s=0;s<sizeof(starts)/sizeof(starts[0]);s++){
+		uint32_t t0=starts[s];
+		for(size_t i=0;i<sizeof(transitions)/sizeof(transitions[0]);i++){
+			reach(&sm,transitions[i].from,t0);
+			CHECK_EQ(sm.state,transitions[i].from);
+			uint32_t last=sm.last_input;
+			power_state_t to=power_sm_event(&sm,transitions[i].ev,last+transitions[i].after);
+			if(to!=transitions[i].to)
+				fprintf(stderr,"%s + event %d after %u ms: %s, want %s\n",
+					power_state_name(transitions[i].from),transitions[i].ev,transitions[i].after,
+					power_state_name(to),power_state_name(transitions[i].to));
+			CHECK_EQ(to,transitions[i].to);
+			CHECK_EQ(sm.state,to);
+		}
+	}
+
+	// Input and connection events restart the quiet time, ticks do not.
+	power_sm_init(&sm,0);
+	power_sm_event(&sm,POWER_EV_CONNECTED,0);
+	CHECK_EQ(power_sm_deadline(&sm,500),POWER_IDLE_MS-500);
+	power_sm_event(&sm,POWER_EV_TICK,1500);
+	CHECK_EQ(power_sm_deadline(&sm,1500),POWER_IDLE_MS-1500);
+	power_sm_event(&sm,POWER_EV_INPUT,1500);
+	CHECK_EQ(power_sm_deadline(&sm,1500),POWER_IDLE_MS);
+	CHECK_EQ(power_sm_event(&sm,POWER_EV_TICK,1500+POWER_IDLE_MS-1),POWER_ACTIVE);
+	// Idle counts from the input, not from entering idle.
+	CHECK_EQ(power_sm_event(&sm,POWER_EV_TICK,1500+POWER_IDLE_MS),POWER_IDLE);
+	CHECK_EQ(power_sm_deadline(&sm,1500+POWER_IDLE_MS),POWER_DEEP_SLEEP_MS-POWER_IDLE_MS);
+	// A late tick asks to be run right away, deep sleep never times out.
+	CHECK_EQ(power_sm_deadline(&sm,1500+POWER_DEEP_SLEEP_MS+50),1);
+	CHECK_EQ(power_sm_event(&sm,POWER_EV_TICK,1500+POWER_DEEP_SLEEP_MS+50),POWER_DEEP_SLEEP);
+	CHECK_EQ(power_sm_deadline(&sm,1500+POWER_DEEP_SLEEP_MS+60),0);
+
+	// Residency and the average current estimate: 1 s active, 9 s idle.
+	power_sm_init(&sm,0);
+	power_sm_event(&sm,POWER_EV_CONNECTED,0);
+	CHECK_EQ(power_sm_avg_ua(&sm,0),POWER_ACTIVE_UA);
+	power_sm_event(&sm,POWER_EV_TICK,POWER_IDLE_MS);
+	CHECK_EQ(sm.residency[POWER_ACTIVE],POWER_IDLE_MS);
+	CHECK_EQ(sm.residency[POWER_ADVERTISING],0);
+	uint32_t end=POWER_IDLE_MS*10;
+	CHECK_EQ(power_sm_avg_ua(&sm,end),((uint64_t)POWER_ACTIVE_UA*POWER_IDLE_MS+(uint64_t)POWER_IDLE_UA*(end-POWER_IDLE_MS))/end);
+
+	for(int st=0;st<POWER_STATES;st++)CHECK(power_state_name(st)[0]!='?');
+	CHECK(power_state_name(POWER_STATES)[0]=='?');
+
+	CHECK_DONE();
+}
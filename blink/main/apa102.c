@@ -0,0 +1,136 @@
+#include "apa102.h"
+#include "apa102_frame.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define LOG_NAME "apa102"
+#define APA102_DMA_CHAN 1
+
+typedef struct {
+	spi_transaction_t t;
+	volatile int64_t start_us;
+	volatile int64_t done_us;
+} apa102_xfer_t;
+
+static apa102_config_t cfg;
+static spi_device_handle_t dev;
+static esp_timer_handle_t frame_timer;
+static TaskHandle_t task;
+static uint8_t *frames[2];
+static apa102_xfer_t xfers[2];
+static portMUX_TYPE lock=portMUX_INITIALIZER_UNLOCKED;
+static apa102_stats_t stats;
+
+static void IRAM_ATTR apa102_xfer_start(spi_transaction_t *t){
+	((apa102_xfer_t *)t->user)->start_us=esp_timer_get_time();
+}
+
+static void IRAM_ATTR apa102_xfer_done(spi_transaction_t *t){
+	((apa102_xfer_t *)t->user)->done_us=esp_timer_get_time();
+}
+
+static void apa102_tick(void *arg){
+	xTaskNotifyGive(task);
+}
+
+static void apa102_task(void *arg){
+	size_t len=APA102_FRAME_LEN(cfg.num_leds);
+	int back=0;
+	bool in_flight=false;
+	int64_t last=0;
+	for(uint32_t n=0;;n++){
+		// More than one tick pending means the last frame overran its slot.
+		uint32_t ticks=ulTaskNotifyTake(pdTRUE,portMAX_DELAY);
+		int64_t start=esp_timer_get_time();
+		cfg.render(frames[back],cfg.num_leds,n,cfg.arg);
+		int64_t rendered=esp_timer_get_time();
+
+		// The other buffer is on the wire, wait for it only now.
+		uint32_t xfer=0;
+		if(in_flight){
+			spi_transaction_t *done;
+			spi_device_get_trans_result(dev,&done,portMAX_DELAY);
+			apa102_xfer_t *x=done->user;
+			xfer=x->done_us-x->start_us;
+		}
+		apa102_xfer_t *x=&xfers[back];
+		memset(&x->t,0,sizeof(x->t));
+		x->t.length=len*8;
+		x->t.tx_buffer=frames[back];
+		x->t.user=x;
+		in_flight=spi_device_queue_trans(dev,&x->t,portMAX_DELAY)==ESP_OK;
+		back^=1;
+
+		portENTER_CRITICAL(&lock);
+		stats.frames++;
+		if(ticks>1)stats.late+=ticks-1;
+		stats.frame_us=last?start-last:0;
+		stats.render_us=rendered-start;
+		if(stats.render_us>stats.render_max_us)stats.render_max_us=stats.render_us;
+		if(xfer){
+			stats.xfer_us=xfer;
+			if(xfer>stats.xfer_max_us)stats.xfer_max_us=xfer;
+		}
+		portEXIT_CRITICAL(&lock);
+		last=start;
+	}
+}
+
+esp_err_t apa102_start(const apa102_config_t *config){
+	esp_err_t err;
+	cfg=*config;
+	size_t len=APA102_FRAME_LEN(cfg.num_leds);
+	for(int i=0;i<2;i++){
+		// DMA reads whole words.
+		if(!(frames[i]=heap_caps_malloc((len+3)&~3,MALLOC_CAP_DMA)))return ESP_ERR_NO_MEM;
+		apa102_frame_init(frames[i],cfg.num_leds);
+	}
+
+	spi_bus_config_t bus={
+		.mosi_io_num=cfg.data_gpio,
+		.miso_io_num=-1,
+		.sclk_io_num=cfg.clock_gpio,
+		.quadwp_io_num=-1,
+		.quadhd_io_num=-1,
+		.max_transfer_sz=len,
+	};
+	if((err=spi_bus_initialize(cfg.host,&bus,APA102_DMA_CHAN))!=ESP_OK)return err;
+	spi_device_interface_config_t devcfg={
+		.mode=0,
+		.clock_speed_hz=cfg.clock_hz,
+		.spics_io_num=-1,
+		.queue_size=2,
+		.pre_cb=apa102_xfer_start,
+		.post_cb=apa102_xfer_done,
+	};
+	if((err=spi_bus_add_device(cfg.host,&devcfg,&dev))!=ESP_OK)return err;
+
+	if(xTaskCreatePinnedToCore(apa102_task,"apa102",2048,NULL,cfg.priority,&task,cfg.core)!=pdPASS)
+		return ESP_ERR_NO_MEM;
+	esp_timer_create_args_t timer_args={.callback=apa102_tick,.name="apa102"};
+	if((err=esp_timer_create(&timer_args,&frame_timer))!=ESP_OK)return err;
+	ESP_LOGI(LOG_NAME,"%u LEDs, %u byte frames at %u Hz",cfg.num_leds,(unsigned)len,cfg.fps);
+	return apa102_set_fps(cfg.fps);
+}
+
+esp_err_t apa102_set_fps(uint16_t fps){
+	if(!fps)return ESP_ERR_INVALID_ARG;
+	if(!frame_timer)return ESP_ERR_INVALID_STATE;
+	cfg.fps=fps;
+	esp_timer_stop(frame_timer);
+	return esp_timer_start_periodic(frame_timer,1000000/fps);
+}
+
+void apa102_pause(void){
+	if(frame_timer)esp_timer_stop(frame_timer);
+}
+
+void apa102_get_stats(apa102_stats_t *out){
+	portENTER_CRITICAL(&lock);
+	*out=stats;
+	portEXIT_CRITICAL(&lock);
+}
@@ -0,0 +1,47 @@
+#ifndef APA102_H__
+#define APA102_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/spi_master.h"
+
+// Fill every LED of the frame with apa102_frame_set. Frames alternate
+// between two buffers, what is in there is two frames old.
+typedef void (*apa102_render_t)(uint8_t *frame, uint16_t num_leds, uint32_t frame_no, void *arg);
+
+typedef struct {
+	spi_host_device_t host;
+	int data_gpio;
+	int clock_gpio;
+	int clock_hz;
+	uint16_t num_leds;
+	uint16_t fps;           // target frame rate
+	int core;               // core the render task is pinned to
+	UBaseType_t priority;
+	apa102_render_t render;
+	void *arg;
+} apa102_config_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t late;          // frame slots missed because the last one overran
+	uint32_t frame_us;      // render start to render start, last frame
+	uint32_t render_us;
+	uint32_t render_max_us;
+	uint32_t xfer_us;       // SPI transaction start to done
+	uint32_t xfer_max_us;
+} apa102_stats_t;
+
+// Set up the SPI bus with DMA and start rendering frames at cfg->fps.
+// The next frame is rendered while the previous one is still being sent.
+esp_err_t apa102_start(const apa102_config_t *cfg);
+
+// Also restarts frames after apa102_pause.
+esp_err_t apa102_set_fps(uint16_t fps);
+
+// Stop rendering, the strip keeps showing the last frame.
+void apa102_pause(void);
+
+void apa102_get_stats(apa102_stats_t *out);
+
+#endif /* APA102_H__ */
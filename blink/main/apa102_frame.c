@@ -0,0 +1,8 @@
+#include "apa102_frame.h"
+#include <string.h>
+
+void apa102_frame_init(uint8_t *frame, size_t num_leds){
+	memset(frame,0,APA102_START_LEN);
+	for(size_t i=0;i<num_leds;i++)apa102_frame_set(frame,i,0,0,0,0);
+	memset(frame+APA102_START_LEN+APA102_LED_LEN*num_leds,0,APA102_END_LEN(num_leds));
+}
@@ -0,0 +1,35 @@
+#ifndef APA102_FRAME_H__
+#define APA102_FRAME_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// One strip update on the wire:
+//  start frame  32 zero bits
+//  LED frames   0b111 + 5 bit global brightness, blue, green, red
+//  end frame    zero bits, one clock per two LEDs so the data shifted along
+//               the strip reaches the last LED, and at least 32 so SK9822
+//               clones latch. Zeros never look like an LED frame, so LEDs
+//               past num_leds keep what they show.
+#define APA102_START_LEN 4
+#define APA102_LED_LEN   4
+#define APA102_END_LEN(n) (((n)+15)/16>4?((n)+15)/16:4)
+#define APA102_FRAME_LEN(n) (APA102_START_LEN+APA102_LED_LEN*(n)+APA102_END_LEN(n))
+
+#define APA102_LED_HEADER     0xE0
+#define APA102_BRIGHTNESS_MAX 31
+
+// Write the start and end frames and turn every LED off.
+void apa102_frame_init(uint8_t *frame, size_t num_leds);
+
+// Set LED i in place. brightness 0-31 is the LED's own current divider,
+// applied on top of the 8 bit colour.
+static inline void apa102_frame_set(uint8_t *frame, size_t i, uint8_t r, uint8_t g, uint8_t b, uint8_t brightness){
+	uint8_t *p=frame+APA102_START_LEN+APA102_LED_LEN*i;
+	p[0]=APA102_LED_HEADER|(brightness&APA102_BRIGHTNESS_MAX);
+	p[1]=b;
+	p[2]=g;
+	p[3]=r;
+}
+
+#endif /* APA102_FRAME_H__ */
@@ -14,6 +14,7 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "esp_bt.h"
 
@@ -26,6 +27,12 @@
 #include "esp_bt_device.h"
 #include "driver/gpio.h"
 #include "hid_dev.h"
+#include "conn_params.h"
+#include "power.h"
+#include "reconnect.h"
+#include "kbd_leds.h"
+#include "boot_time.h"
+#include "dlog.h"
 
 /**
  * Brief:
@@ -49,32 +56,47 @@
 #define BLE_HID_LOG_NAME "Module: Bluetooth"
 #define HIDD_DEVICE_NAME "Not_A_Keyboard"
 
+// Connection and security state of the active host, the one reports go to.
 static uint16_t hid_conn_id = 0;
-static bool sec_conn = false;
+static volatile bool sec_conn = false;
+static TaskHandle_t hid_sender_task = NULL;
+// Set when the active host needs the full keyboard state again.
+static volatile bool hid_resync = false;
+// When the last secured host went away, boot counts as one. Keys typed
+// without a host are held for it until KEY_REPLAY_MS after this.
+static volatile int64_t hid_link_lost_us = 0;
+// Set when a host other than the last peer secures, what is held is
+// dropped instead of replayed to it.
+static volatile bool hid_keys_flush = false;
+// Connection interval of the active host, mouse motion is reported once per
+// interval. 7.5 ms until a host's central picks one.
+#define HID_CONN_INTERVAL_DEFAULT_US 7500
+static volatile uint32_t hid_conn_interval_us = HID_CONN_INTERVAL_DEFAULT_US;
 #define CHAR_DECLARATION_SIZE   (sizeof(uint8_t))
 
 static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param);
 
-static uint8_t hidd_service_uuid128[] = {
-    /* LSB <--------------------------------------------------------------------------------> MSB */
-    //first uuid, 16bit, [12],[13] is the value
-    0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0x12, 0x18, 0x00, 0x00,
+// Advertising and scan response payloads, built at compile time so
+// advertising can start without the stack assembling them first. The
+// advertisement carries what hosts filter and list devices by.
+static const struct __attribute__((packed)) {
+    uint8_t flags[3];
+    uint8_t uuid[4];
+    uint8_t appearance[4];
+    uint8_t name_hdr[2];
+    char name[sizeof(HIDD_DEVICE_NAME) - 1];
+} hidd_adv_raw = {
+    .flags = {2, ESP_BLE_AD_TYPE_FLAG, ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT},
+    .uuid = {3, ESP_BLE_AD_TYPE_16SRV_CMPL, 0x12, 0x18},           //HID service
+    .appearance = {3, ESP_BLE_AD_TYPE_APPEARANCE, 0xc0, 0x03},     //HID Generic
+    .name_hdr = {sizeof(HIDD_DEVICE_NAME), ESP_BLE_AD_TYPE_NAME_CMPL},
+    .name = HIDD_DEVICE_NAME,
 };
+_Static_assert(sizeof(hidd_adv_raw) <= ESP_BLE_ADV_DATA_LEN_MAX, "device name too long for the advertisement");
 
-static esp_ble_adv_data_t hidd_adv_data = {
-    .set_scan_rsp = false,
-    .include_name = true,
-    .include_txpower = true,
-    .min_interval = 0x0006, //slave connection min interval, Time = min_interval * 1.25 msec
-    .max_interval = 0x0010, //slave connection max interval, Time = max_interval * 1.25 msec
-    .appearance = 0x03c0,       //HID Generic,
-    .manufacturer_len = 0,
-    .p_manufacturer_data =  NULL,
-    .service_data_len = 0,
-    .p_service_data = NULL,
-    .service_uuid_len = sizeof(hidd_service_uuid128),
-    .p_service_uuid = hidd_service_uuid128,
-    .flag = 0x6,
+static const uint8_t hidd_scan_rsp_raw[] = {
+    //slave connection interval range 0x0006 - 0x0010, Time = N * 1.25 msec
+    5, ESP_BLE_AD_TYPE_INT_RANGE, 0x06, 0x00, 0x10, 0x00,
 };
 
 static esp_ble_adv_params_t hidd_adv_params = {
@@ -89,6 +111,117 @@ static esp_ble_adv_params_t hidd_adv_params = {
 };
 
 
+// Hosts connected at once. Only the active one gets reports, the others
+// stay connected on idle parameters so switching to them is immediate.
+typedef struct {
+    bool in_use;
+    bool secured;
+    uint16_t conn_id;
+    esp_bd_addr_t bda;
+    uint8_t leds;       // lock LEDs as the host last wrote them
+    uint32_t interval_us; // connection interval of this link
+} hid_host_t;
+
+static hid_host_t hid_hosts[HID_MAX_APPS];
+static int hid_active_host = -1;
+static portMUX_TYPE hid_host_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// With hid_host_lock held.
+static int hid_host_find(const esp_bd_addr_t bda)
+{
+    for (int i = 0; i < HID_MAX_APPS; i++) {
+        if (hid_hosts[i].in_use && !memcmp(hid_hosts[i].bda, bda, sizeof(esp_bd_addr_t))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// First host ready for reports, -1 if none. With hid_host_lock held.
+static int hid_host_first_secured(void)
+{
+    for (int i = 0; i < HID_MAX_APPS; i++) {
+        if (hid_hosts[i].in_use && hid_hosts[i].secured) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Point reports at another host, -1 for none. The host left behind is
+// parked on the idle connection parameters.
+static void hid_host_activate(int slot)
+{
+    esp_bd_addr_t old_bda, new_bda;
+    bool old_secured = false, new_secured = false;
+    uint8_t leds = 0;
+
+    portENTER_CRITICAL(&hid_host_lock);
+    int old = hid_active_host;
+    if (old >= 0 && hid_hosts[old].in_use) {
+        old_secured = hid_hosts[old].secured;
+        memcpy(old_bda, hid_hosts[old].bda, sizeof(esp_bd_addr_t));
+    }
+    hid_active_host = slot;
+    if (slot >= 0) {
+        new_secured = hid_hosts[slot].secured;
+        memcpy(new_bda, hid_hosts[slot].bda, sizeof(esp_bd_addr_t));
+        hid_conn_id = hid_hosts[slot].conn_id;
+        hid_conn_interval_us = hid_hosts[slot].interval_us;
+        leds = hid_hosts[slot].leds;
+    }
+    sec_conn = new_secured;
+    portEXIT_CRITICAL(&hid_host_lock);
+
+    kbd_leds_host(leds, 0);
+    ESP_LOGI(BLE_HID_LOG_NAME, "active host %d", slot + 1);
+    if (new_secured) {
+        conn_params_start(new_bda);
+    } else {
+        conn_params_stop();
+    }
+    if (old_secured && old != slot) {
+        conn_params_park(old_bda);
+    }
+}
+
+// Switch reports to the host in a slot. An empty slot opens advertising
+// instead, so another host can connect or pair there.
+static bool hid_host_select(int slot)
+{
+    if (slot < 0 || slot >= HID_MAX_APPS) {
+        return false;
+    }
+    portENTER_CRITICAL(&hid_host_lock);
+    bool ready = hid_hosts[slot].in_use && hid_hosts[slot].secured;
+    bool empty = !hid_hosts[slot].in_use;
+    bool same = slot == hid_active_host;
+    portEXIT_CRITICAL(&hid_host_lock);
+
+    if (empty) {
+        reconnect_start();
+    }
+    if (!ready || same) {
+        return false;
+    }
+    hid_host_activate(slot);
+    return true;
+}
+
+// Kick the report sender after the link state it is waiting on changed.
+static void hidd_wake_sender(void)
+{
+    if (hid_sender_task != NULL) {
+        xTaskNotifyGive(hid_sender_task);
+    }
+}
+
+// hid_dev callback, a full keyboard FIFO has room again.
+static void hidd_tx_space(uint16_t conn_id)
+{
+    hidd_wake_sender();
+}
+
 static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param)
 {
     switch(event) {
@@ -96,8 +229,12 @@ static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *
             if (param->init_finish.state == ESP_HIDD_INIT_OK) {
                 //esp_bd_addr_t rand_addr = {0x04,0x11,0x11,0x11,0x11,0x05};
                 esp_ble_gap_set_device_name(HIDD_DEVICE_NAME);
-                esp_ble_gap_config_adv_data(&hidd_adv_data);
-                
+                esp_ble_gap_config_adv_data_raw((uint8_t *)&hidd_adv_raw, sizeof(hidd_adv_raw));
+                esp_ble_gap_config_scan_rsp_data_raw((uint8_t *)hidd_scan_rsp_raw, sizeof(hidd_scan_rsp_raw));
+                // Commands run in order on the Bluetooth task, advertising
+                // queues up behind the payloads instead of waiting for them.
+                // hid_dev tracks hosts that connect before the HID table is up.
+                reconnect_start();
             }
             break;
         }
@@ -107,20 +244,110 @@ static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *
         case ESP_HIDD_EVENT_DEINIT_FINISH:
 	     break;
 		case ESP_HIDD_EVENT_BLE_CONNECT: {
+            int slot = -1;
             ESP_LOGI(BLE_HID_LOG_NAME, "ESP_HIDD_EVENT_BLE_CONNECT");
-            hid_conn_id = param->connect.conn_id;
+            portENTER_CRITICAL(&hid_host_lock);
+            for (int i = 0; i < HID_MAX_APPS && slot < 0; i++) {
+                if (!hid_hosts[i].in_use) {
+                    slot = i;
+                    hid_hosts[i].in_use = true;
+                    hid_hosts[i].secured = false;
+                    hid_hosts[i].leds = 0;
+                    hid_hosts[i].interval_us = HID_CONN_INTERVAL_DEFAULT_US;
+                    hid_hosts[i].conn_id = param->connect.conn_id;
+                    memcpy(hid_hosts[i].bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+                }
+            }
+            bool activate = slot >= 0 && hid_active_host < 0;
+            portEXIT_CRITICAL(&hid_host_lock);
+            reconnect_connected(param->connect.remote_bda);
+            boot_time_mark(BOOT_CONNECTED);
+            if (activate) {
+                hid_host_activate(slot);
+            }
             break;
         }
         case ESP_HIDD_EVENT_BLE_DISCONNECT: {
-            sec_conn = false;
-            ESP_LOGI(BLE_HID_LOG_NAME, "ESP_HIDD_EVENT_BLE_DISCONNECT");
-            esp_ble_gap_start_advertising(&hidd_adv_params);
+            hid_dev_tx_stats_t stats;
+            int slot = -1;
+            portENTER_CRITICAL(&hid_host_lock);
+            for (int i = 0; i < HID_MAX_APPS && slot < 0; i++) {
+                if (hid_hosts[i].in_use && hid_hosts[i].conn_id == param->disconnect.conn_id) {
+                    slot = i;
+                    hid_hosts[i].in_use = false;
+                }
+            }
+            // Carry on with another host that is ready for reports.
+            bool was_active = slot >= 0 && slot == hid_active_host;
+            bool was_secured = was_active && hid_hosts[slot].secured;
+            int next = hid_host_first_secured();
+            portEXIT_CRITICAL(&hid_host_lock);
+            if (was_active) {
+                hid_host_activate(next);
+            }
+            if (next < 0) {
+                power_connected(false);
+                if (was_secured) {
+                    hid_link_lost_us = esp_timer_get_time();
+                }
+            }
+            reconnect_disconnected(param->disconnect.remote_bda);
+            hidd_wake_sender();
+            hid_dev_tx_get_stats(&stats);
+            ESP_LOGI(BLE_HID_LOG_NAME, "ESP_HIDD_EVENT_BLE_DISCONNECT, reports sent %u coalesced %u refused %u dropped %u",
+                     stats.sent, stats.coalesced, stats.refused, stats.dropped);
+            reconnect_start();
             break;
         }
         case ESP_HIDD_EVENT_BLE_VENDOR_REPORT_WRITE_EVT: {
-            ESP_LOGI(BLE_HID_LOG_NAME, "%s, ESP_HIDD_EVENT_BLE_VENDOR_REPORT_WRITE_EVT", __func__);
-            ESP_LOG_BUFFER_HEX(BLE_HID_LOG_NAME, param->vendor_write.data, param->vendor_write.length);
-        }    
+            // The data is gone once we return, keep the first 8 bytes in wire order.
+            uint32_t head[2] = {0};
+            memcpy(head, param->vendor_write.data,
+                   param->vendor_write.length < sizeof(head) ? param->vendor_write.length : sizeof(head));
+            DLOGI(BLE_HID_LOG_NAME, "ESP_HIDD_EVENT_BLE_VENDOR_REPORT_WRITE_EVT, %u bytes: %08x %08x",
+                  param->vendor_write.length, __builtin_bswap32(head[0]), __builtin_bswap32(head[1]));
+            break;
+        }
+        case ESP_HIDD_EVENT_BLE_CONGEST: {
+            if (!param->congest.congested) {
+                hidd_wake_sender();
+            }
+            break;
+        }
+        case ESP_HIDD_EVENT_BLE_PROTO_MODE: {
+            ESP_LOGI(BLE_HID_LOG_NAME, "conn_id %x %s protocol mode", param->proto_mode.conn_id,
+                     param->proto_mode.mode == HID_PROTOCOL_MODE_BOOT ? "boot" : "report");
+            // Keys held across the switch have to show up on the new route.
+            if (sec_conn && param->proto_mode.conn_id == hid_conn_id) {
+                hid_resync = true;
+                hidd_wake_sender();
+            }
+            break;
+        }
+        case ESP_HIDD_EVENT_BLE_LED_REPORT_WRITE: {
+            int64_t now = esp_timer_get_time();
+            bool active = false;
+            portENTER_CRITICAL(&hid_host_lock);
+            for (int i = 0; i < HID_MAX_APPS; i++) {
+                if (hid_hosts[i].in_use && hid_hosts[i].conn_id == param->led_write.conn_id) {
+                    hid_hosts[i].leds = param->led_write.leds;
+                    active = i == hid_active_host;
+                }
+            }
+            portEXIT_CRITICAL(&hid_host_lock);
+            // The others are shown when switched to.
+            if (active) {
+                kbd_leds_host(param->led_write.leds, now);
+            }
+            break;
+        }
+        case ESP_HIDD_EVENT_BLE_CCCD_WRITE: {
+            // Keys typed while reconnecting wait for the keyboard CCCD.
+            if (param->cccd_write.notify) {
+                hidd_wake_sender();
+            }
+            break;
+        }
         default:
             break;
     }
@@ -130,8 +357,10 @@ static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
     switch (event) {
-    case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
-        esp_ble_gap_start_advertising(&hidd_adv_params);
+    case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
+        if (param->adv_start_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+            boot_time_mark(BOOT_ADVERTISING);
+        }
         break;
      case ESP_GAP_BLE_SEC_REQ_EVT:
         for(int i = 0; i < ESP_BD_ADDR_LEN; i++) {
@@ -139,8 +368,7 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
         }
         esp_ble_gap_security_rsp(param->ble_security.ble_req.bd_addr, true);
 	 break;
-     case ESP_GAP_BLE_AUTH_CMPL_EVT:
-        sec_conn = true;
+     case ESP_GAP_BLE_AUTH_CMPL_EVT: {
         esp_bd_addr_t bd_addr;
         memcpy(bd_addr, param->ble_security.auth_cmpl.bd_addr, sizeof(esp_bd_addr_t));
         ESP_LOGI(BLE_HID_LOG_NAME, "remote BD_ADDR: %08x%04x",\
@@ -150,8 +378,55 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
         ESP_LOGI(BLE_HID_LOG_NAME, "pair status = %s",param->ble_security.auth_cmpl.success ? "success" : "fail");
         if(!param->ble_security.auth_cmpl.success) {
             ESP_LOGE(BLE_HID_LOG_NAME, "fail reason = 0x%x",param->ble_security.auth_cmpl.fail_reason);
+            break;
+        }
+        // Only the host with this address. Guessing another link could
+        // hand reports to a host that never finished pairing.
+        portENTER_CRITICAL(&hid_host_lock);
+        int slot = hid_host_find(bd_addr);
+        uint16_t conn_id = 0;
+        bool active = false;
+        if (slot >= 0) {
+            conn_id = hid_hosts[slot].conn_id;
+            hid_hosts[slot].secured = true;
+            active = hid_active_host < 0 || slot == hid_active_host;
+        }
+        portEXIT_CRITICAL(&hid_host_lock);
+        if (slot < 0) {
+            ESP_LOGW(BLE_HID_LOG_NAME, "paired with a host that is not connected");
+            break;
+        }
+        hid_dev_conn_bonded(conn_id, bd_addr);
+        if (active) {
+            // Keys held through a reconnect are only for the host that
+            // dropped, before sec_conn lets the sender replay them.
+            if (!reconnect_is_last_peer(bd_addr)) {
+                hid_keys_flush = true;
+            }
+            hid_host_activate(slot);
+            reconnect_save_peer(bd_addr, param->ble_security.auth_cmpl.addr_type);
+            hidd_wake_sender();
+        } else {
+            conn_params_park(bd_addr);
+        }
+        boot_time_mark(BOOT_SECURED);
+        power_connected(true);
+        break;
+    }
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
+        // Kept per host, loaded when it becomes the active one.
+        portENTER_CRITICAL(&hid_host_lock);
+        int slot = hid_host_find(param->update_conn_params.bda);
+        if (slot >= 0) {
+            hid_hosts[slot].interval_us = param->update_conn_params.conn_int * 1250;
+            if (slot == hid_active_host) {
+                hid_conn_interval_us = hid_hosts[slot].interval_us;
+            }
         }
+        portEXIT_CRITICAL(&hid_host_lock);
+        conn_params_updated(param);
         break;
+    }
     default:
         break;
     }
@@ -7,37 +7,247 @@
 #include "ble_hidd.c"
 
 #include "freertos/queue.h"
+#include "esp_timer.h"
+#include "key_capture.h"
+#include "kbd_report.h"
+#include "key_text.h"
+#include "key_matrix.h"
+#include "key_ring.h"
+#include "key_trace.h"
+#include "hid_bench.h"
+#include "dlog.h"
+#include "mouse_accum.h"
+#include "lighting.h"
 
 #define LED_GPIO 32
 #define BUTTON_GPIO 5
+#define BUTTON_DEBOUNCE_MS 10
 
 static bool led_state = false;
-typedef struct {	bool down;
-	                uint8_t key;} key_press;
-static QueueHandle_t key_buffer;
+
+// One ring per producer: the button loop in app_main and the matrix scan timer.
+static key_ring_t button_keys;
+static key_ring_t matrix_keys;
 
 #define ifwhile(COND) if(COND)while(COND)
 
-void bluetooth_task(void *pvParameters){
+enum { TEXT_HELLO, TEXT_CLEAR };
+static const char *const text_macros[] = {
+	[TEXT_HELLO] = "Hello, world!\n",
+	[TEXT_CLEAR] = "\b\b\b\b\b\b\b\b\b\b\b\b\b\b",
+};
+
+static void push_key(key_ring_t *ring, int64_t time_us, uint8_t key, uint8_t flags){
+	key_event_t ev={.time_us=time_us,.key=key,.flags=flags};
+	key_ring_push(ring,&ev);
+	conn_params_activity();
+	power_input();
+	if(hid_sender_task)xTaskNotifyGive(hid_sender_task);
+}
+
+static void matrix_key_event(uint8_t key, bool down){
+	push_key(&matrix_keys,esp_timer_get_time(),key,down?KEY_EVENT_DOWN:0);
+	// After the report path has its event.
+	lighting_key(key,down);
+}
+
+// Mouse motion is merged here and reported at most once per connection
+// event, all reports go out from the esp_timer task so they stay in order.
+static mouse_accum_t mouse;
+static portMUX_TYPE mouse_lock=portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t mouse_timer;
+static bool mouse_armed;
+
+static void mouse_flush(void *arg){
+	mouse_state_t s;
+	bool any=false, more;
+	// A relative report must not replace one still waiting for the link,
+	// keep accumulating until the next connection event instead.
+	bool on=sec_conn && esp_hidd_mouse_enabled(hid_conn_id);
+	bool busy=on && esp_hidd_mouse_pending(hid_conn_id);
+	portENTER_CRITICAL(&mouse_lock);
+	// Motion nobody subscribed to is dropped rather than built.
+	if(!on)mouse_accum_init(&mouse);
+	else if(!busy)any=mouse_accum_take(&mouse,&s);
+	mouse_armed=more=mouse_accum_pending(&mouse);
+	portEXIT_CRITICAL(&mouse_lock);
+	if(any)esp_hidd_send_mouse_value(hid_conn_id,s.buttons,s.axis[MOUSE_X],s.axis[MOUSE_Y],s.axis[MOUSE_WHEEL],s.axis[MOUSE_PAN]);
+	if(more)esp_timer_start_once(mouse_timer,hid_conn_interval_us);
+}
+
+// Entry points for a pointing device, motion is in 1/256 counts.
+void mouse_move(int32_t dx, int32_t dy, int32_t wheel, int32_t pan){
+	const int32_t delta[MOUSE_AXES]={dx,dy,wheel,pan};
+	bool arm;
+	conn_params_activity();
+	power_input();
+	portENTER_CRITICAL(&mouse_lock);
+	mouse_accum_move(&mouse,delta);
+	arm=!mouse_armed && mouse_accum_pending(&mouse);
+	mouse_armed|=arm;
+	portEXIT_CRITICAL(&mouse_lock);
+	if(arm)esp_timer_start_once(mouse_timer,hid_conn_interval_us);
+}
+
+void mouse_set_buttons(uint8_t buttons){
+	bool changed;
+	conn_params_activity();
+	power_input();
+	portENTER_CRITICAL(&mouse_lock);
+	if((changed=mouse_accum_buttons(&mouse,buttons)))mouse_armed=true;
+	portEXIT_CRITICAL(&mouse_lock);
+	// Clicks skip the wait for the next connection event.
+	if(changed){
+		esp_timer_stop(mouse_timer);
+		esp_timer_start_once(mouse_timer,0);
+	}
+}
+
+_Static_assert(KBD_NKRO_BYTES==HID_NKRO_IN_RPT_LEN,"kbd_state_t bits are sent as the NKRO report");
+
+// Hosts that take the NKRO report get the bitmap, the rest the six key
+// array. Only one of the two carries keys at a time.
+static const kbd_state_t kbd_released;
+static bool kbd_nkro, kbd_held;
+
+static esp_err_t send_keyboard_state(uint16_t conn_id, const kbd_state_t *state, bool nkro){
+	if(nkro)return esp_hidd_send_nkro_value(conn_id, state->bits);
+	return esp_hidd_send_keyboard_value(conn_id, state->mods, state->keys, state->num_keys);
+}
+
+static void send_keyboard_report(const kbd_state_t *state){
+	KEY_TRACE_REPORT();
+	bool nkro=sec_conn && esp_hidd_nkro_enabled(hid_conn_id);
+	// The host switched reports (MTU exchange, subscription, boot mode),
+	// let go of what the old one still holds.
+	if(nkro!=kbd_nkro){
+		if(sec_conn && kbd_held)send_keyboard_state(hid_conn_id, &kbd_released, kbd_nkro);
+		kbd_nkro=nkro;
+	}
+	// A full queue means the link is congested or the stack is refusing
+	// reports, wait for it to drain rather than lose the report. Refusals
+	// bring no event, so every connection interval the send tries again.
+	while(sec_conn && send_keyboard_state(hid_conn_id, state, nkro)==ESP_ERR_NO_MEM)
+		ulTaskNotifyTake(pdTRUE,pdMS_TO_TICKS(hid_conn_interval_us/1000)+1);
+	kbd_held=state->mods || state->num_keys;
+	power_report_sent();
+	reconnect_report_sent();
+	boot_time_mark(BOOT_FIRST_REPORT);
+}
+
+// Left Ctrl + Left Shift + F1..F3 picks the host reports go to. The F key
+// itself never reaches a host.
+#define HOST_SWITCH_MODS (LEFT_CONTROL_KEY_MASK|LEFT_SHIFT_KEY_MASK)
+
+static bool switch_host(kbd_report_t *report, uint8_t key){
+	if((report->cur.mods&HOST_SWITCH_MODS)!=HOST_SWITCH_MODS)return false;
+	if(key<HID_KEY_F1 || key>=HID_KEY_F1+HID_MAX_APPS)return false;
+	uint16_t old=hid_conn_id;
+	bool was=sec_conn;
+	if(hid_host_select(key-HID_KEY_F1)){
+		// Let go of everything on the host left behind and tell the new
+		// one which keys are still held.
+		if(was)send_keyboard_state(old, &kbd_released, kbd_nkro);
+		kbd_report_resync(report);
+	}
+	return true;
+}
+
+// Keys typed without a host are replayed to it if it is back within its
+// directed and whitelist advertising. Past that, or to any other host,
+// they could be a password typed long ago and go nowhere.
+#define KEY_REPLAY_MS (RECONNECT_DIRECTED_MS+RECONNECT_WHITELIST_MS)
+
+// Wait for a secured host taking keyboard reports, the gap/hidd callbacks
+// wake us. Returns false when what is held has to be dropped instead.
+static bool wait_for_host(void){
+	while(!hid_keys_flush){
+		if(sec_conn && esp_hidd_keyboard_enabled(hid_conn_id))return true;
+		int64_t left_ms=(hid_link_lost_us-esp_timer_get_time())/1000+KEY_REPLAY_MS;
+		if(left_ms<=0)break;
+		ulTaskNotifyTake(pdTRUE,pdMS_TO_TICKS(left_ms)+1);
+	}
+	return false;
+}
+
+// Feed everything pending in one ring into the report builder.
+static void drain_keys(kbd_report_t *report, key_ring_t *ring, uint32_t *overflows){
 	#define LOG_NAME "ble_key_buffer_reader"
-	vTaskDelay(1000 / portTICK_PERIOD_MS);
-	key_press key_value;
-	while(1) {
-		vTaskDelay(100 / portTICK_PERIOD_MS);
-		ifwhile(uxQueueMessagesWaiting(key_buffer)){
-			ESP_LOGI(LOG_NAME, "Send the letter");
-			xQueueReceive(key_buffer,&key_value,0/*no wait*/);
-			esp_hidd_send_keyboard_value(hid_conn_id, 0, &key_value.key, key_value.down);
-			vTaskDelay(10/portTICK_PERIOD_MS); // for interupts
-		}else{
-			ESP_LOGI(LOG_NAME, "No Letters, sleeping for a while");
-			vTaskDelay(1000/portTICK_PERIOD_MS);
-			// TODO: Go into low power sleep for the keys to wake up from.
+	key_event_t ev[16];
+	size_t n;
+	uint32_t stale=0;
+	while((n=key_ring_pop(ring,ev,sizeof(ev)/sizeof(ev[0])))){
+		for(size_t i=0;i<n;i++){
+			if(!wait_for_host()){
+				stale+=n-i;
+				break;
+			}
+			DLOGI(LOG_NAME, "Send the letter 0x%02x", ev[i].key);
+			KEY_TRACE_EVENT(ev[i].time_us);
+			if(ev[i].flags&KEY_EVENT_TEXT)
+				key_text_type(report, key_text_layout_us, text_macros[ev[i].key]);
+			else if((ev[i].flags&KEY_EVENT_DOWN) && switch_host(report, ev[i].key))
+				continue;
+			else if(!kbd_report_apply(report, ev[i].key, ev[i].flags&KEY_EVENT_DOWN) && !kbd_nkro)
+				ESP_LOGW(LOG_NAME, "More than %d keys down, 0x%02x waits for a free slot", KBD_REPORT_KEYS, ev[i].key);
 		}
 	}
+	if(stale){
+		// Releases went with them, start over from nothing pressed. A host
+		// sees a fresh keyboard on every connection anyway.
+		kbd_report_init(report, report->send);
+		ESP_LOGW(LOG_NAME, "%u keys typed without a host dropped", stale);
+	}
+	uint32_t dropped=key_ring_overflows(ring);
+	if(dropped!=*overflows){
+		ESP_LOGW(LOG_NAME, "Key ring overflowed, %u events lost", dropped-*overflows);
+		*overflows=dropped;
+	}
 	#undef LOG_NAME
 }
 
+// Sized for the deepest send path, a report going out through
+// esp_ble_gatts_send_indicate. Debug builds log the headroom left.
+#define HID_TASK_STACK 4096
+
+void bluetooth_task(void *pvParameters){
+	UBaseType_t stack_free=HID_TASK_STACK;
+	kbd_report_t report;
+	kbd_report_init(&report, send_keyboard_report);
+	uint32_t button_overflows=0, matrix_overflows=0;
+	// Benchmark builds measure the report paths once the first host is up,
+	// before any key is taken.
+	if(HID_BENCH_ENABLED){
+		ESP_LOGI("hid_bench","waiting for a host");
+		while(!sec_conn || !esp_hidd_keyboard_enabled(hid_conn_id) || !esp_hidd_mouse_enabled(hid_conn_id))
+			ulTaskNotifyTake(pdTRUE,portMAX_DELAY);
+		HID_BENCH_RUN(hid_conn_id);
+	}
+	while(1) {
+		// Sleep until a producer pushes the first key of a burst.
+		while(key_ring_empty(&button_keys) && key_ring_empty(&matrix_keys) && !hid_resync)
+			ulTaskNotifyTake(pdTRUE,portMAX_DELAY);
+		drain_keys(&report, &matrix_keys, &matrix_overflows);
+		drain_keys(&report, &button_keys, &button_overflows);
+		hid_keys_flush=false;
+		if(hid_resync){
+			hid_resync=false;
+			if(sec_conn && esp_hidd_keyboard_enabled(hid_conn_id))kbd_report_resync(&report);
+		}
+		// One report for whatever the burst left pressed.
+		kbd_report_flush(&report);
+		if(LOG_LOCAL_LEVEL>=ESP_LOG_DEBUG){
+			UBaseType_t left=uxTaskGetStackHighWaterMark(NULL);
+			if(left<stack_free){
+				stack_free=left;
+				ESP_LOGD(BLE_HID_LOG_NAME, "hid_task stack: %u of %u bytes never used", left, HID_TASK_STACK);
+			}
+		}
+		// Blocking above lets the idle task light sleep, deep sleep is up
+		// to the power manager.
+	}
+}
+
 void setup_ble_hidd(){
 	esp_err_t ret;
 
@@ -48,6 +258,14 @@ void setup_ble_hidd(){
 		ret = nvs_flash_init();
 	}
 	ESP_ERROR_CHECK( ret );
+
+	// Hosts may connect as soon as advertising starts, before the HID
+	// table is in the stack.
+	if((ret = hid_dev_init()) != ESP_OK) {
+		ESP_LOGE(BLE_HID_LOG_NAME, "%s init hid device failed\n", __func__);
+		return;
+	}
+	hid_dev_tx_on_space(hidd_tx_space);
     
 	ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
     
@@ -63,6 +281,7 @@ void setup_ble_hidd(){
 		ESP_LOGE(BLE_HID_LOG_NAME, "%s enable controller failed\n", __func__);
 		return;
 	}
+	boot_time_mark(BOOT_BT_CONTROLLER);
     
 	ret = esp_bluedroid_init();
 	if (ret) {
@@ -75,11 +294,20 @@ void setup_ble_hidd(){
 		ESP_LOGE(BLE_HID_LOG_NAME, "%s init bluedroid failed\n", __func__);
 		return;
 	}
+	boot_time_mark(BOOT_BT_HOST);
     
 	if((ret = esp_hidd_profile_init()) != ESP_OK) {
 		ESP_LOGE(BLE_HID_LOG_NAME, "%s init bluedroid failed\n", __func__);
 	}
 
+	if((ret = conn_params_init()) != ESP_OK) {
+		ESP_LOGE(BLE_HID_LOG_NAME, "%s init connection parameters failed\n", __func__);
+	}
+
+	if((ret = reconnect_init(&hidd_adv_params)) != ESP_OK) {
+		ESP_LOGE(BLE_HID_LOG_NAME, "%s init reconnect failed\n", __func__);
+	}
+
 	///register the callback function to the gap module
 	esp_ble_gap_register_callback(gap_event_handler);
 	esp_hidd_register_callbacks(hidd_event_callback);
@@ -100,130 +328,78 @@ void setup_ble_hidd(){
 	esp_ble_gap_set_security_param(ESP_BLE_SM_SET_INIT_KEY, &init_key, sizeof(uint8_t));
 	esp_ble_gap_set_security_param(ESP_BLE_SM_SET_RSP_KEY, &rsp_key, sizeof(uint8_t));
 
-	xTaskCreate(&bluetooth_task, "hid_task", 2048, NULL, 5, NULL);
+	xTaskCreate(&bluetooth_task, "hid_task", HID_TASK_STACK, NULL, 5, &hid_sender_task);
+}
+
+// Bluetooth bring-up is the long pole of startup and mostly waits on the
+// controller and Bluedroid tasks, app_main sets up the rest meanwhile.
+static void ble_setup_task(void *pvParameters){
+	setup_ble_hidd();
+	vTaskDelete(NULL);
 }
 
 void app_main(void){
-	/* Configure the IOMUX register for pad LED_GPIO (some pads are
+	boot_time_mark(BOOT_APP_MAIN);
+	ESP_ERROR_CHECK(dlog_start());
+	// Host callbacks drive the LEDs and the power manager, both are ready
+	// before Bluetooth starts.
+	ESP_ERROR_CHECK(kbd_leds_init(LED_GPIO));
+	ESP_ERROR_CHECK(power_init());
+
+	// Start bluetooth worker. Pinned with the controller and Bluedroid,
+	// above us so it goes on as soon as they hand back.
+	xTaskCreatePinnedToCore(&ble_setup_task, "ble_setup", 4096, NULL, 6, NULL, CONFIG_BTDM_CTRL_PINNED_TO_CORE);
+
+	/* Configure the IOMUX register for pad BUTTON_GPIO (some pads are
 	   muxed to GPIO on reset already, but some default to other
 	   functions and need to be switched to GPIO. Consult the
 	   Technical Reference for a list of pads and their default
 	   functions.)
 	*/
-	gpio_pad_select_gpio(LED_GPIO);
 	gpio_pad_select_gpio(BUTTON_GPIO);
-	gpio_set_direction(LED_GPIO, GPIO_MODE_OUTPUT);
 	gpio_set_direction(BUTTON_GPIO, GPIO_MODE_INPUT);
 
 
 	// Setup global state.
-	key_buffer = xQueueCreate(1<<7,sizeof(key_press));
-
-	// Start bluetooth worker.
-	setup_ble_hidd();
-
-	// Main loop
+	QueueHandle_t key_edges = key_capture_init(1<<4);
+	ESP_ERROR_CHECK(key_capture_add(BUTTON_GPIO));
+	ESP_ERROR_CHECK(lighting_start());
+	ESP_ERROR_CHECK(key_matrix_start(matrix_key_event));
+	mouse_accum_init(&mouse);
+	const esp_timer_create_args_t mouse_timer_args={.callback=mouse_flush,.name="mouse"};
+	ESP_ERROR_CHECK(esp_timer_create(&mouse_timer_args,&mouse_timer));
+	boot_time_mark(BOOT_PERIPHERALS);
+	KEY_TRACE_START_CONSOLE();
+
+	// Main loop, sleeps until the button ISR hands over an edge.
 	bool pressed=false;
-	gpio_set_level(LED_GPIO, led_state);
+	kbd_leds_local(led_state);
 	bool toggel=false;
+	key_edge_t edge;
+	TickType_t wait=portMAX_DELAY;
 	while(1) {
-		pressed=!gpio_get_level(BUTTON_GPIO);
+		if(xQueueReceive(key_edges,&edge,wait)){
+			// Edges inside the debounce window are contact bounce.
+			if(wait!=portMAX_DELAY)continue;
+			wait=pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS)?:1;
+		}else{
+			// Window closed, pick up a level change the bounce hid from us.
+			edge.time_us=esp_timer_get_time();
+			edge.level=gpio_get_level(BUTTON_GPIO);
+			wait=portMAX_DELAY;
+		}
+		pressed=!edge.level;
 		if(led_state!=pressed){
-			printf("Turning %s the LED\n",pressed?"on":"off");
-			gpio_set_level(LED_GPIO, (led_state=pressed));
-
-			key_press k;
+			DLOGI("button","Turning %s the LED (edge at %u us)",(uintptr_t)(pressed?"on":"off"),(uint32_t)edge.time_us);
+			kbd_leds_local((led_state=pressed));
 
 			if(pressed)if((toggel=!toggel)){
-				printf("Sending \"Hello, world!\"");
-
-				k.key=HID_KEY_RIGHT_SHIFT;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_H;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_H;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_RIGHT_SHIFT;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_E;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_E;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_L;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_L;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_L;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_L;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_O;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_O;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_COMMA;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_COMMA;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_SPACEBAR;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_SPACEBAR;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_W;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_W;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_O;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_O;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_R;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_R;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_L;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_L;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_D;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_D;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_LEFT_SHIFT;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_1;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_1;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_LEFT_SHIFT;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-
-				k.key=HID_KEY_RETURN;k.down=true;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				k.key=HID_KEY_RETURN;k.down=false;
-				xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
+				DLOGI("button","Sending \"Hello, world!\"");
+				push_key(&button_keys,edge.time_us,TEXT_HELLO,KEY_EVENT_TEXT);
 			}else{
-				printf("Clearing \"Hello, world!\"");
-				for(int i=0;i<14;i++){
-					k.key=HID_KEY_DELETE;k.down=true;
-					xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-					k.key=HID_KEY_DELETE;k.down=false;
-					xQueueSendToBackFromISR(key_buffer,&k,pdFALSE);
-				}
+				DLOGI("button","Clearing \"Hello, world!\"");
+				push_key(&button_keys,edge.time_us,TEXT_CLEAR,KEY_EVENT_TEXT);
 			}
 		}
-		vTaskDelay(10 / portTICK_PERIOD_MS);
 	}
 }
@@ -0,0 +1,53 @@
+#include "boot_time.h"
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define LOG_NAME "boot"
+
+static const char *const mark_names[BOOT_MARKS]={
+	[BOOT_APP_MAIN]="app_main",
+	[BOOT_PERIPHERALS]="peripherals",
+	[BOOT_BT_CONTROLLER]="bt controller",
+	[BOOT_BT_HOST]="bt host",
+	[BOOT_HID_DB]="hid db",
+	[BOOT_ADVERTISING]="advertising",
+	[BOOT_CONNECTED]="connected",
+	[BOOT_SECURED]="secured",
+	[BOOT_FIRST_REPORT]="first report",
+};
+
+static uint32_t marks[BOOT_MARKS];
+static portMUX_TYPE lock=portMUX_INITIALIZER_UNLOCKED;
+
+static const char *boot_time_cause(void){
+	return esp_reset_reason()==ESP_RST_DEEPSLEEP?"deep sleep wake":"reset";
+}
+
+void boot_time_mark(boot_mark_t mark){
+	// A mark at 0 ms still has to read as reached.
+	uint32_t now=(esp_timer_get_time()/1000)?:1;
+	bool first;
+	portENTER_CRITICAL(&lock);
+	if((first=!marks[mark]))marks[mark]=now;
+	portEXIT_CRITICAL(&lock);
+	if(!first)return;
+	ESP_LOGD(LOG_NAME,"%s at %u ms",mark_names[mark],now);
+
+	uint32_t m[BOOT_MARKS];
+	boot_time_get(m);
+	if(mark==BOOT_ADVERTISING)
+		ESP_LOGI(LOG_NAME,"advertising %u ms after %s (peripherals %u, bt controller %u, bt host %u, hid db %u)",
+			now,boot_time_cause(),m[BOOT_PERIPHERALS],m[BOOT_BT_CONTROLLER],m[BOOT_BT_HOST],m[BOOT_HID_DB]);
+	else if(mark==BOOT_FIRST_REPORT)
+		ESP_LOGI(LOG_NAME,"first report %u ms after %s (advertising %u, connected %u, secured %u)",
+			now,boot_time_cause(),m[BOOT_ADVERTISING],m[BOOT_CONNECTED],m[BOOT_SECURED]);
+}
+
+void boot_time_get(uint32_t out_ms[BOOT_MARKS]){
+	portENTER_CRITICAL(&lock);
+	for(int i=0;i<BOOT_MARKS;i++)out_ms[i]=marks[i];
+	portEXIT_CRITICAL(&lock);
+}
@@ -0,0 +1,29 @@
+#ifndef BOOT_TIME_H__
+#define BOOT_TIME_H__
+
+#include <stdint.h>
+
+// Startup milestones, in the order they usually happen. Bluetooth and the
+// local peripherals come up side by side, so the middle ones may swap.
+typedef enum {
+	BOOT_APP_MAIN,      // app_main entered
+	BOOT_PERIPHERALS,   // LEDs, keys, lighting and the matrix scan running
+	BOOT_BT_CONTROLLER, // controller enabled, PHY calibrated
+	BOOT_BT_HOST,       // Bluedroid enabled
+	BOOT_HID_DB,        // HID service table created
+	BOOT_ADVERTISING,   // first advertising started
+	BOOT_CONNECTED,     // first host connected
+	BOOT_SECURED,       // first host encrypted
+	BOOT_FIRST_REPORT,  // first key report went to the stack
+	BOOT_MARKS
+} boot_mark_t;
+
+// Record a milestone, only the first time it is reached counts. Safe from
+// any task. Advertising and the first report log a summary.
+void boot_time_mark(boot_mark_t mark);
+
+// Milliseconds from app start to each milestone, 0 until reached. esp_timer
+// starts with the app, ROM and bootloader time is not included.
+void boot_time_get(uint32_t out_ms[BOOT_MARKS]);
+
+#endif /* BOOT_TIME_H__ */
@@ -0,0 +1,178 @@
+#include "conn_params.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define LOG_NAME "conn_params"
+
+// Typing: the shortest interval and no slave latency, so a report goes out
+// on the next connection event. Tried in order while the central rejects
+// them, the later ones stay inside the Apple accessory guidelines.
+static const conn_params_t fast_params[]={
+	{ 6, 12,0,400}, // 7.5-15 ms
+	{ 9, 24,0,400}, // 11.25-30 ms
+	{12, 36,0,400}, // 15-45 ms
+};
+#define FAST_PARAMS (sizeof(fast_params)/sizeof(fast_params[0]))
+// Idle: 60-75 ms and the slave may skip 4 events, about 375 ms between
+// radio wakeups. A key press still gets out on the next event we attend.
+static const conn_params_t idle_params={48,60,4,600};
+
+enum { CONN_PARAMS_OFF, CONN_PARAMS_FAST, CONN_PARAMS_IDLE };
+
+static portMUX_TYPE lock=portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t idle_timer, retry_timer;
+static esp_bd_addr_t peer;
+static uint8_t want=CONN_PARAMS_OFF;
+static uint8_t fast_step;
+static uint8_t retries;
+static bool in_flight;
+static const conn_params_t *requested; // set while a request is out
+static volatile int64_t last_activity;
+
+static const conn_params_t *conn_params_wanted(void){
+	return want==CONN_PARAMS_FAST?&fast_params[fast_step]:&idle_params;
+}
+
+// Ask for the wanted parameters unless a request is already out, the
+// update event then decides whether another one is needed.
+static void conn_params_request(void){
+	esp_ble_conn_update_params_t req;
+	portENTER_CRITICAL(&lock);
+	bool send=want!=CONN_PARAMS_OFF && !in_flight;
+	if(send){
+		const conn_params_t *p=requested=conn_params_wanted();
+		memcpy(req.bda,peer,sizeof(esp_bd_addr_t));
+		req.min_int=p->min_int;
+		req.max_int=p->max_int;
+		req.latency=p->latency;
+		req.timeout=p->timeout;
+		in_flight=true;
+	}
+	portEXIT_CRITICAL(&lock);
+	if(!send)return;
+	ESP_LOGI(LOG_NAME,"request interval %u-%u latency %u",req.min_int,req.max_int,req.latency);
+	if(esp_ble_gap_update_conn_params(&req)!=ESP_OK){
+		portENTER_CRITICAL(&lock);
+		in_flight=false;
+		portEXIT_CRITICAL(&lock);
+		esp_timer_start_once(retry_timer,CONN_PARAMS_RETRY_MS*1000);
+	}
+}
+
+static void conn_params_idle_check(void *arg){
+	int64_t idle=esp_timer_get_time()-last_activity;
+	if(idle<CONN_PARAMS_IDLE_MS*1000){
+		esp_timer_start_once(idle_timer,CONN_PARAMS_IDLE_MS*1000-idle);
+		return;
+	}
+	portENTER_CRITICAL(&lock);
+	bool go=want==CONN_PARAMS_FAST;
+	if(go){
+		want=CONN_PARAMS_IDLE;
+		retries=0;
+	}
+	portEXIT_CRITICAL(&lock);
+	if(go)conn_params_request();
+}
+
+static void conn_params_retry(void *arg){
+	conn_params_request();
+}
+
+esp_err_t conn_params_init(void){
+	const esp_timer_create_args_t idle_args={.callback=conn_params_idle_check,.name="conn_idle"};
+	const esp_timer_create_args_t retry_args={.callback=conn_params_retry,.name="conn_retry"};
+	esp_err_t err=esp_timer_create(&idle_args,&idle_timer);
+	if(err==ESP_OK)err=esp_timer_create(&retry_args,&retry_timer);
+	return err;
+}
+
+void conn_params_start(const esp_bd_addr_t bda){
+	portENTER_CRITICAL(&lock);
+	memcpy(peer,bda,sizeof(esp_bd_addr_t));
+	want=CONN_PARAMS_FAST;
+	fast_step=0;
+	retries=0;
+	in_flight=false;
+	portEXIT_CRITICAL(&lock);
+	last_activity=esp_timer_get_time();
+	esp_timer_stop(idle_timer);
+	esp_timer_start_once(idle_timer,CONN_PARAMS_IDLE_MS*1000);
+	conn_params_request();
+}
+
+void conn_params_stop(void){
+	portENTER_CRITICAL(&lock);
+	want=CONN_PARAMS_OFF;
+	in_flight=false;
+	portEXIT_CRITICAL(&lock);
+	esp_timer_stop(idle_timer);
+	esp_timer_stop(retry_timer);
+}
+
+void conn_params_park(const esp_bd_addr_t bda){
+	esp_ble_conn_update_params_t req={
+		.min_int=idle_params.min_int,
+		.max_int=idle_params.max_int,
+		.latency=idle_params.latency,
+		.timeout=idle_params.timeout,
+	};
+	memcpy(req.bda,bda,sizeof(esp_bd_addr_t));
+	ESP_LOGI(LOG_NAME,"park interval %u-%u latency %u",req.min_int,req.max_int,req.latency);
+	esp_ble_gap_update_conn_params(&req);
+}
+
+void conn_params_activity(void){
+	last_activity=esp_timer_get_time();
+	if(want!=CONN_PARAMS_IDLE)return;
+	portENTER_CRITICAL(&lock);
+	bool go=want==CONN_PARAMS_IDLE;
+	if(go){
+		want=CONN_PARAMS_FAST;
+		retries=0;
+	}
+	portEXIT_CRITICAL(&lock);
+	if(!go)return;
+	esp_timer_stop(idle_timer);
+	esp_timer_start_once(idle_timer,CONN_PARAMS_IDLE_MS*1000);
+	conn_params_request();
+}
+
+void conn_params_updated(const esp_ble_gap_cb_param_t *param){
+	ESP_LOGI(LOG_NAME,"status %d interval %u (%u.%02u ms) latency %u timeout %u ms",
+		param->update_conn_params.status,param->update_conn_params.conn_int,
+		param->update_conn_params.conn_int*125/100,param->update_conn_params.conn_int*125%100,
+		param->update_conn_params.latency,param->update_conn_params.timeout*10);
+
+	bool again=false, later=false;
+	portENTER_CRITICAL(&lock);
+	if(want==CONN_PARAMS_OFF || memcmp(param->update_conn_params.bda,peer,sizeof(esp_bd_addr_t))){
+		// A parked link, or the managed one is gone.
+		portEXIT_CRITICAL(&lock);
+		return;
+	}
+	const conn_params_t *sent=in_flight?requested:NULL;
+	in_flight=false;
+	const conn_params_t *p=conn_params_wanted();
+	bool ok=param->update_conn_params.status==ESP_BT_STATUS_SUCCESS &&
+		param->update_conn_params.conn_int>=p->min_int &&
+		param->update_conn_params.conn_int<=p->max_int &&
+		param->update_conn_params.latency==p->latency;
+	if(ok){
+		retries=0;
+	}else if(sent && sent!=p){
+		// The answer to an older request, the wanted set changed since.
+		again=true;
+	}else if(retries<CONN_PARAMS_MAX_RETRIES){
+		// Rejected or overridden by the central, back off and, while
+		// typing, try a less aggressive set.
+		retries++;
+		if(want==CONN_PARAMS_FAST && fast_step<FAST_PARAMS-1)fast_step++;
+		later=true;
+	}
+	portEXIT_CRITICAL(&lock);
+	if(again)conn_params_request();
+	if(later)esp_timer_start_once(retry_timer,CONN_PARAMS_RETRY_MS*1000);
+}
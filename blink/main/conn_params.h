@@ -0,0 +1,40 @@
+#ifndef CONN_PARAMS_H__
+#define CONN_PARAMS_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+
+// Without input for this long the link drops to the idle parameters.
+#define CONN_PARAMS_IDLE_MS 3000
+// Wait before asking again after the central rejected or overrode a request.
+#define CONN_PARAMS_RETRY_MS 5000
+#define CONN_PARAMS_MAX_RETRIES 3
+
+// One parameter set, intervals in 1.25 ms units and timeout in 10 ms units.
+typedef struct {
+	uint16_t min_int;
+	uint16_t max_int;
+	uint16_t latency;
+	uint16_t timeout;
+} conn_params_t;
+
+esp_err_t conn_params_init(void);
+
+// Start managing the link reports go to, only one link is managed at a
+// time. Call after ESP_GAP_BLE_AUTH_CMPL_EVT, some centrals (iOS) refuse
+// parameter updates while encryption is being set up.
+void conn_params_start(const esp_bd_addr_t bda);
+void conn_params_stop(void);
+
+// Ask once for the idle parameters on a link that is not managed, a host
+// that stays connected without getting reports.
+void conn_params_park(const esp_bd_addr_t bda);
+
+// Input activity, switches back to the fast parameters if the link idled.
+void conn_params_activity(void);
+
+// Feed ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, updates on other links are ignored.
+void conn_params_updated(const esp_ble_gap_cb_param_t *param);
+
+#endif /* CONN_PARAMS_H__ */
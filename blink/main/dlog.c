@@ -0,0 +1,106 @@
+#include "dlog.h"
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define LOG_NAME "dlog"
+
+typedef struct {
+	const dlog_fmt_t *fmt;
+	uint32_t time_ms;
+	uint32_t args[DLOG_MAX_ARGS];
+} dlog_rec_t;
+
+// One ring per core. Everyone writing to a ring runs on its core, so
+// masking interrupts there orders tasks and ISRs without a lock shared
+// with the other core. dlog_task is the only reader, head and tail work
+// as in key_ring.
+typedef struct {
+	_Atomic uint32_t head;
+	_Atomic uint32_t tail;
+	_Atomic uint32_t dropped;
+	dlog_rec_t buf[DLOG_RING_SIZE];
+} dlog_ring_t;
+
+static dlog_ring_t rings[portNUM_PROCESSORS];
+static TaskHandle_t task;
+
+void dlog_write(const dlog_fmt_t *fmt, const uint32_t args[DLOG_MAX_ARGS]){
+	uint32_t time_ms=esp_log_timestamp();
+	unsigned irq=portSET_INTERRUPT_MASK_FROM_ISR();
+	dlog_ring_t *ring=&rings[xPortGetCoreID()];
+	uint32_t head=atomic_load_explicit(&ring->head,memory_order_relaxed);
+	uint32_t tail=atomic_load_explicit(&ring->tail,memory_order_acquire);
+	bool wake=false;
+	if(head-tail==DLOG_RING_SIZE){
+		atomic_fetch_add_explicit(&ring->dropped,1,memory_order_relaxed);
+	}else{
+		dlog_rec_t *rec=&ring->buf[head&(DLOG_RING_SIZE-1)];
+		rec->fmt=fmt;
+		rec->time_ms=time_ms;
+		memcpy(rec->args,args,sizeof(rec->args));
+		atomic_store_explicit(&ring->head,head+1,memory_order_seq_cst);
+		// The formatter empties every ring before it sleeps, only the first
+		// record of a burst has to wake it. Decided on the tail read after
+		// publishing: the one read before may be from before the formatter
+		// took the last record, and it would then sleep with this one
+		// pending. Both sides store, then load the other index seq_cst, so
+		// at least one of them sees the other's store.
+		wake=head+1-atomic_load_explicit(&ring->tail,memory_order_seq_cst)==1;
+	}
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+	if(!wake || !task)return;
+	if(xPortInIsrContext())vTaskNotifyGiveFromISR(task,NULL);
+	else xTaskNotifyGive(task);
+}
+
+// Ring with the oldest pending record, so lines from both cores come out
+// in time order. NULL once all are empty.
+static dlog_ring_t *dlog_oldest(void){
+	dlog_ring_t *oldest=NULL;
+	uint32_t oldest_ms=0;
+	for(int i=0;i<portNUM_PROCESSORS;i++){
+		dlog_ring_t *ring=&rings[i];
+		uint32_t tail=atomic_load_explicit(&ring->tail,memory_order_relaxed);
+		if(atomic_load_explicit(&ring->head,memory_order_seq_cst)==tail)continue;
+		uint32_t ms=ring->buf[tail&(DLOG_RING_SIZE-1)].time_ms;
+		if(!oldest || (int32_t)(ms-oldest_ms)<0){
+			oldest=ring;
+			oldest_ms=ms;
+		}
+	}
+	return oldest;
+}
+
+static void dlog_task(void *arg){
+	uint32_t reported[portNUM_PROCESSORS]={0};
+	while(1){
+		dlog_ring_t *ring;
+		while((ring=dlog_oldest())){
+			uint32_t tail=atomic_load_explicit(&ring->tail,memory_order_relaxed);
+			dlog_rec_t rec=ring->buf[tail&(DLOG_RING_SIZE-1)];
+			atomic_store_explicit(&ring->tail,tail+1,memory_order_seq_cst);
+			const uint32_t *a=rec.args;
+			// The runtime level set with esp_log_level_set applies here.
+			esp_log_write(rec.fmt->level,rec.fmt->tag,rec.fmt->fmt,rec.time_ms,rec.fmt->tag,
+				a[0],a[1],a[2],a[3],a[4],a[5],a[6],a[7]);
+		}
+		for(int i=0;i<portNUM_PROCESSORS;i++){
+			uint32_t dropped=atomic_load_explicit(&rings[i].dropped,memory_order_relaxed);
+			if(dropped!=reported[i]){
+				ESP_LOGW(LOG_NAME,"core %d ring overflowed, %u records lost",i,dropped-reported[i]);
+				reported[i]=dropped;
+			}
+		}
+		ulTaskNotifyTake(pdTRUE,portMAX_DELAY);
+	}
+}
+
+esp_err_t dlog_start(void){
+	if(xTaskCreate(dlog_task,"dlog",3072,NULL,tskIDLE_PRIORITY+1,&task)!=pdPASS)return ESP_ERR_NO_MEM;
+	// Catch up on what was written before there was a task to wake.
+	xTaskNotifyGive(task);
+	return ESP_OK;
+}
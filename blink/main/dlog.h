@@ -0,0 +1,52 @@
+#ifndef DLOG_H__
+#define DLOG_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+// Deferred logging for hot paths. A call stores a pointer to its static
+// format record, the esp_log timestamp and its arguments in a ring of the
+// calling core, and returns. dlog_task formats the records later at low
+// priority, the line reads as if ESP_LOGx had printed it.
+//
+// Arguments are kept as 32-bit words: integers, and pointers cast to
+// uintptr_t. %s only for strings that outlive the call, 64-bit values
+// must be narrowed first.
+
+// Calls above this level compile to nothing, per file like LOG_LOCAL_LEVEL.
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL LOG_LOCAL_LEVEL
+#endif
+
+#define DLOG_MAX_ARGS 8
+#define DLOG_RING_SIZE 32 // records per core, power of two
+
+// One per call site, its address is what the ring carries.
+typedef struct {
+	esp_log_level_t level;
+	const char *tag;
+	const char *fmt; // whole line, LOG_FORMAT applied
+} dlog_fmt_t;
+
+#define DLOG_AT(level, letter, tag, format, ...) do{ \
+	if(DLOG_LEVEL>=level){ \
+		static const dlog_fmt_t dlog_fmt={level,tag,LOG_FORMAT(letter,format)}; \
+		dlog_write(&dlog_fmt,(const uint32_t[DLOG_MAX_ARGS]){__VA_ARGS__}); \
+	} \
+}while(0)
+
+#define DLOGE(tag, format, ...) DLOG_AT(ESP_LOG_ERROR,   E, tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...) DLOG_AT(ESP_LOG_WARN,    W, tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) DLOG_AT(ESP_LOG_INFO,    I, tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) DLOG_AT(ESP_LOG_DEBUG,   D, tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...) DLOG_AT(ESP_LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
+
+// Queue one record, from a task or an ISR. Dropped and counted when the
+// ring of this core is full.
+void dlog_write(const dlog_fmt_t *fmt, const uint32_t args[DLOG_MAX_ARGS]);
+
+// Start the formatter. Records written before are kept until it runs.
+esp_err_t dlog_start(void);
+
+#endif /* DLOG_H__ */
@@ -18,18 +18,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "esp_log.h"
-
-// HID keyboard input report length
-#define HID_KEYBOARD_IN_RPT_LEN     8
-
-// HID LED output report length
-#define HID_LED_OUT_RPT_LEN         1
-
-// HID mouse input report length
-#define HID_MOUSE_IN_RPT_LEN        5
-
-// HID consumer control input report length
-#define HID_CC_IN_RPT_LEN           2
+#include "dlog.h"
+#include "esp_gatt_common_api.h"
 
 esp_err_t esp_hidd_register_callbacks(esp_hidd_event_cb_t callbacks)
 {
@@ -45,8 +35,8 @@ esp_err_t esp_hidd_register_callbacks(esp_hidd_event_cb_t callbacks)
         return hidd_status;
     }
 
-    esp_ble_gatts_app_register(BATTRAY_APP_ID);
-    
+    /* The battery table lives on the HID app's interface, registering a
+       second app only delayed the HID one by a round trip. */
     if((hidd_status = esp_ble_gatts_app_register(HIDD_APP_ID)) != ESP_OK) {
         return hidd_status;
     }
@@ -63,6 +53,8 @@ esp_err_t esp_hidd_profile_init(void)
     // Reset the hid device target environment
     memset(&hidd_le_env, 0, sizeof(hidd_le_env_t));
     hidd_le_env.enabled = true;
+    // Hosts exchange MTUs on connect, offer enough for the NKRO report.
+    esp_ble_gatt_set_local_mtu(HID_NKRO_MIN_MTU);
     return ESP_OK;
 }
 
@@ -92,24 +84,30 @@ uint16_t esp_hidd_get_version(void)
 	return HIDD_VERSION;
 }
 
-void esp_hidd_send_consumer_value(uint16_t conn_id, uint8_t key_cmd, bool key_pressed)
+esp_err_t esp_hidd_send_consumer_value(uint16_t conn_id, uint8_t key_cmd, bool key_pressed)
 {
     uint8_t buffer[HID_CC_IN_RPT_LEN] = {0, 0};
+    // Not subscribed, don't bother building the report
+    if (!hid_dev_report_enabled(conn_id, HID_RPT_ID_CC_IN, HID_REPORT_TYPE_INPUT)) {
+        return ESP_ERR_INVALID_STATE;
+    }
     if (key_pressed) {
-        ESP_LOGD(HID_LE_PRF_TAG, "hid_consumer_build_report");
+        DLOGD(HID_LE_PRF_TAG, "hid_consumer_build_report");
         hid_consumer_build_report(buffer, key_cmd);
     }
-    ESP_LOGD(HID_LE_PRF_TAG, "buffer[0] = %x, buffer[1] = %x", buffer[0], buffer[1]);
-    hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
+    DLOGD(HID_LE_PRF_TAG, "buffer[0] = %x, buffer[1] = %x", buffer[0], buffer[1]);
+    return hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
                         HID_RPT_ID_CC_IN, HID_REPORT_TYPE_INPUT, HID_CC_IN_RPT_LEN, buffer);
-    return;
 }
 
-void esp_hidd_send_keyboard_value(uint16_t conn_id, key_mask_t special_key_mask, uint8_t *keyboard_cmd, uint8_t num_key)
+esp_err_t esp_hidd_send_keyboard_value(uint16_t conn_id, key_mask_t special_key_mask, const uint8_t *keyboard_cmd, uint8_t num_key)
 {
     if (num_key > HID_KEYBOARD_IN_RPT_LEN - 2) {
         ESP_LOGE(HID_LE_PRF_TAG, "%s(), the number key should not be more than %d", __func__, HID_KEYBOARD_IN_RPT_LEN);
-        return;
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!hid_dev_report_enabled(conn_id, HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT)) {
+        return ESP_ERR_INVALID_STATE;
     }
    
     uint8_t buffer[HID_KEYBOARD_IN_RPT_LEN] = {0};
@@ -120,25 +118,56 @@ void esp_hidd_send_keyboard_value(uint16_t conn_id, key_mask_t special_key_mask,
         buffer[i+2] = keyboard_cmd[i];
     }
 
-    ESP_LOGD(HID_LE_PRF_TAG, "the key vaule = %d,%d,%d, %d, %d, %d,%d, %d", buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7]);
-    hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
+    DLOGD(HID_LE_PRF_TAG, "the key vaule = %d,%d,%d, %d, %d, %d,%d, %d", buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7]);
+    return hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
                         HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT, HID_KEYBOARD_IN_RPT_LEN, buffer);
-    return;
 }
 
-void esp_hidd_send_mouse_value(uint16_t conn_id, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y)
+esp_err_t esp_hidd_send_nkro_value(uint16_t conn_id, const uint8_t *keys)
+{
+    // The caller keeps the bitmap in report layout, it is queued as is.
+    return hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
+                        HID_RPT_ID_NKRO_IN, HID_REPORT_TYPE_INPUT, HID_NKRO_IN_RPT_LEN, (uint8_t *)keys);
+}
+
+bool esp_hidd_keyboard_enabled(uint16_t conn_id)
+{
+    return hid_dev_report_enabled(conn_id, HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT) ||
+           esp_hidd_nkro_enabled(conn_id);
+}
+
+bool esp_hidd_nkro_enabled(uint16_t conn_id)
+{
+    return hid_dev_report_enabled(conn_id, HID_RPT_ID_NKRO_IN, HID_REPORT_TYPE_INPUT);
+}
+
+bool esp_hidd_mouse_enabled(uint16_t conn_id)
+{
+    return hid_dev_report_enabled(conn_id, HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT);
+}
+
+bool esp_hidd_mouse_pending(uint16_t conn_id)
+{
+    return hid_dev_tx_pending(conn_id, HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT);
+}
+
+esp_err_t esp_hidd_send_mouse_value(uint16_t conn_id, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y,
+                                    int8_t wheel, int8_t pan)
 {
     uint8_t buffer[HID_MOUSE_IN_RPT_LEN];
+
+    if (!esp_hidd_mouse_enabled(conn_id)) {
+        return ESP_ERR_INVALID_STATE;
+    }
     
     buffer[0] = mouse_button;   // Buttons
     buffer[1] = mickeys_x;           // X
     buffer[2] = mickeys_y;           // Y
-    buffer[3] = 0;           // Wheel
-    buffer[4] = 0;           // AC Pan
+    buffer[3] = wheel;           // Wheel
+    buffer[4] = pan;           // AC Pan
 
-    hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
+    return hid_dev_send_report(hidd_le_env.gatt_if, conn_id,
                         HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT, HID_MOUSE_IN_RPT_LEN, buffer);
-    return;
 }
 
 
@@ -30,6 +30,10 @@ typedef enum {
     ESP_HIDD_EVENT_BLE_CONNECT,                         
     ESP_HIDD_EVENT_BLE_DISCONNECT,
     ESP_HIDD_EVENT_BLE_VENDOR_REPORT_WRITE_EVT,
+    ESP_HIDD_EVENT_BLE_CONGEST,
+    ESP_HIDD_EVENT_BLE_CCCD_WRITE,
+    ESP_HIDD_EVENT_BLE_PROTO_MODE,
+    ESP_HIDD_EVENT_BLE_LED_REPORT_WRITE,
 } esp_hidd_cb_event_t;
 
 /// HID config status
@@ -91,6 +95,7 @@ typedef union {
      * @brief ESP_HIDD_EVENT_DISCONNECT
 	 */
     struct hidd_disconnect_evt_param {
+        uint16_t conn_id;                           /*!< HID connection index */
         esp_bd_addr_t remote_bda;                   /*!< HID Remote bluetooth device address */
     } disconnect;									/*!< HID callback param of ESP_HIDD_EVENT_DISCONNECT */
 
@@ -104,6 +109,39 @@ typedef union {
         uint8_t  *data;                             /*!< The pointer to the data */
     } vendor_write;									/*!< HID callback param of ESP_HIDD_EVENT_BLE_VENDOR_REPORT_WRITE_EVT */
 
+    /**
+     * @brief ESP_HIDD_EVENT_BLE_CONGEST
+	 */
+    struct hidd_congest_evt_param {
+        uint16_t conn_id;                           /*!< HID connection index */
+        bool congested;                             /*!< Congested or not */
+    } congest;									    /*!< HID callback param of ESP_HIDD_EVENT_BLE_CONGEST */
+
+    /**
+     * @brief ESP_HIDD_EVENT_BLE_CCCD_WRITE
+	 */
+    struct hidd_cccd_write_evt_param {
+        uint16_t conn_id;                           /*!< HID connection index */
+        uint16_t handle;                            /*!< CCCD handle */
+        bool notify;                                /*!< Notifications enabled or not */
+    } cccd_write;								    /*!< HID callback param of ESP_HIDD_EVENT_BLE_CCCD_WRITE */
+
+    /**
+     * @brief ESP_HIDD_EVENT_BLE_PROTO_MODE
+	 */
+    struct hidd_proto_mode_evt_param {
+        uint16_t conn_id;                           /*!< HID connection index */
+        uint8_t mode;                               /*!< HID_PROTOCOL_MODE_BOOT or HID_PROTOCOL_MODE_REPORT */
+    } proto_mode;								    /*!< HID callback param of ESP_HIDD_EVENT_BLE_PROTO_MODE */
+
+    /**
+     * @brief ESP_HIDD_EVENT_BLE_LED_REPORT_WRITE
+	 */
+    struct hidd_led_write_evt_param {
+        uint16_t conn_id;                           /*!< HID connection index */
+        uint8_t leds;                               /*!< Num, Caps, Scroll Lock, Compose, Kana bits */
+    } led_write;								    /*!< HID callback param of ESP_HIDD_EVENT_BLE_LED_REPORT_WRITE */
+
 } esp_hidd_cb_param_t;
 
 
@@ -154,11 +192,36 @@ esp_err_t esp_hidd_profile_deinit(void);
  */
 uint16_t esp_hidd_get_version(void);
 
-void esp_hidd_send_consumer_value(uint16_t conn_id, uint8_t key_cmd, bool key_pressed);
+/* The send functions queue a report for the connection, ESP_ERR_NO_MEM means
+ * the keyboard queue is full, retry once hid_dev_tx_on_space() reports room
+ * or after a connection interval. ESP_ERR_INVALID_STATE means the host has
+ * not subscribed to the report, nothing was built. */
+esp_err_t esp_hidd_send_consumer_value(uint16_t conn_id, uint8_t key_cmd, bool key_pressed);
+
+esp_err_t esp_hidd_send_keyboard_value(uint16_t conn_id, key_mask_t special_key_mask, const uint8_t *keyboard_cmd, uint8_t num_key);
+
+esp_err_t esp_hidd_send_mouse_value(uint16_t conn_id, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y,
+                                    int8_t wheel, int8_t pan);
+
+/* Send the N-key rollover report, keys is a bitmap of usages 0x00..0xE7,
+ * usage n in bit n % 8 of byte n / 8, so the modifiers fill the last byte. */
+esp_err_t esp_hidd_send_nkro_value(uint16_t conn_id, const uint8_t *keys);
+
+/* True when the host takes keyboard reports in its current protocol mode,
+ * 6KRO or NKRO. */
+bool esp_hidd_keyboard_enabled(uint16_t conn_id);
+
+/* True when the host subscribed to the NKRO report and the link's MTU fits
+ * it. Not in boot mode. */
+bool esp_hidd_nkro_enabled(uint16_t conn_id);
 
-void esp_hidd_send_keyboard_value(uint16_t conn_id, key_mask_t special_key_mask, uint8_t *keyboard_cmd, uint8_t num_key);
+/* Same for mouse reports. */
+bool esp_hidd_mouse_enabled(uint16_t conn_id);
 
-void esp_hidd_send_mouse_value(uint16_t conn_id, uint8_t mouse_button, int8_t mickeys_x, int8_t mickeys_y);
+/* True while a mouse report is still waiting for the link. Mouse reports
+ * only keep their latest state there, so relative motion should not be
+ * handed over until this clears. */
+bool esp_hidd_mouse_pending(uint16_t conn_id);
 
 #ifdef __cplusplus
 }
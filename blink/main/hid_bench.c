@@ -0,0 +1,112 @@
+#include "hid_bench.h"
+
+#if HID_BENCH_ENABLED
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_hidd_prf_api.h"
+#include "hid_dev.h"
+
+#define LOG_NAME "hid_bench"
+
+typedef enum { BENCH_KEYBOARD, BENCH_MOUSE, BENCH_CONSUMER, BENCH_PATHS } bench_path_t;
+
+static const char *const path_names[BENCH_PATHS]={
+	[BENCH_KEYBOARD]="keyboard",
+	[BENCH_MOUSE]="mouse",
+	[BENCH_CONSUMER]="consumer",
+};
+
+static TaskHandle_t waiter;
+static _Atomic uint32_t confirms;
+
+void hid_bench_confirmed(void){
+	atomic_fetch_add(&confirms,1);
+	if(waiter)xTaskNotifyGive(waiter);
+}
+
+static esp_err_t bench_send(bench_path_t path, uint16_t conn_id){
+	static const uint8_t no_keys[1];
+	switch(path){
+	case BENCH_KEYBOARD: return esp_hidd_send_keyboard_value(conn_id,0,no_keys,0);
+	case BENCH_MOUSE:    return esp_hidd_send_mouse_value(conn_id,0,0,0,0,0);
+	default:             return esp_hidd_send_consumer_value(conn_id,0,false);
+	}
+}
+
+// Mouse and consumer reports only keep their latest state while the link
+// is busy, wait for the slot so every report counts.
+static bool bench_slot_free(bench_path_t path, uint16_t conn_id){
+	if(path==BENCH_KEYBOARD)return true;
+	uint8_t id=path==BENCH_MOUSE?HID_RPT_ID_MOUSE_IN:HID_RPT_ID_CC_IN;
+	return !hid_dev_tx_pending(conn_id,id,HID_REPORT_TYPE_INPUT);
+}
+
+// Wait until confirms reaches target, false on timeout.
+static bool bench_wait(uint32_t target){
+	int64_t deadline=esp_timer_get_time()+HID_BENCH_TIMEOUT_MS*1000;
+	while(atomic_load(&confirms)<target){
+		if(esp_timer_get_time()>deadline)return false;
+		ulTaskNotifyTake(pdTRUE,pdMS_TO_TICKS(HID_BENCH_TIMEOUT_MS)?:1);
+	}
+	return true;
+}
+
+static int cmp_u32(const void *a, const void *b){
+	uint32_t x=*(const uint32_t *)a, y=*(const uint32_t *)b;
+	return x<y?-1:x>y;
+}
+
+static void bench_path(bench_path_t path, uint16_t conn_id){
+	static uint32_t lat[HID_BENCH_LATENCY_SAMPLES];
+	uint32_t n=0, cpu=0;
+
+	// Latency, one report at a time.
+	for(int i=0;i<HID_BENCH_LATENCY_SAMPLES;i++){
+		uint32_t target=atomic_load(&confirms)+1;
+		int64_t t0=esp_timer_get_time();
+		if(bench_send(path,conn_id)!=ESP_OK || !bench_wait(target))break;
+		lat[n++]=esp_timer_get_time()-t0;
+	}
+	if(!n){
+		ESP_LOGW(LOG_NAME,"%s: no confirms, is the host subscribed?",path_names[path]);
+		return;
+	}
+	qsort(lat,n,sizeof(lat[0]),cmp_u32);
+
+	// Throughput, keep the link full.
+	uint32_t start=atomic_load(&confirms), sent=0;
+	int64_t t0=esp_timer_get_time();
+	while(sent<HID_BENCH_REPORTS){
+		if(!bench_slot_free(path,conn_id)){
+			ulTaskNotifyTake(pdTRUE,1);
+			continue;
+		}
+		int64_t s=esp_timer_get_time();
+		esp_err_t err=bench_send(path,conn_id);
+		cpu+=esp_timer_get_time()-s;
+		if(err==ESP_OK)sent++;
+		else if(err==ESP_ERR_NO_MEM)ulTaskNotifyTake(pdTRUE,1);
+		else break;
+	}
+	bench_wait(start+sent);
+	uint32_t done=atomic_load(&confirms)-start;
+	uint32_t us=esp_timer_get_time()-t0;
+
+	ESP_LOGI(LOG_NAME,"%s: %u reports, %u reports/s, %u us/report, latency p50 %u us p99 %u us max %u us",
+		path_names[path],done,us?(uint32_t)((uint64_t)done*1000000/us):0,sent?cpu/sent:0,
+		lat[n/2],lat[(n*99)/100],lat[n-1]);
+}
+
+void hid_bench_run(uint16_t conn_id){
+	waiter=xTaskGetCurrentTaskHandle();
+	for(int p=0;p<BENCH_PATHS;p++)bench_path(p,conn_id);
+	waiter=NULL;
+	ESP_LOGI(LOG_NAME,"done");
+}
+
+#endif
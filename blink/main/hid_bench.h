@@ -0,0 +1,41 @@
+#ifndef HID_BENCH_H__
+#define HID_BENCH_H__
+
+#include <stdint.h>
+
+// Report path benchmarks against a real host. Build with
+// -DHID_BENCH_ENABLED=1 to turn them on, otherwise the hooks compile to
+// nothing. The reports carry no keys, motion or usages, the host sees
+// nothing happen.
+#ifndef HID_BENCH_ENABLED
+#define HID_BENCH_ENABLED 0
+#endif
+
+#define HID_BENCH_REPORTS 200        // per path, for the throughput run
+#define HID_BENCH_LATENCY_SAMPLES 64 // per path, one report in flight at a time
+#define HID_BENCH_TIMEOUT_MS 1000    // give up on a confirm after this long
+
+#if HID_BENCH_ENABLED
+
+// Measure the keyboard, mouse and consumer paths on a secured connection
+// whose host subscribed to all three, and log one line per path:
+//   hid_bench: <path>: <n> reports, <r> reports/s, <c> us/report, latency p50 <us> us p99 <us> us max <us> us
+// reports/s runs from the first send to the last confirm with the link
+// kept full, us/report is the time spent in the send call and latency is
+// send call to ESP_GATTS_CONF_EVT. Blocks the calling task.
+void hid_bench_run(uint16_t conn_id);
+
+// ESP_GATTS_CONF_EVT for any input report.
+void hid_bench_confirmed(void);
+
+#define HID_BENCH_RUN(conn_id)  hid_bench_run(conn_id)
+#define HID_BENCH_CONFIRMED()   hid_bench_confirmed()
+
+#else
+
+#define HID_BENCH_RUN(conn_id)  do{}while(0)
+#define HID_BENCH_CONFIRMED()   do{}while(0)
+
+#endif
+
+#endif /* HID_BENCH_H__ */
@@ -18,43 +18,634 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "key_trace.h"
+#include "dlog.h"
+
+// Subscriptions of bonded hosts, keyed by address. Bonded hosts are not
+// required to write their CCCDs again when they reconnect. Saved as one bit
+// per report id, type and protocol mode, so they survive the table changing
+// with the SUPPORT_REPORT_* flags.
+#define HID_DEV_NVS_NAMESPACE "hid_cccd"
+_Static_assert(2 * HID_RPT_ID_MAX * (HID_TYPE_FEATURE + 1) <= 64, "saved CCCD bits do not fit a u64");
 
 static hid_report_map_t *hid_dev_rpt_tbl;
 static uint8_t hid_dev_rpt_tbl_Len;
 
-static hid_report_map_t *hid_dev_rpt_by_id(uint8_t id, uint8_t type)
+// One report waiting for its turn on the link.
+typedef struct {
+    uint8_t id;
+    uint8_t type;
+    uint8_t len;
+    uint8_t data[HID_DEV_TX_RPT_MAX_LEN];
+    // Capture time of the first key in it for key_trace, 0 if untraced.
+    uint32_t trace_us;
+} hid_dev_tx_rpt_t;
+
+// Mouse and consumer reports carry absolute state, so only the newest one
+// of each is worth sending.
+enum {
+    HID_DEV_TX_LATEST_MOUSE,
+    HID_DEV_TX_LATEST_CC,
+    HID_DEV_TX_LATEST_NUM,
+};
+
+// Everything a host has set up on its own link: the protocol mode it
+// selected, the CCCDs it wrote, the routing table built from both and
+// the reports queued for it.
+typedef struct {
+    bool in_use;
+    bool congested;
+    // Set while one caller is sending this link's queue.
+    bool draining;
+    uint16_t conn_id;
+    esp_gatt_if_t gatts_if;
+    uint8_t mode;
+    uint16_t mtu;
+    // Set once the link is encrypted with a bonded host, subscriptions
+    // are saved under its address from then on.
+    bool bonded;
+    esp_bd_addr_t bda;
+    // Notification state of each report's CCCD, one bit per table entry.
+    // Nothing is sent for a report until its host subscribes.
+    uint32_t ntf_enabled;
+    // CCCDs written on this link, they win over saved state.
+    uint32_t ntf_written;
+    // Reports that can be sent right now, indexed by id and type. NULL for
+    // unknown reports and for those whose CCCD the host has switched off,
+    // so the send path is a single load.
+    hid_report_map_t *ntf_tbl[HID_RPT_ID_MAX][HID_TYPE_FEATURE + 1];
+    uint8_t head;
+    uint8_t count;
+    hid_dev_tx_rpt_t queue[HID_DEV_TX_QUEUE_LEN];
+    uint8_t latest_pending;
+    hid_dev_tx_rpt_t latest[HID_DEV_TX_LATEST_NUM];
+} hid_dev_conn_t;
+
+static hid_dev_conn_t hid_dev_conn[HID_MAX_APPS];
+static hid_dev_tx_stats_t hid_dev_tx_stats;
+static hid_dev_tx_space_cb_t hid_dev_tx_space_cb;
+
+// Guards the connection table, taken by the sending task and by the BTC
+// task on GATT events.
+static SemaphoreHandle_t hid_dev_lock;
+
+static void hid_dev_build_ntf_tbl(hid_dev_conn_t *conn)
 {
     hid_report_map_t *rpt = hid_dev_rpt_tbl;
 
-    for (uint8_t i = hid_dev_rpt_tbl_Len; i > 0; i--, rpt++) {
-        if (rpt->id == id && rpt->type == type && rpt->mode == hidProtocolMode) {
-            return rpt;
+    memset(conn->ntf_tbl, 0, sizeof(conn->ntf_tbl));
+    for (uint8_t i = 0; i < hid_dev_rpt_tbl_Len; i++, rpt++) {
+        if (rpt->mode != conn->mode || rpt->id >= HID_RPT_ID_MAX || rpt->type > HID_TYPE_FEATURE) {
+            continue;
         }
+        if (rpt->cccdHandle != 0 && !(conn->ntf_enabled & (1 << i))) {
+            continue;
+        }
+        // Left to the 6KRO report until the host takes long enough notifications.
+        if (rpt->id == HID_RPT_ID_NKRO_IN && conn->mtu < HID_NKRO_MIN_MTU) {
+            continue;
+        }
+        conn->ntf_tbl[rpt->id][rpt->type] = rpt;
     }
+}
 
+static hid_dev_conn_t *hid_dev_conn_find(uint16_t conn_id)
+{
+    for (int i = 0; i < HID_MAX_APPS; i++) {
+        if (hid_dev_conn[i].in_use && hid_dev_conn[i].conn_id == conn_id) {
+            return &hid_dev_conn[i];
+        }
+    }
     return NULL;
 }
 
+esp_err_t hid_dev_init(void)
+{
+    if (hid_dev_lock == NULL && (hid_dev_lock = xSemaphoreCreateMutex()) == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
 void hid_dev_register_reports(uint8_t num_reports, hid_report_map_t *p_report)
 {
+    // Advertising does not wait for the service table, hosts that came in
+    // before it existed get their routes now.
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
     hid_dev_rpt_tbl = p_report;
     hid_dev_rpt_tbl_Len = num_reports;
+    for (int i = 0; i < HID_MAX_APPS; i++) {
+        if (hid_dev_conn[i].in_use) {
+            hid_dev_build_ntf_tbl(&hid_dev_conn[i]);
+        }
+    }
+    xSemaphoreGive(hid_dev_lock);
     return;
 }
 
-void hid_dev_send_report(esp_gatt_if_t gatts_if, uint16_t conn_id,
-                                    uint8_t id, uint8_t type, uint8_t length, uint8_t *data)
+esp_err_t hid_dev_conn_open(uint16_t conn_id)
 {
+    hid_dev_conn_t *conn = NULL;
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    if (hid_dev_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    for (int i = 0; i < HID_MAX_APPS; i++) {
+        if (!hid_dev_conn[i].in_use) {
+            conn = &hid_dev_conn[i];
+            break;
+        }
+    }
+    if (conn != NULL) {
+        memset(conn, 0, sizeof(hid_dev_conn_t));
+        conn->in_use = true;
+        conn->conn_id = conn_id;
+        conn->mode = HID_PROTOCOL_MODE_REPORT;
+        conn->mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+        hid_dev_build_ntf_tbl(conn);
+        ret = ESP_OK;
+    }
+    xSemaphoreGive(hid_dev_lock);
+    return ret;
+}
+
+bool hid_dev_set_protocol_mode(uint16_t conn_id, uint8_t mode)
+{
+    hid_dev_conn_t *conn;
+    bool changed = false;
+
+    if (mode != HID_PROTOCOL_MODE_BOOT && mode != HID_PROTOCOL_MODE_REPORT) {
+        ESP_LOGE(HID_LE_PRF_TAG, "%s(), invalid protocol mode %d", __func__, mode);
+        return false;
+    }
+    // The send path looks routes up under the same lock, it sees either
+    // the old table or the new one.
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) != NULL && conn->mode != mode) {
+        conn->mode = mode;
+        hid_dev_build_ntf_tbl(conn);
+        changed = true;
+    }
+    xSemaphoreGive(hid_dev_lock);
+    return changed;
+}
+
+uint8_t hid_dev_get_protocol_mode(uint16_t conn_id)
+{
+    hid_dev_conn_t *conn;
+    uint8_t mode = HID_PROTOCOL_MODE_REPORT;
+
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) != NULL) {
+        mode = conn->mode;
+    }
+    xSemaphoreGive(hid_dev_lock);
+    return mode;
+}
+
+void hid_dev_conn_mtu(uint16_t conn_id, uint16_t mtu)
+{
+    hid_dev_conn_t *conn;
+
+    if (hid_dev_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) != NULL && conn->mtu != mtu) {
+        conn->mtu = mtu;
+        hid_dev_build_ntf_tbl(conn);
+    }
+    xSemaphoreGive(hid_dev_lock);
+    ESP_LOGI(HID_LE_PRF_TAG, "conn_id %x mtu %d", conn_id, mtu);
+}
+
+static void hid_dev_nvs_key(const esp_bd_addr_t bda, char *key)
+{
+    sprintf(key, "%02x%02x%02x%02x%02x%02x", bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+static uint64_t hid_dev_cccd_bit(const hid_report_map_t *rpt)
+{
+    if (rpt->id >= HID_RPT_ID_MAX || rpt->type > HID_TYPE_FEATURE || rpt->mode > HID_PROTOCOL_MODE_REPORT) {
+        return 0;
+    }
+    return 1ULL << ((rpt->mode * HID_RPT_ID_MAX + rpt->id) * (HID_TYPE_FEATURE + 1) + rpt->type);
+}
+
+// Table entry bits to saved bits and back, with hid_dev_lock held.
+static uint64_t hid_dev_cccd_pack(uint32_t enabled)
+{
+    uint64_t saved = 0;
+
+    for (uint8_t i = 0; i < hid_dev_rpt_tbl_Len; i++) {
+        if (enabled & (1 << i)) {
+            saved |= hid_dev_cccd_bit(&hid_dev_rpt_tbl[i]);
+        }
+    }
+    return saved;
+}
+
+static uint32_t hid_dev_cccd_unpack(uint64_t saved)
+{
+    uint32_t enabled = 0;
+
+    for (uint8_t i = 0; i < hid_dev_rpt_tbl_Len; i++) {
+        if (hid_dev_rpt_tbl[i].cccdHandle != 0 && (saved & hid_dev_cccd_bit(&hid_dev_rpt_tbl[i]))) {
+            enabled |= (1 << i);
+        }
+    }
+    return enabled;
+}
+
+static void hid_dev_save_cccd(const esp_bd_addr_t bda, uint64_t saved)
+{
+    char key[2 * ESP_BD_ADDR_LEN + 1];
+    nvs_handle_t nvs;
+    uint64_t old;
+
+    if (nvs_open(HID_DEV_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    hid_dev_nvs_key(bda, key);
+    // Hosts write the same CCCDs on every connect, spare the flash.
+    if (nvs_get_u64(nvs, key, &old) != ESP_OK || old != saved) {
+        nvs_set_u64(nvs, key, saved);
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+bool hid_dev_write_cccd(uint16_t conn_id, uint16_t handle, uint16_t value)
+{
+    hid_report_map_t *rpt;
+    hid_dev_conn_t *conn;
+    esp_bd_addr_t bda;
+    uint64_t saved = 0;
+    bool found = false, save = false;
+
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    rpt = hid_dev_rpt_tbl;
+    conn = hid_dev_conn_find(conn_id);
+    for (uint8_t i = 0; i < hid_dev_rpt_tbl_Len && conn != NULL; i++, rpt++) {
+        if (rpt->cccdHandle != 0 && rpt->cccdHandle == handle) {
+            if (value & 0x0001) {
+                conn->ntf_enabled |= (1 << i);
+            } else {
+                conn->ntf_enabled &= ~(1 << i);
+            }
+            conn->ntf_written |= (1 << i);
+            hid_dev_build_ntf_tbl(conn);
+            if ((save = conn->bonded)) {
+                memcpy(bda, conn->bda, sizeof(esp_bd_addr_t));
+                saved = hid_dev_cccd_pack(conn->ntf_enabled);
+            }
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(hid_dev_lock);
+
+    if (save) {
+        hid_dev_save_cccd(bda, saved);
+    }
+    return found;
+}
+
+void hid_dev_conn_bonded(uint16_t conn_id, const esp_bd_addr_t bda)
+{
+    char key[2 * ESP_BD_ADDR_LEN + 1];
+    hid_dev_conn_t *conn;
+    nvs_handle_t nvs;
+    uint64_t saved = 0;
+    bool have = false, save = false;
+
+    if (hid_dev_lock == NULL) {
+        return;
+    }
+    hid_dev_nvs_key(bda, key);
+    // Entries from before the bits were keyed by report are u32, they read
+    // back as a type mismatch and count as not saved.
+    if (nvs_open(HID_DEV_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        have = nvs_get_u64(nvs, key, &saved) == ESP_OK;
+        nvs_close(nvs);
+    }
+
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) != NULL) {
+        conn->bonded = true;
+        memcpy(conn->bda, bda, sizeof(esp_bd_addr_t));
+        if (have) {
+            conn->ntf_enabled = (conn->ntf_enabled & conn->ntf_written) |
+                                (hid_dev_cccd_unpack(saved) & ~conn->ntf_written);
+            hid_dev_build_ntf_tbl(conn);
+        }
+        // Written before the bond was known, a fresh pairing.
+        if ((save = conn->ntf_written != 0)) {
+            saved = hid_dev_cccd_pack(conn->ntf_enabled);
+        }
+    }
+    xSemaphoreGive(hid_dev_lock);
+
+    if (save) {
+        hid_dev_save_cccd(bda, saved);
+    }
+    ESP_LOGI(HID_LE_PRF_TAG, "conn_id %x subscriptions %s", conn_id, have ? "restored" : "not saved yet");
+}
+
+static int hid_dev_tx_latest_slot(uint8_t id, uint8_t type)
+{
+    if (type != HID_TYPE_INPUT) {
+        return -1;
+    }
+    switch (id) {
+        case HID_RPT_ID_MOUSE_IN:
+            return HID_DEV_TX_LATEST_MOUSE;
+        case HID_RPT_ID_CC_IN:
+            return HID_DEV_TX_LATEST_CC;
+        default:
+            return -1;
+    }
+}
+
+// Boot reports are prefixes of the report mode layouts. The keyboard is
+// the same 8 bytes, the boot mouse stops after X and Y. So a queued report
+// goes out as is in either mode, only shorter.
+static uint8_t hid_dev_tx_len(const hid_report_map_t *p_rpt, uint8_t len)
+{
+    if (p_rpt->mode != HID_PROTOCOL_MODE_BOOT || p_rpt->type != HID_TYPE_INPUT) {
+        return len;
+    }
+    switch (p_rpt->id) {
+        case HID_RPT_ID_KEY_IN:
+            return len < HID_BOOT_KB_IN_RPT_LEN ? len : HID_BOOT_KB_IN_RPT_LEN;
+        case HID_RPT_ID_MOUSE_IN:
+            return len < HID_BOOT_MOUSE_IN_RPT_LEN ? len : HID_BOOT_MOUSE_IN_RPT_LEN;
+        default:
+            return len;
+    }
+}
+
+// Hand one report to the stack. Called without hid_dev_lock, the stack
+// takes its own locks and may block on them.
+static esp_err_t hid_dev_tx_send(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t handle,
+                                 const hid_dev_tx_rpt_t *rpt, uint8_t len)
+{
+    DLOGD(HID_LE_PRF_TAG, "%s(), send the report, handle = %d", (uintptr_t)__func__, handle);
+    esp_err_t ret = esp_ble_gatts_send_indicate(gatts_if, conn_id, handle, len, (uint8_t *)rpt->data, false);
+    if (ret != ESP_OK) {
+        DLOGW(HID_LE_PRF_TAG, "report %d refused by the stack, kept for a retry", rpt->id);
+        return ret;
+    }
+    KEY_TRACE_SENT(rpt->trace_us);
+    return ESP_OK;
+}
+
+// Send everything queued, keyboard FIFO first, until the link congests or
+// the stack refuses a report. A refused report stays at the head and is
+// tried again on the next congestion or confirm event, or the next report
+// queued or turned away. Reports are copied out and sent without
+// hid_dev_lock held, one caller drains a link at a time so they still go
+// out in order. A FIFO that was full and has room again is announced to
+// the hid_dev_tx_on_space() callback.
+static void hid_dev_tx_drain(uint16_t conn_id)
+{
+    hid_dev_conn_t *conn;
+    hid_dev_tx_rpt_t rpt;
     hid_report_map_t *p_rpt;
+    esp_gatt_if_t gatts_if;
+    uint16_t handle;
+    uint8_t len;
+    int slot;
+    bool was_full;
+
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) == NULL || conn->draining) {
+        xSemaphoreGive(hid_dev_lock);
+        return;
+    }
+    conn->draining = true;
+    was_full = conn->count == HID_DEV_TX_QUEUE_LEN;
+    while (!conn->congested) {
+        slot = -1;
+        if (conn->count > 0) {
+            rpt = conn->queue[conn->head];
+        } else {
+            for (int i = 0; i < HID_DEV_TX_LATEST_NUM && slot < 0; i++) {
+                if (conn->latest_pending & (1 << i)) {
+                    slot = i;
+                }
+            }
+            if (slot < 0) {
+                break;
+            }
+            // A newer state written during the send takes its place.
+            conn->latest_pending &= ~(1 << slot);
+            rpt = conn->latest[slot];
+        }
+        // Looked up again, the protocol mode or CCCD may have changed while queued.
+        if ((p_rpt = conn->ntf_tbl[rpt.id][rpt.type]) == NULL) {
+            hid_dev_tx_stats.dropped++;
+            if (slot < 0) {
+                conn->head = (conn->head + 1) % HID_DEV_TX_QUEUE_LEN;
+                conn->count--;
+            }
+            continue;
+        }
+        gatts_if = conn->gatts_if;
+        handle = p_rpt->handle;
+        len = hid_dev_tx_len(p_rpt, rpt.len);
+        xSemaphoreGive(hid_dev_lock);
+
+        esp_err_t ret = hid_dev_tx_send(gatts_if, conn_id, handle, &rpt, len);
 
-    // get att handle for report
-    if ((p_rpt = hid_dev_rpt_by_id(id, type)) != NULL) {
-        // if notifications are enabled
-        ESP_LOGD(HID_LE_PRF_TAG, "%s(), send the report, handle = %d", __func__, p_rpt->handle);
-        esp_ble_gatts_send_indicate(gatts_if, conn_id, p_rpt->handle, length, data, false);
+        xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+        // Closed while sending, whatever was left is already counted.
+        if (!conn->in_use || conn->conn_id != conn_id) {
+            xSemaphoreGive(hid_dev_lock);
+            return;
+        }
+        if (ret != ESP_OK) {
+            hid_dev_tx_stats.refused++;
+            if (slot >= 0) {
+                conn->latest_pending |= (1 << slot);
+            }
+            break;
+        }
+        hid_dev_tx_stats.sent++;
+        if (slot < 0) {
+            conn->head = (conn->head + 1) % HID_DEV_TX_QUEUE_LEN;
+            conn->count--;
+        }
     }
-    
-    return;
+    conn->draining = false;
+    bool space = was_full && conn->count < HID_DEV_TX_QUEUE_LEN;
+    hid_dev_tx_space_cb_t space_cb = hid_dev_tx_space_cb;
+    xSemaphoreGive(hid_dev_lock);
+    if (space && space_cb != NULL) {
+        space_cb(conn_id);
+    }
+}
+
+bool hid_dev_report_enabled(uint16_t conn_id, uint8_t id, uint8_t type)
+{
+    hid_dev_conn_t *conn;
+    bool enabled = false;
+
+    if (id >= HID_RPT_ID_MAX || type > HID_TYPE_FEATURE || hid_dev_lock == NULL) {
+        return false;
+    }
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) != NULL) {
+        enabled = conn->ntf_tbl[id][type] != NULL;
+    }
+    xSemaphoreGive(hid_dev_lock);
+    return enabled;
+}
+
+esp_err_t hid_dev_send_report(esp_gatt_if_t gatts_if, uint16_t conn_id,
+                                    uint8_t id, uint8_t type, uint8_t length, uint8_t *data)
+{
+    hid_dev_conn_t *conn;
+    hid_dev_tx_rpt_t *rpt;
+    esp_err_t ret = ESP_OK;
+    int slot;
+
+    if (id >= HID_RPT_ID_MAX || type > HID_TYPE_FEATURE || length > HID_DEV_TX_RPT_MAX_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (hid_dev_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) == NULL) {
+        ret = ESP_ERR_NOT_FOUND;
+        goto out;
+    }
+    // NULL if notifications are disabled, nothing to queue then
+    if (conn->ntf_tbl[id][type] == NULL) {
+        ret = ESP_ERR_INVALID_STATE;
+        goto out;
+    }
+    // Opcode and handle take 3 bytes of every notification.
+    if (length + 3 > conn->mtu) {
+        ret = ESP_ERR_INVALID_SIZE;
+        goto out;
+    }
+    conn->gatts_if = gatts_if;
+
+    if ((slot = hid_dev_tx_latest_slot(id, type)) >= 0) {
+        if (conn->latest_pending & (1 << slot)) {
+            hid_dev_tx_stats.coalesced++;
+        }
+        conn->latest_pending |= (1 << slot);
+        rpt = &conn->latest[slot];
+        rpt->trace_us = 0;
+    } else if (conn->count < HID_DEV_TX_QUEUE_LEN) {
+        rpt = &conn->queue[(conn->head + conn->count) % HID_DEV_TX_QUEUE_LEN];
+        conn->count++;
+        rpt->trace_us = id == HID_RPT_ID_KEY_IN || id == HID_RPT_ID_NKRO_IN ? KEY_TRACE_ORIGIN() : 0;
+    } else {
+        // Nothing may be in flight to bring a confirm or congestion event,
+        // the stack can have refused the head with the link clear. Try it
+        // again now, the caller hears of the room through the callback.
+        xSemaphoreGive(hid_dev_lock);
+        hid_dev_tx_drain(conn_id);
+        return ESP_ERR_NO_MEM;
+    }
+    rpt->id = id;
+    rpt->type = type;
+    rpt->len = length;
+    memcpy(rpt->data, data, length);
+    xSemaphoreGive(hid_dev_lock);
+
+    hid_dev_tx_drain(conn_id);
+    return ESP_OK;
+out:
+    xSemaphoreGive(hid_dev_lock);
+    return ret;
+}
+
+bool hid_dev_tx_pending(uint16_t conn_id, uint8_t id, uint8_t type)
+{
+    hid_dev_conn_t *conn;
+    bool pending = false;
+    int slot;
+
+    if (hid_dev_lock == NULL) {
+        return false;
+    }
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) != NULL) {
+        if ((slot = hid_dev_tx_latest_slot(id, type)) >= 0) {
+            pending = conn->latest_pending & (1 << slot);
+        } else {
+            for (uint8_t i = 0; i < conn->count && !pending; i++) {
+                hid_dev_tx_rpt_t *rpt = &conn->queue[(conn->head + i) % HID_DEV_TX_QUEUE_LEN];
+                pending = rpt->id == id && rpt->type == type;
+            }
+        }
+    }
+    xSemaphoreGive(hid_dev_lock);
+    return pending;
+}
+
+void hid_dev_tx_congest(uint16_t conn_id, bool congested)
+{
+    hid_dev_conn_t *conn;
+
+    if (hid_dev_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) != NULL) {
+        conn->congested = congested;
+    }
+    xSemaphoreGive(hid_dev_lock);
+    hid_dev_tx_drain(conn_id);
+}
+
+void hid_dev_tx_confirm(uint16_t conn_id)
+{
+    if (hid_dev_lock == NULL) {
+        return;
+    }
+    hid_dev_tx_drain(conn_id);
+}
+
+void hid_dev_conn_close(uint16_t conn_id)
+{
+    hid_dev_conn_t *conn;
+
+    if (hid_dev_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(hid_dev_lock, portMAX_DELAY);
+    if ((conn = hid_dev_conn_find(conn_id)) != NULL) {
+        hid_dev_tx_stats.dropped += conn->count;
+        for (int i = 0; i < HID_DEV_TX_LATEST_NUM; i++) {
+            if (conn->latest_pending & (1 << i)) {
+                hid_dev_tx_stats.dropped++;
+            }
+        }
+        conn->in_use = false;
+    }
+    xSemaphoreGive(hid_dev_lock);
+}
+
+void hid_dev_tx_on_space(hid_dev_tx_space_cb_t cb)
+{
+    hid_dev_tx_space_cb = cb;
+}
+
+void hid_dev_tx_get_stats(hid_dev_tx_stats_t *stats)
+{
+    *stats = hid_dev_tx_stats;
 }
 
 void hid_consumer_build_report(uint8_t *buffer, consumer_cmd_t cmd)
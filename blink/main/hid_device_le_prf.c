@@ -13,8 +13,14 @@
 // limitations under the License.
 
 #include "hidd_le_prf_int.h"
+#include <assert.h>
 #include <string.h>
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "key_trace.h"
+#include "hid_bench.h"
+#include "boot_time.h"
 
 /// characteristic presentation information
 struct prf_char_pres_fmt
@@ -35,8 +41,10 @@ struct prf_char_pres_fmt
 static hid_report_map_t hid_rpt_map[HID_NUM_REPORTS];
 
 // HID Report Map characteristic value
-// Keyboard report descriptor (using format for Boot interface descriptor)
+// Keyboard report descriptor (using format for Boot interface descriptor),
+// one application collection per SUPPORT_REPORT_* feature
 static const uint8_t hidReportMap[] = {
+#if (SUPPORT_REPORT_MOUSE == true)
     0x05, 0x01,  // Usage Page (Generic Desktop)
     0x09, 0x02,  // Usage (Mouse)
     0xA1, 0x01,  // Collection (Application)
@@ -63,9 +71,15 @@ static const uint8_t hidReportMap[] = {
     0x75, 0x08,  //     Report Size (8)
     0x95, 0x03,  //     Report Count (3)
     0x81, 0x06,  //     Input (Data, Variable, Relative) - X & Y coordinate
+    0x05, 0x0C,  //     Usage Page (Consumer)
+    0x0A, 0x38, 0x02, //     Usage (AC Pan)
+    0x95, 0x01,  //     Report Count (1)
+    0x81, 0x06,  //     Input (Data, Variable, Relative) - Horizontal scroll
     0xC0,        //   End Collection
     0xC0,        // End Collection
+#endif
 
+#if (SUPPORT_REPORT_KEYBOARD == true)
     0x05, 0x01,  // Usage Pg (Generic Desktop)
     0x09, 0x06,  // Usage (Keyboard)
     0xA1, 0x01,  // Collection: (Application)
@@ -112,6 +126,27 @@ static const uint8_t hidReportMap[] = {
     //
     0xC0,        // End Collection
     //
+#endif
+#if (SUPPORT_REPORT_NKRO == true)
+    0x05, 0x01,  // Usage Pg (Generic Desktop)
+    0x09, 0x06,  // Usage (Keyboard)
+    0xA1, 0x01,  // Collection: (Application)
+    0x85, 0x05,  // Report Id (5)
+    //
+    //   Key bitmap, one bit per usage up to the modifiers (29 bytes)
+    0x05, 0x07,  //   Usage Pg (Key Codes)
+    0x19, 0x00,  //   Usage Min (0)
+    0x29, 0xE7,  //   Usage Max (231)
+    0x15, 0x00,  //   Log Min (0)
+    0x25, 0x01,  //   Log Max (1)
+    0x75, 0x01,  //   Report Size (1)
+    0x95, 0xE8,  //   Report Count (232)
+    0x81, 0x02,  //   Input: (Data, Variable, Absolute)
+    //
+    0xC0,        // End Collection
+    //
+#endif
+#if (SUPPORT_REPORT_CONSUMER == true)
     0x05, 0x0C,   // Usage Pg (Consumer Devices)
     0x09, 0x01,   // Usage (Consumer Control)
     0xA1, 0x01,   // Collection (Application)
@@ -169,6 +204,7 @@ static const uint8_t hidReportMap[] = {
     0xC0,           //   End Collection
     0x81, 0x03,   //   Input (Const, Var, Abs)
     0xC0,            // End Collectionq
+#endif
 
 #if (SUPPORT_REPORT_VENDOR == true)
     0x06, 0xFF, 0xFF, // Usage Page(Vendor defined)
@@ -185,6 +221,8 @@ static const uint8_t hidReportMap[] = {
 
 };
 
+_Static_assert(sizeof(hidReportMap) <= HIDD_LE_REPORT_MAP_MAX_LEN, "report map too long for HID over GATT");
+
 /// Battery Service Attributes Indexes
 enum
 {
@@ -213,8 +251,10 @@ struct gatts_profile_inst {
 hidd_le_env_t hidd_le_env;
 
 // HID report map length
-uint8_t hidReportMapLen = sizeof(hidReportMap);
-uint8_t hidProtocolMode = HID_PROTOCOL_MODE_REPORT;
+uint16_t hidReportMapLen = sizeof(hidReportMap);
+// Only the attribute's size, reads and writes are answered from the
+// mode each link is in.
+static const uint8_t hidProtocolMode = HID_PROTOCOL_MODE_REPORT;
 
 // HID report mapping table
 //static hidRptMap_t  hidRptMap[HID_NUM_REPORTS];
@@ -230,11 +270,13 @@ static const uint8_t hidInfo[HID_INFORMATION_LEN] = {
 // HID External Report Reference Descriptor
 static uint16_t hidExtReportRefDesc = ESP_GATT_UUID_BATTERY_LEVEL;
 
+#if (SUPPORT_REPORT_MOUSE == true)
 // HID Report Reference characteristic descriptor, mouse input
 static uint8_t hidReportRefMouseIn[HID_REPORT_REF_LEN] =
              { HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT };
+#endif
 
-
+#if (SUPPORT_REPORT_KEYBOARD == true)
 // HID Report Reference characteristic descriptor, key input
 static uint8_t hidReportRefKeyIn[HID_REPORT_REF_LEN] =
              { HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT };
@@ -242,6 +284,13 @@ static uint8_t hidReportRefKeyIn[HID_REPORT_REF_LEN] =
 // HID Report Reference characteristic descriptor, LED output
 static uint8_t hidReportRefLedOut[HID_REPORT_REF_LEN] =
              { HID_RPT_ID_LED_OUT, HID_REPORT_TYPE_OUTPUT };
+#endif
+
+#if (SUPPORT_REPORT_NKRO == true)
+// HID Report Reference characteristic descriptor, NKRO key input
+static uint8_t hidReportRefNkroIn[HID_REPORT_REF_LEN] =
+             { HID_RPT_ID_NKRO_IN, HID_REPORT_TYPE_INPUT };
+#endif
 
 #if (SUPPORT_REPORT_VENDOR  == true)
 
@@ -253,9 +302,11 @@ static uint8_t hidReportRefVendorOut[HID_REPORT_REF_LEN] =
 static uint8_t hidReportRefFeature[HID_REPORT_REF_LEN] =
              { HID_RPT_ID_FEATURE, HID_REPORT_TYPE_FEATURE };
 
+#if (SUPPORT_REPORT_CONSUMER == true)
 // HID Report Reference characteristic descriptor, consumer control input
 static uint8_t hidReportRefCCIn[HID_REPORT_REF_LEN] =
              { HID_RPT_ID_CC_IN, HID_REPORT_TYPE_INPUT };
+#endif
 
 
 /*
@@ -279,9 +330,13 @@ static const uint16_t hid_report_map_uuid    = ESP_GATT_UUID_HID_REPORT_MAP;
 static const uint16_t hid_control_point_uuid = ESP_GATT_UUID_HID_CONTROL_POINT;
 static const uint16_t hid_report_uuid = ESP_GATT_UUID_HID_REPORT;
 static const uint16_t hid_proto_mode_uuid = ESP_GATT_UUID_HID_PROTO_MODE;
+#if (SUPPORT_REPORT_KEYBOARD == true)
 static const uint16_t hid_kb_input_uuid = ESP_GATT_UUID_HID_BT_KB_INPUT;
 static const uint16_t hid_kb_output_uuid = ESP_GATT_UUID_HID_BT_KB_OUTPUT;
+#endif
+#if (SUPPORT_REPORT_MOUSE == true)
 static const uint16_t hid_mouse_input_uuid = ESP_GATT_UUID_HID_BT_MOUSE_INPUT;
+#endif
 static const uint16_t hid_repot_map_ext_desc_uuid = ESP_GATT_UUID_EXT_RPT_REF_DESCR;
 static const uint16_t hid_report_ref_descr_uuid = ESP_GATT_UUID_RPT_REF_DESCR;
 ///the propoty definition
@@ -290,7 +345,9 @@ static const uint8_t char_prop_read = ESP_GATT_CHAR_PROP_BIT_READ;
 static const uint8_t char_prop_write_nr = ESP_GATT_CHAR_PROP_BIT_WRITE_NR;
 static const uint8_t char_prop_read_write = ESP_GATT_CHAR_PROP_BIT_WRITE|ESP_GATT_CHAR_PROP_BIT_READ;
 static const uint8_t char_prop_read_notify = ESP_GATT_CHAR_PROP_BIT_READ|ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+#if (SUPPORT_REPORT_VENDOR == true)
 static const uint8_t char_prop_read_write_notify = ESP_GATT_CHAR_PROP_BIT_READ|ESP_GATT_CHAR_PROP_BIT_WRITE|ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+#endif
 
 /// battary Service
 static const uint16_t battary_svc = ESP_GATT_UUID_BATTERY_SERVICE_SVC;
@@ -369,7 +426,7 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
     // Report Map Characteristic Value
     [HIDD_LE_IDX_REPORT_MAP_VAL]     = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_map_uuid,
                                                               ESP_GATT_PERM_READ,
-                                                              HIDD_LE_REPORT_MAP_MAX_LEN, sizeof(hidReportMap),
+                                                              sizeof(hidReportMap), sizeof(hidReportMap),
                                                               (uint8_t *)&hidReportMap}},
 
     // Report Map Characteristic - External Report Reference Descriptor
@@ -384,11 +441,12 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
                                                                         CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE,
                                                                         (uint8_t *)&char_prop_read_write}},
     // Protocol Mode Characteristic Value
-    [HIDD_LE_IDX_PROTO_MODE_VAL]               = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_proto_mode_uuid,
+    [HIDD_LE_IDX_PROTO_MODE_VAL]               = {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_proto_mode_uuid,
                                                                         (ESP_GATT_PERM_READ|ESP_GATT_PERM_WRITE),
                                                                         sizeof(uint8_t), sizeof(hidProtocolMode),
                                                                         (uint8_t *)&hidProtocolMode}},
 
+#if (SUPPORT_REPORT_MOUSE == true)
     [HIDD_LE_IDX_REPORT_MOUSE_IN_CHAR]       = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid,
                                                                          ESP_GATT_PERM_READ,
                                                                          CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE,
@@ -396,7 +454,7 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
 
     [HIDD_LE_IDX_REPORT_MOUSE_IN_VAL]        = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_uuid,
                                                                        ESP_GATT_PERM_READ,
-                                                                       HIDD_LE_REPORT_MAX_LEN, 0,
+                                                                       HID_MOUSE_IN_RPT_LEN, 0,
                                                                        NULL}},
 
     [HIDD_LE_IDX_REPORT_MOUSE_IN_CCC]        = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid,
@@ -408,6 +466,8 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
                                                                        ESP_GATT_PERM_READ,
                                                                        sizeof(hidReportRefMouseIn), sizeof(hidReportRefMouseIn),
                                                                        hidReportRefMouseIn}},
+#endif
+#if (SUPPORT_REPORT_KEYBOARD == true)
     // Report Characteristic Declaration
     [HIDD_LE_IDX_REPORT_KEY_IN_CHAR]         = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid,
                                                                          ESP_GATT_PERM_READ,
@@ -416,7 +476,7 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
     // Report Characteristic Value
     [HIDD_LE_IDX_REPORT_KEY_IN_VAL]            = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_uuid,
                                                                        ESP_GATT_PERM_READ,
-                                                                       HIDD_LE_REPORT_MAX_LEN, 0,
+                                                                       HID_KEYBOARD_IN_RPT_LEN, 0,
                                                                        NULL}},
     // Report KEY INPUT Characteristic - Client Characteristic Configuration Descriptor
     [HIDD_LE_IDX_REPORT_KEY_IN_CCC]              = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid,
@@ -437,12 +497,35 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
 
     [HIDD_LE_IDX_REPORT_LED_OUT_VAL]            = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_uuid,
                                                                        ESP_GATT_PERM_READ|ESP_GATT_PERM_WRITE,
-                                                                       HIDD_LE_REPORT_MAX_LEN, 0,
+                                                                       HID_LED_OUT_RPT_LEN, 0,
                                                                        NULL}},
     [HIDD_LE_IDX_REPORT_LED_OUT_REP_REF]      =  {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_ref_descr_uuid,
                                                                        ESP_GATT_PERM_READ,
                                                                        sizeof(hidReportRefLedOut), sizeof(hidReportRefLedOut),
                                                                        hidReportRefLedOut}},
+#endif
+#if (SUPPORT_REPORT_NKRO == true)
+    // NKRO Report Characteristic Declaration
+    [HIDD_LE_IDX_REPORT_NKRO_IN_CHAR]        = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid,
+                                                                         ESP_GATT_PERM_READ,
+                                                                         CHAR_DECLARATION_SIZE, CHAR_DECLARATION_SIZE,
+                                                                         (uint8_t *)&char_prop_read_notify}},
+    // NKRO Report Characteristic Value
+    [HIDD_LE_IDX_REPORT_NKRO_IN_VAL]         = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_uuid,
+                                                                       ESP_GATT_PERM_READ,
+                                                                       HID_NKRO_IN_RPT_LEN, 0,
+                                                                       NULL}},
+    // NKRO Report Characteristic - Client Characteristic Configuration Descriptor
+    [HIDD_LE_IDX_REPORT_NKRO_IN_CCC]         = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid,
+                                                                      (ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE),
+                                                                      sizeof(uint16_t), 0,
+                                                                      NULL}},
+    // NKRO Report Characteristic - Report Reference Descriptor
+    [HIDD_LE_IDX_REPORT_NKRO_IN_REP_REF]     = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_ref_descr_uuid,
+                                                                       ESP_GATT_PERM_READ,
+                                                                       sizeof(hidReportRefNkroIn), sizeof(hidReportRefNkroIn),
+                                                                       hidReportRefNkroIn}},
+#endif
 #if (SUPPORT_REPORT_VENDOR  == true)
     // Report Characteristic Declaration
     [HIDD_LE_IDX_REPORT_VENDOR_OUT_CHAR]        = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid,
@@ -458,6 +541,7 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
                                                                        sizeof(hidReportRefVendorOut), sizeof(hidReportRefVendorOut),
                                                                        hidReportRefVendorOut}},
 #endif
+#if (SUPPORT_REPORT_CONSUMER == true)
     // Report Characteristic Declaration
     [HIDD_LE_IDX_REPORT_CC_IN_CHAR]         = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid,
                                                                          ESP_GATT_PERM_READ,
@@ -466,7 +550,7 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
     // Report Characteristic Value
     [HIDD_LE_IDX_REPORT_CC_IN_VAL]            = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&hid_report_uuid,
                                                                        ESP_GATT_PERM_READ,
-                                                                       HIDD_LE_REPORT_MAX_LEN, 0,
+                                                                       HID_CC_IN_RPT_LEN, 0,
                                                                        NULL}},
     // Report KEY INPUT Characteristic - Client Characteristic Configuration Descriptor
     [HIDD_LE_IDX_REPORT_CC_IN_CCC]              = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid,
@@ -478,7 +562,9 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
                                                                        ESP_GATT_PERM_READ,
                                                                        sizeof(hidReportRefCCIn), sizeof(hidReportRefCCIn),
                                                                        hidReportRefCCIn}},
+#endif
 
+#if (SUPPORT_REPORT_KEYBOARD == true)
     // Boot Keyboard Input Report Characteristic Declaration
     [HIDD_LE_IDX_BOOT_KB_IN_REPORT_CHAR] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid,
                                                                         ESP_GATT_PERM_READ,
@@ -505,7 +591,9 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
                                                                               (ESP_GATT_PERM_READ|ESP_GATT_PERM_WRITE),
                                                                               HIDD_LE_BOOT_REPORT_MAX_LEN, 0,
                                                                               NULL}},
+#endif
 
+#if (SUPPORT_REPORT_MOUSE == true)
     // Boot Mouse Input Report Characteristic Declaration
     [HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_CHAR] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid,
                                                                               ESP_GATT_PERM_READ,
@@ -521,6 +609,7 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
                                                                                       (ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE),
                                                                                       sizeof(uint16_t), 0,
                                                                                       NULL}},
+#endif
 
     // Report Characteristic Declaration
     [HIDD_LE_IDX_REPORT_CHAR]                    = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid,
@@ -540,6 +629,56 @@ static esp_gatts_attr_db_t hidd_le_gatt_db[HIDD_LE_IDX_NB] =
 };
 
 static void hid_add_id_tbl(void);
+static void hidd_le_log_db(void);
+
+// Features in the service, for the log.
+static const char hidd_le_features[] = ""
+#if (SUPPORT_REPORT_KEYBOARD == true)
+    " keyboard"
+#endif
+#if (SUPPORT_REPORT_NKRO == true)
+    " nkro"
+#endif
+#if (SUPPORT_REPORT_MOUSE == true)
+    " mouse"
+#endif
+#if (SUPPORT_REPORT_CONSUMER == true)
+    " consumer"
+#endif
+#if (SUPPORT_REPORT_VENDOR == true)
+    " vendor"
+#endif
+    ;
+
+// Free heap before the HID table went in, what it took is logged once the
+// stack has created it.
+static uint32_t hidd_le_db_heap;
+
+static bool hidd_le_is_kb_input(uint16_t handle)
+{
+#if (SUPPORT_REPORT_KEYBOARD == true)
+    if (handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_KEY_IN_VAL] ||
+        handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_BOOT_KB_IN_REPORT_VAL]) {
+        return true;
+    }
+#endif
+#if (SUPPORT_REPORT_NKRO == true)
+    if (handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_NKRO_IN_VAL]) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+static bool hidd_le_is_led_output(uint16_t handle)
+{
+#if (SUPPORT_REPORT_KEYBOARD == true)
+    return handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_LED_OUT_VAL] ||
+           handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_BOOT_KB_OUT_REPORT_VAL];
+#else
+    return false;
+#endif
+}
 
 void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
 									esp_ble_gatts_cb_param_t *param)
@@ -552,8 +691,9 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
             if(param->reg.app_id == HIDD_APP_ID) {
                 hidd_le_env.gatt_if = gatts_if;
                 if(hidd_le_env.hidd_cb != NULL) {
-                    (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_REG_FINISH, &hidd_param);
+                    // Tables first, so they are queued ahead of advertising.
                     hidd_le_create_service(hidd_le_env.gatt_if);
+                    (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_REG_FINISH, &hidd_param);
                 }
             }
             if(param->reg.app_id == BATTRAY_APP_ID) {
@@ -567,16 +707,32 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
             break;
         }
         case ESP_GATTS_CONF_EVT: {
+            if (hidd_le_is_kb_input(param->conf.handle)) {
+                KEY_TRACE_CONFIRMED();
+            }
+            HID_BENCH_CONFIRMED();
+            hid_dev_tx_confirm(param->conf.conn_id);
             break;
         }
+        case ESP_GATTS_MTU_EVT:
+            // Reports longer than the link carries stay unrouted until now.
+            hid_dev_conn_mtu(param->mtu.conn_id, param->mtu.mtu);
+            break;
         case ESP_GATTS_CREATE_EVT:
             break;
         case ESP_GATTS_CONNECT_EVT: {
             esp_hidd_cb_param_t cb_param = {0};
+            hidd_clcb_t *p_clcb;
 			ESP_LOGI(HID_LE_PRF_TAG, "HID connection establish, conn_id = %x",param->connect.conn_id);
 			memcpy(cb_param.connect.remote_bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
             cb_param.connect.conn_id = param->connect.conn_id;
             hidd_clcb_alloc(param->connect.conn_id, param->connect.remote_bda);
+            if ((p_clcb = hidd_clcb_find(param->connect.conn_id)) != NULL) {
+                p_clcb->connect_us = esp_timer_get_time();
+            }
+            if (hid_dev_conn_open(param->connect.conn_id) != ESP_OK) {
+                ESP_LOGE(HID_LE_PRF_TAG, "no room for conn_id %x", param->connect.conn_id);
+            }
             esp_ble_set_encryption(param->connect.remote_bda, ESP_BLE_SEC_ENCRYPT_NO_MITM);
             if(hidd_le_env.hidd_cb != NULL) {
                 (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_CONNECT, &cb_param);
@@ -584,15 +740,88 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
             break;
         }
         case ESP_GATTS_DISCONNECT_EVT: {
+            esp_hidd_cb_param_t cb_param = {0};
+            cb_param.disconnect.conn_id = param->disconnect.conn_id;
+            memcpy(cb_param.disconnect.remote_bda, param->disconnect.remote_bda, sizeof(esp_bd_addr_t));
 			 if(hidd_le_env.hidd_cb != NULL) {
-                    (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_DISCONNECT, NULL);
+                    (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_DISCONNECT, &cb_param);
              }
+            hid_dev_conn_close(param->disconnect.conn_id);
             hidd_clcb_dealloc(param->disconnect.conn_id);
             break;
         }
         case ESP_GATTS_CLOSE_EVT:
             break;
+        case ESP_GATTS_CONGEST_EVT: {
+            esp_hidd_cb_param_t cb_param = {0};
+            hidd_clcb_t *p_clcb = hidd_clcb_find(param->congest.conn_id);
+            if (p_clcb != NULL) {
+                p_clcb->congest = param->congest.congested;
+            }
+            // Let the scheduler flush what it held before the app hears of it.
+            hid_dev_tx_congest(param->congest.conn_id, param->congest.congested);
+            cb_param.congest.conn_id = param->congest.conn_id;
+            cb_param.congest.congested = param->congest.congested;
+            if(hidd_le_env.hidd_cb != NULL) {
+                (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_CONGEST, &cb_param);
+            }
+            break;
+        }
+        case ESP_GATTS_READ_EVT: {
+            // Each host reads the mode of its own link.
+            if (param->read.handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_PROTO_MODE_VAL] &&
+                param->read.need_rsp) {
+                esp_gatt_rsp_t rsp = {0};
+                rsp.attr_value.handle = param->read.handle;
+                rsp.attr_value.len = HID_PROTOCOL_MODE_LEN;
+                rsp.attr_value.value[0] = hid_dev_get_protocol_mode(param->read.conn_id);
+                esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id, ESP_GATT_OK, &rsp);
+            }
+            break;
+        }
         case ESP_GATTS_WRITE_EVT: {
+            if (param->write.handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_PROTO_MODE_VAL]) {
+                bool valid = param->write.len == HID_PROTOCOL_MODE_LEN;
+                if (param->write.need_rsp) {
+                    esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id,
+                                                valid ? ESP_GATT_OK : ESP_GATT_INVALID_ATTR_LEN, NULL);
+                }
+                if (valid && hid_dev_set_protocol_mode(param->write.conn_id, param->write.value[0]) &&
+                    hidd_le_env.hidd_cb != NULL) {
+                    esp_hidd_cb_param_t cb_param = {0};
+                    cb_param.proto_mode.conn_id = param->write.conn_id;
+                    cb_param.proto_mode.mode = param->write.value[0];
+                    (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_PROTO_MODE, &cb_param);
+                }
+                break;
+            }
+            if (hidd_le_is_led_output(param->write.handle) && param->write.len >= 1) {
+                esp_hidd_cb_param_t cb_param = {0};
+                cb_param.led_write.conn_id = param->write.conn_id;
+                cb_param.led_write.leds = param->write.value[0];
+                if(hidd_le_env.hidd_cb != NULL) {
+                    (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_LED_REPORT_WRITE, &cb_param);
+                }
+                break;
+            }
+            if (param->write.len == 2 &&
+                hid_dev_write_cccd(param->write.conn_id, param->write.handle, param->write.value[0] | (param->write.value[1] << 8))) {
+                esp_hidd_cb_param_t cb_param = {0};
+                hidd_clcb_t *p_clcb = hidd_clcb_find(param->write.conn_id);
+                // Hosts subscribe right after discovery, the last of these
+                // is about when it finished.
+                if (p_clcb != NULL) {
+                    ESP_LOGI(HID_LE_PRF_TAG, "conn_id %x cccd %d = %d, %d ms after connect", param->write.conn_id,
+                             param->write.handle, param->write.value[0], (int)((esp_timer_get_time() - p_clcb->connect_us) / 1000));
+                }
+                cb_param.cccd_write.conn_id = param->write.conn_id;
+                cb_param.cccd_write.handle = param->write.handle;
+                cb_param.cccd_write.notify = param->write.value[0] & 0x01;
+                if(hidd_le_env.hidd_cb != NULL) {
+                    (hidd_le_env.hidd_cb)(ESP_HIDD_EVENT_BLE_CCCD_WRITE, &cb_param);
+                }
+                break;
+            }
 #if (SUPPORT_REPORT_VENDOR == true)
             esp_hidd_cb_param_t cb_param = {0};
             if (param->write.handle == hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_VENDOR_OUT_VAL] &&
@@ -614,6 +843,7 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
                 incl_svc.end_hdl = incl_svc.start_hdl + BAS_IDX_NB -1;
                 ESP_LOGI(HID_LE_PRF_TAG, "%s(), start added the hid service to the stack database. incl_handle = %d",
                            __func__, incl_svc.start_hdl);
+                hidd_le_db_heap = esp_get_free_heap_size();
                 esp_ble_gatts_create_attr_tab(hidd_le_gatt_db, gatts_if, HIDD_LE_IDX_NB, 0);
             }
             if (param->add_attr_tab.num_handle == HIDD_LE_IDX_NB &&
@@ -621,6 +851,8 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
                 memcpy(hidd_le_env.hidd_inst.att_tbl, param->add_attr_tab.handles,
                             HIDD_LE_IDX_NB*sizeof(uint16_t));
                 ESP_LOGI(HID_LE_PRF_TAG, "hid svc handle = %x",hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_SVC]);
+                boot_time_mark(BOOT_HID_DB);
+                hidd_le_log_db();
                 hid_add_id_tbl();
 		        esp_ble_gatts_start_service(hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_SVC]);
             } else {
@@ -634,6 +866,19 @@ void esp_hidd_prf_cb_hdl(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if,
     }
 }
 
+// What a host has to discover and what the table costs, per configuration.
+static void hidd_le_log_db(void)
+{
+    uint32_t values = 0;
+
+    for (int i = 0; i < HIDD_LE_IDX_NB; i++) {
+        values += hidd_le_gatt_db[i].att_desc.max_length;
+    }
+    ESP_LOGI(HID_LE_PRF_TAG, "hid svc:%s, %d attributes, %d reports, %u byte report map, %u bytes of values, %d bytes of heap",
+             hidd_le_features, HIDD_LE_IDX_NB, HID_NUM_REPORTS, (unsigned)sizeof(hidReportMap), values,
+             (int)(hidd_le_db_heap - esp_get_free_heap_size()));
+}
+
 void hidd_le_create_service(esp_gatt_if_t gatts_if)
 {
     /* Here should added the battery service first, because the hid service should include the battery service.
@@ -666,14 +911,30 @@ void hidd_clcb_alloc (uint16_t conn_id, esp_bd_addr_t bda)
     return;
 }
 
+hidd_clcb_t *hidd_clcb_find (uint16_t conn_id)
+{
+    uint8_t              i_clcb = 0;
+    hidd_clcb_t      *p_clcb = NULL;
+
+    for (i_clcb = 0, p_clcb= hidd_le_env.hidd_clcb; i_clcb < HID_MAX_APPS; i_clcb++, p_clcb++) {
+        if (p_clcb->in_use && p_clcb->conn_id == conn_id) {
+            return p_clcb;
+        }
+    }
+
+    return NULL;
+}
+
 bool hidd_clcb_dealloc (uint16_t conn_id)
 {
     uint8_t              i_clcb = 0;
     hidd_clcb_t      *p_clcb = NULL;
 
     for (i_clcb = 0, p_clcb= hidd_le_env.hidd_clcb; i_clcb < HID_MAX_APPS; i_clcb++, p_clcb++) {
+        if (p_clcb->in_use && p_clcb->conn_id == conn_id) {
             memset(p_clcb, 0, sizeof(hidd_clcb_t));
             return true;
+        }
     }
 
     return false;
@@ -748,69 +1009,76 @@ void hidd_get_attr_value(uint16_t handle, uint16_t *length, uint8_t **value)
     return;
 }
 
-static void hid_add_id_tbl(void)
+// Append one report to the mapping table, cccd is 0 for reports that are
+// not notified. A report HID_NUM_REPORTS does not count is left out.
+static uint8_t hid_add_rpt(uint8_t n, const uint8_t *ref, uint16_t handle, uint16_t cccd, uint8_t mode)
 {
-     // Mouse input report
-      hid_rpt_map[0].id = hidReportRefMouseIn[0];
-      hid_rpt_map[0].type = hidReportRefMouseIn[1];
-      hid_rpt_map[0].handle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_MOUSE_IN_VAL];
-      hid_rpt_map[0].cccdHandle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_MOUSE_IN_VAL];
-      hid_rpt_map[0].mode = HID_PROTOCOL_MODE_REPORT;
-
-      // Key input report
-      hid_rpt_map[1].id = hidReportRefKeyIn[0];
-      hid_rpt_map[1].type = hidReportRefKeyIn[1];
-      hid_rpt_map[1].handle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_KEY_IN_VAL];
-      hid_rpt_map[1].cccdHandle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_KEY_IN_CCC];
-      hid_rpt_map[1].mode = HID_PROTOCOL_MODE_REPORT;
-
-      // Consumer Control input report
-      hid_rpt_map[2].id = hidReportRefCCIn[0];
-      hid_rpt_map[2].type = hidReportRefCCIn[1];
-      hid_rpt_map[2].handle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_CC_IN_VAL];
-      hid_rpt_map[2].cccdHandle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_CC_IN_CCC];
-      hid_rpt_map[2].mode = HID_PROTOCOL_MODE_REPORT;
-
-      // LED output report
-      hid_rpt_map[3].id = hidReportRefLedOut[0];
-      hid_rpt_map[3].type = hidReportRefLedOut[1];
-      hid_rpt_map[3].handle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_LED_OUT_VAL];
-      hid_rpt_map[3].cccdHandle = 0;
-      hid_rpt_map[3].mode = HID_PROTOCOL_MODE_REPORT;
-
-      // Boot keyboard input report
-      // Use same ID and type as key input report
-      hid_rpt_map[4].id = hidReportRefKeyIn[0];
-      hid_rpt_map[4].type = hidReportRefKeyIn[1];
-      hid_rpt_map[4].handle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_BOOT_KB_IN_REPORT_VAL];
-      hid_rpt_map[4].cccdHandle = 0;
-      hid_rpt_map[4].mode = HID_PROTOCOL_MODE_BOOT;
-
-      // Boot keyboard output report
-      // Use same ID and type as LED output report
-      hid_rpt_map[5].id = hidReportRefLedOut[0];
-      hid_rpt_map[5].type = hidReportRefLedOut[1];
-      hid_rpt_map[5].handle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_BOOT_KB_OUT_REPORT_VAL];
-      hid_rpt_map[5].cccdHandle = 0;
-      hid_rpt_map[5].mode = HID_PROTOCOL_MODE_BOOT;
-
-      // Boot mouse input report
-      // Use same ID and type as mouse input report
-      hid_rpt_map[6].id = hidReportRefMouseIn[0];
-      hid_rpt_map[6].type = hidReportRefMouseIn[1];
-      hid_rpt_map[6].handle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_VAL];
-      hid_rpt_map[6].cccdHandle = 0;
-      hid_rpt_map[6].mode = HID_PROTOCOL_MODE_BOOT;
-
-      // Feature report
-      hid_rpt_map[7].id = hidReportRefFeature[0];
-      hid_rpt_map[7].type = hidReportRefFeature[1];
-      hid_rpt_map[7].handle = hidd_le_env.hidd_inst.att_tbl[HIDD_LE_IDX_REPORT_VAL];
-      hid_rpt_map[7].cccdHandle = 0;
-      hid_rpt_map[7].mode = HID_PROTOCOL_MODE_REPORT;
-
-
-  // Setup report ID map
-  hid_dev_register_reports(HID_NUM_REPORTS, hid_rpt_map);
+    if (n >= HID_NUM_REPORTS) {
+        ESP_LOGE(HID_LE_PRF_TAG, "%s(), report id %d type %d past HID_NUM_REPORTS", __func__, ref[0], ref[1]);
+        return n + 1;
+    }
+    hid_rpt_map[n].id = ref[0];
+    hid_rpt_map[n].type = ref[1];
+    hid_rpt_map[n].handle = handle;
+    hid_rpt_map[n].cccdHandle = cccd;
+    hid_rpt_map[n].mode = mode;
+    return n + 1;
 }
 
+static void hid_add_id_tbl(void)
+{
+    uint16_t *att_tbl = hidd_le_env.hidd_inst.att_tbl;
+    uint8_t n = 0;
+
+    // Saved CCCD state is keyed by report id, type and mode, not by the
+    // position of an entry here.
+#if (SUPPORT_REPORT_MOUSE == true)
+    // Mouse input report
+    n = hid_add_rpt(n, hidReportRefMouseIn, att_tbl[HIDD_LE_IDX_REPORT_MOUSE_IN_VAL],
+                    att_tbl[HIDD_LE_IDX_REPORT_MOUSE_IN_CCC], HID_PROTOCOL_MODE_REPORT);
+#endif
+#if (SUPPORT_REPORT_KEYBOARD == true)
+    // Key input report
+    n = hid_add_rpt(n, hidReportRefKeyIn, att_tbl[HIDD_LE_IDX_REPORT_KEY_IN_VAL],
+                    att_tbl[HIDD_LE_IDX_REPORT_KEY_IN_CCC], HID_PROTOCOL_MODE_REPORT);
+#endif
+#if (SUPPORT_REPORT_CONSUMER == true)
+    // Consumer Control input report
+    n = hid_add_rpt(n, hidReportRefCCIn, att_tbl[HIDD_LE_IDX_REPORT_CC_IN_VAL],
+                    att_tbl[HIDD_LE_IDX_REPORT_CC_IN_CCC], HID_PROTOCOL_MODE_REPORT);
+#endif
+#if (SUPPORT_REPORT_KEYBOARD == true)
+    // LED output report
+    n = hid_add_rpt(n, hidReportRefLedOut, att_tbl[HIDD_LE_IDX_REPORT_LED_OUT_VAL],
+                    0, HID_PROTOCOL_MODE_REPORT);
+
+    // Boot keyboard input report
+    // Use same ID and type as key input report
+    n = hid_add_rpt(n, hidReportRefKeyIn, att_tbl[HIDD_LE_IDX_BOOT_KB_IN_REPORT_VAL],
+                    att_tbl[HIDD_LE_IDX_BOOT_KB_IN_REPORT_NTF_CFG], HID_PROTOCOL_MODE_BOOT);
+
+    // Boot keyboard output report
+    // Use same ID and type as LED output report
+    n = hid_add_rpt(n, hidReportRefLedOut, att_tbl[HIDD_LE_IDX_BOOT_KB_OUT_REPORT_VAL],
+                    0, HID_PROTOCOL_MODE_BOOT);
+#endif
+#if (SUPPORT_REPORT_MOUSE == true)
+    // Boot mouse input report
+    // Use same ID and type as mouse input report
+    n = hid_add_rpt(n, hidReportRefMouseIn, att_tbl[HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_VAL],
+                    att_tbl[HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_NTF_CFG], HID_PROTOCOL_MODE_BOOT);
+#endif
+    // Feature report
+    n = hid_add_rpt(n, hidReportRefFeature, att_tbl[HIDD_LE_IDX_REPORT_VAL],
+                    0, HID_PROTOCOL_MODE_REPORT);
+#if (SUPPORT_REPORT_NKRO == true)
+    // NKRO key input report
+    n = hid_add_rpt(n, hidReportRefNkroIn, att_tbl[HIDD_LE_IDX_REPORT_NKRO_IN_VAL],
+                    att_tbl[HIDD_LE_IDX_REPORT_NKRO_IN_CCC], HID_PROTOCOL_MODE_REPORT);
+#endif
+
+    // HID_NUM_REPORTS has to follow the SUPPORT_REPORT_* blocks above.
+    assert(n == HID_NUM_REPORTS);
+    // Setup report ID map
+    hid_dev_register_reports(n < HID_NUM_REPORTS ? n : HID_NUM_REPORTS, hid_rpt_map);
+}
@@ -23,7 +23,27 @@
 #include "esp_gap_ble_api.h"
 #include "hid_dev.h"
 
+// Reports the HID service is built with. Each one brings its part of the
+// report map, its characteristics and its report mapping entries, so a
+// device without a mouse does not make hosts discover one. Override with
+// target_compile_definitions in main/CMakeLists.txt.
+#ifndef SUPPORT_REPORT_KEYBOARD
+#define SUPPORT_REPORT_KEYBOARD               true    // 6KRO, boot keyboard and LED output
+#endif
+#ifndef SUPPORT_REPORT_NKRO
+#define SUPPORT_REPORT_NKRO                   true    // NKRO bitmap, needs the keyboard
+#endif
+#ifndef SUPPORT_REPORT_MOUSE
+#define SUPPORT_REPORT_MOUSE                  true    // Report and boot mouse
+#endif
+#ifndef SUPPORT_REPORT_CONSUMER
+#define SUPPORT_REPORT_CONSUMER               true
+#endif
 #define SUPPORT_REPORT_VENDOR                 false
+
+#if (SUPPORT_REPORT_NKRO == true) && (SUPPORT_REPORT_KEYBOARD != true)
+#error "The NKRO report falls back to the keyboard report and shares its LED output"
+#endif
 //HID BLE profile log tag
 #define HID_LE_PRF_TAG                        "HID_LE_PRF"
 
@@ -38,18 +58,24 @@
 #define HIDD_SUB_VER     0x00  //Version + Subversion
 #define HIDD_VERSION     ((HIDD_GREAT_VER<<8)|HIDD_SUB_VER)  //Version + Subversion
 
-#define HID_MAX_APPS                 1
+// Hosts connected at once, within CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#define HID_MAX_APPS                 3
 
-// Number of HID reports defined in the service
-#define HID_NUM_REPORTS          9
+// Number of HID reports defined in the service: the feature report, the
+// keyboard's input, LED output and boot input/output, the report and boot
+// mouse inputs, consumer control and NKRO.
+#define HID_NUM_REPORTS          (1 + 4 * (SUPPORT_REPORT_KEYBOARD == true) + 2 * (SUPPORT_REPORT_MOUSE == true) + \
+                                  (SUPPORT_REPORT_CONSUMER == true) + (SUPPORT_REPORT_NKRO == true))
 
 // HID Report IDs for the service
 #define HID_RPT_ID_MOUSE_IN      1   // Mouse input report ID
 #define HID_RPT_ID_KEY_IN        2   // Keyboard input report ID
 #define HID_RPT_ID_CC_IN         3   //Consumer Control input report ID
 #define HID_RPT_ID_VENDOR_OUT    4   // Vendor output report ID
+#define HID_RPT_ID_NKRO_IN       5   // N-key rollover keyboard input report ID
 #define HID_RPT_ID_LED_OUT       0  // LED output report ID
 #define HID_RPT_ID_FEATURE       0  // Feature report ID
+#define HID_RPT_ID_MAX           6   // Report IDs are below this
 
 #define HIDD_APP_ID			0x1812//ATT_SVC_HID
 
@@ -128,11 +154,14 @@ enum {
     HIDD_LE_IDX_PROTO_MODE_CHAR,
     HIDD_LE_IDX_PROTO_MODE_VAL,
 
+#if (SUPPORT_REPORT_MOUSE == true)
     // Report mouse input
     HIDD_LE_IDX_REPORT_MOUSE_IN_CHAR,
     HIDD_LE_IDX_REPORT_MOUSE_IN_VAL,
     HIDD_LE_IDX_REPORT_MOUSE_IN_CCC,
     HIDD_LE_IDX_REPORT_MOUSE_REP_REF,
+#endif
+#if (SUPPORT_REPORT_KEYBOARD == true)
     //Report Key input
     HIDD_LE_IDX_REPORT_KEY_IN_CHAR,
     HIDD_LE_IDX_REPORT_KEY_IN_VAL,
@@ -142,18 +171,27 @@ enum {
     HIDD_LE_IDX_REPORT_LED_OUT_CHAR,
     HIDD_LE_IDX_REPORT_LED_OUT_VAL,
     HIDD_LE_IDX_REPORT_LED_OUT_REP_REF,
-
+#endif
+#if (SUPPORT_REPORT_NKRO == true)
+    /// Report NKRO keyboard input
+    HIDD_LE_IDX_REPORT_NKRO_IN_CHAR,
+    HIDD_LE_IDX_REPORT_NKRO_IN_VAL,
+    HIDD_LE_IDX_REPORT_NKRO_IN_CCC,
+    HIDD_LE_IDX_REPORT_NKRO_IN_REP_REF,
+#endif
 #if (SUPPORT_REPORT_VENDOR  == true)
     /// Report Vendor
     HIDD_LE_IDX_REPORT_VENDOR_OUT_CHAR,
     HIDD_LE_IDX_REPORT_VENDOR_OUT_VAL,
     HIDD_LE_IDX_REPORT_VENDOR_OUT_REP_REF,
 #endif
+#if (SUPPORT_REPORT_CONSUMER == true)
     HIDD_LE_IDX_REPORT_CC_IN_CHAR,
     HIDD_LE_IDX_REPORT_CC_IN_VAL,
     HIDD_LE_IDX_REPORT_CC_IN_CCC,
     HIDD_LE_IDX_REPORT_CC_IN_REP_REF,
-    
+#endif
+#if (SUPPORT_REPORT_KEYBOARD == true)
     // Boot Keyboard Input Report
     HIDD_LE_IDX_BOOT_KB_IN_REPORT_CHAR,
     HIDD_LE_IDX_BOOT_KB_IN_REPORT_VAL,
@@ -162,11 +200,13 @@ enum {
     // Boot Keyboard Output Report
     HIDD_LE_IDX_BOOT_KB_OUT_REPORT_CHAR,
     HIDD_LE_IDX_BOOT_KB_OUT_REPORT_VAL,
-
+#endif
+#if (SUPPORT_REPORT_MOUSE == true)
     // Boot Mouse Input Report
     HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_CHAR,
     HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_VAL,
     HIDD_LE_IDX_BOOT_MOUSE_IN_REPORT_NTF_CFG,
+#endif
 
     // Report
     HIDD_LE_IDX_REPORT_CHAR,
@@ -260,6 +300,7 @@ typedef struct {
     esp_bd_addr_t         remote_bda;
     uint32_t                  trans_id;
     uint8_t                    cur_srvc_id;
+    int64_t                   connect_us;
 
 } hidd_clcb_t;
 
@@ -324,11 +365,12 @@ typedef struct {
 } hidd_le_env_t;
 
 extern hidd_le_env_t hidd_le_env;
-extern uint8_t hidProtocolMode;
 
 
 void hidd_clcb_alloc (uint16_t conn_id, esp_bd_addr_t bda);
 
+hidd_clcb_t *hidd_clcb_find (uint16_t conn_id);
+
 bool hidd_clcb_dealloc (uint16_t conn_id);
 
 void hidd_le_create_service(esp_gatt_if_t gatts_if);
@@ -0,0 +1,53 @@
+#include "kbd_leds.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "lighting.h"
+
+static portMUX_TYPE lock=portMUX_INITIALIZER_UNLOCKED;
+static int led_gpio=-1;
+static bool local;
+static kbd_leds_stats_t stats;
+
+// Only a register write, cheap enough for the BTC task and the critical section.
+static void kbd_leds_apply(void){
+	gpio_set_level(led_gpio,local || (stats.leds&KBD_LEDS_SHOWN));
+}
+
+esp_err_t kbd_leds_init(int gpio){
+	gpio_pad_select_gpio(gpio);
+	esp_err_t err=gpio_set_direction(gpio,GPIO_MODE_OUTPUT);
+	if(err!=ESP_OK)return err;
+	led_gpio=gpio;
+	kbd_leds_apply();
+	return ESP_OK;
+}
+
+void kbd_leds_host(uint8_t leds, int64_t write_us){
+	if(led_gpio<0)return;
+	portENTER_CRITICAL(&lock);
+	stats.leds=leds;
+	kbd_leds_apply();
+	portEXIT_CRITICAL(&lock);
+	lighting_locks(leds);
+	if(!write_us)return;
+	uint32_t us=esp_timer_get_time()-write_us;
+	portENTER_CRITICAL(&lock);
+	stats.writes++;
+	if(us>stats.max_us)stats.max_us=us;
+	portEXIT_CRITICAL(&lock);
+}
+
+void kbd_leds_local(bool on){
+	if(led_gpio<0)return;
+	portENTER_CRITICAL(&lock);
+	local=on;
+	kbd_leds_apply();
+	portEXIT_CRITICAL(&lock);
+}
+
+void kbd_leds_get_stats(kbd_leds_stats_t *out){
+	portENTER_CRITICAL(&lock);
+	*out=stats;
+	portEXIT_CRITICAL(&lock);
+}
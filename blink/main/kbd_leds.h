@@ -0,0 +1,38 @@
+#ifndef KBD_LEDS_H__
+#define KBD_LEDS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Bits of the keyboard LED output report.
+#define KBD_LED_NUM_LOCK    (1<<0)
+#define KBD_LED_CAPS_LOCK   (1<<1)
+#define KBD_LED_SCROLL_LOCK (1<<2)
+#define KBD_LED_COMPOSE     (1<<3)
+#define KBD_LED_KANA        (1<<4)
+
+// Host LED bits shown on the indicator.
+#define KBD_LEDS_SHOWN KBD_LED_CAPS_LOCK
+
+typedef struct {
+	uint8_t leds;        // last state the active host wrote
+	uint32_t writes;     // host writes applied
+	uint32_t max_us;     // longest GATT write to GPIO time seen
+} kbd_leds_stats_t;
+
+// The indicator is lit while either the local owner asks for it or the host
+// has one of KBD_LEDS_SHOWN set.
+esp_err_t kbd_leds_init(int gpio);
+
+// LED state of the active host, applied right away and handed on to the
+// strip. Callable from any task,
+// write_us is the esp_timer time the write arrived, 0 if unknown.
+void kbd_leds_host(uint8_t leds, int64_t write_us);
+
+// Local use of the indicator, the push button lights it while held.
+void kbd_leds_local(bool on);
+
+void kbd_leds_get_stats(kbd_leds_stats_t *out);
+
+#endif /* KBD_LEDS_H__ */
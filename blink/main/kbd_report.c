@@ -0,0 +1,68 @@
+#include "kbd_report.h"
+#include <string.h>
+
+static bool kbd_state_has(const kbd_state_t *s, uint8_t key){
+	if(key<=KBD_NKRO_LAST)return s->bits[key>>3] & (1<<(key&7));
+	for(int i=0;i<s->num_keys;i++)if(s->keys[i]==key)return true;
+	return false;
+}
+
+// Give a slot that just freed up to a key held past the sixth, so hosts
+// on the 6KRO report see it too.
+static void kbd_state_refill(kbd_state_t *s){
+	for(int b=0;b<0xE0/8;b++){
+		for(uint8_t bits=s->bits[b];bits;bits&=bits-1){
+			uint8_t key=b*8+__builtin_ctz(bits);
+			if(!memchr(s->keys,key,s->num_keys)){
+				s->keys[s->num_keys++]=key;
+				return;
+			}
+		}
+	}
+}
+
+void kbd_report_init(kbd_report_t *r, kbd_report_send_t send){
+	memset(r,0,sizeof(*r));
+	r->send=send;
+}
+
+bool kbd_report_apply(kbd_report_t *r, uint8_t key, bool down){
+	kbd_state_t *s=&r->cur;
+	if(kbd_state_has(s,key)!=kbd_state_has(&r->sent,key))kbd_report_flush(r);
+
+	if(key<=KBD_NKRO_LAST){
+		if(down)s->bits[key>>3]|=1<<(key&7);
+		else s->bits[key>>3]&=~(1<<(key&7));
+	}
+	if(KBD_IS_MODIFIER(key)){
+		if(down)s->mods|=KBD_MODIFIER_BIT(key);
+		else s->mods&=~KBD_MODIFIER_BIT(key);
+		return true;
+	}
+
+	int i;
+	for(i=0;i<s->num_keys && s->keys[i]!=key;i++);
+	if(down){
+		if(i<s->num_keys)return true;
+		if(s->num_keys==KBD_REPORT_KEYS)return false;
+		s->keys[s->num_keys++]=key;
+	}else if(i<s->num_keys){
+		bool full=s->num_keys==KBD_REPORT_KEYS;
+		// Keep the remaining keys in press order.
+		memmove(&s->keys[i],&s->keys[i+1],s->num_keys-i-1);
+		s->keys[--s->num_keys]=0;
+		if(full)kbd_state_refill(s);
+	}
+	return true;
+}
+
+void kbd_report_flush(kbd_report_t *r){
+	if(!memcmp(&r->cur,&r->sent,sizeof(kbd_state_t)))return;
+	r->send(&r->cur);
+	r->sent=r->cur;
+}
+
+void kbd_report_resync(kbd_report_t *r){
+	r->send(&r->cur);
+	r->sent=r->cur;
+}
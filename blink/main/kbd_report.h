@@ -0,0 +1,50 @@
+#ifndef KBD_REPORT_H__
+#define KBD_REPORT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KBD_REPORT_KEYS 6
+
+// Usages 0xE0-0xE7 are the modifiers, in the same order as the modifier byte.
+#define KBD_IS_MODIFIER(key) ((key)>=0xE0 && (key)<=0xE7)
+#define KBD_MODIFIER_BIT(key) (1<<((key)-0xE0))
+
+// The NKRO bitmap has a bit for every usage up to the last modifier.
+#define KBD_NKRO_LAST 0xE7
+#define KBD_NKRO_BYTES ((KBD_NKRO_LAST+8)/8)
+
+// Keyboard state in the layouts of both input reports, the 8 byte 6KRO one
+// and the NKRO bitmap.
+typedef struct {
+	uint8_t mods;                  // LEFT_CONTROL_KEY_MASK ... RIGHT_GUI_KEY_MASK
+	uint8_t keys[KBD_REPORT_KEYS]; // first six pressed keys in press order, zero padded
+	uint8_t num_keys;
+	uint8_t bits[KBD_NKRO_BYTES];  // every pressed key, usage n in bit n%8 of byte n/8
+} kbd_state_t;
+
+typedef void (*kbd_report_send_t)(const kbd_state_t *state);
+
+// Folds key events into one keyboard state and only reports real changes.
+typedef struct {
+	kbd_state_t cur;  // state after every applied event
+	kbd_state_t sent; // state the host last saw
+	kbd_report_send_t send;
+} kbd_report_t;
+
+void kbd_report_init(kbd_report_t *r, kbd_report_send_t send);
+
+// Apply one press/release. If the event would undo a change the host has
+// not seen yet (press and release in one drain), the pending state is sent
+// first so the keystroke is not lost. Returns false if all six slots are
+// taken, the key is then only in the bitmap until a slot frees up.
+bool kbd_report_apply(kbd_report_t *r, uint8_t key, bool down);
+
+// Send the current state if it differs from what the host last saw.
+void kbd_report_flush(kbd_report_t *r);
+
+// Send the full state, even if unchanged. For a switch to a host that has
+// not seen any of it.
+void kbd_report_resync(kbd_report_t *r);
+
+#endif /* KBD_REPORT_H__ */
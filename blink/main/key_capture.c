@@ -0,0 +1,30 @@
+#include "key_capture.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+
+static QueueHandle_t key_edges;
+
+static void IRAM_ATTR key_capture_isr(void *arg){
+	gpio_num_t gpio=(gpio_num_t)(uintptr_t)arg;
+	key_edge_t edge={
+		.time_us=esp_timer_get_time(),
+		.gpio=gpio,
+		.level=gpio_get_level(gpio),
+	};
+	BaseType_t woken=pdFALSE;
+	// A full queue drops the edge, the reader resyncs from the pin level.
+	xQueueSendFromISR(key_edges,&edge,&woken);
+	if(woken)portYIELD_FROM_ISR();
+}
+
+QueueHandle_t key_capture_init(UBaseType_t depth){
+	key_edges=xQueueCreate(depth,sizeof(key_edge_t));
+	ESP_ERROR_CHECK(gpio_install_isr_service(0));
+	return key_edges;
+}
+
+esp_err_t key_capture_add(gpio_num_t gpio){
+	esp_err_t ret=gpio_set_intr_type(gpio,GPIO_INTR_ANYEDGE);
+	if(ret)return ret;
+	return gpio_isr_handler_add(gpio,key_capture_isr,(void*)(uintptr_t)gpio);
+}
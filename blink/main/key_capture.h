@@ -0,0 +1,23 @@
+#ifndef KEY_CAPTURE_H__
+#define KEY_CAPTURE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/gpio.h"
+
+// One edge on a key input, stamped inside the GPIO ISR.
+typedef struct {
+	int64_t time_us; // esp_timer_get_time() when the edge fired
+	uint8_t gpio;
+	bool level;      // pin level read in the ISR
+} key_edge_t;
+
+// Create the edge queue and install the GPIO ISR service.
+QueueHandle_t key_capture_init(UBaseType_t depth);
+
+// Start capturing both edges of an input pin into the edge queue.
+esp_err_t key_capture_add(gpio_num_t gpio);
+
+#endif /* KEY_CAPTURE_H__ */
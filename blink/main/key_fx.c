@@ -0,0 +1,128 @@
+#include "key_fx.h"
+#include <string.h>
+#include "apa102_frame.h"
+
+// Colours as 8 bit channel weights.
+typedef struct { uint8_t r, g, b; } key_fx_rgb_t;
+static const key_fx_rgb_t key_colour={96,160,255};
+static const key_fx_rgb_t ripple_colour={64,0,255};
+static const key_fx_rgb_t lock_colour={255,96,0};
+
+// Perceptual to PWM, gamma 2.2.
+static const uint8_t gamma8[256]={
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,
+	  1,  1,  1,  1,  1,  1,  1,  1,  1,  2,  2,  2,  2,  2,  2,  2,
+	  3,  3,  3,  3,  3,  4,  4,  4,  4,  5,  5,  5,  5,  6,  6,  6,
+	  6,  7,  7,  7,  8,  8,  8,  9,  9,  9, 10, 10, 11, 11, 11, 12,
+	 12, 13, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19,
+	 20, 20, 21, 22, 22, 23, 23, 24, 25, 25, 26, 26, 27, 28, 28, 29,
+	 30, 30, 31, 32, 33, 33, 34, 35, 35, 36, 37, 38, 39, 39, 40, 41,
+	 42, 43, 43, 44, 45, 46, 47, 48, 49, 49, 50, 51, 52, 53, 54, 55,
+	 56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+	 73, 74, 75, 76, 77, 78, 79, 81, 82, 83, 84, 85, 87, 88, 89, 90,
+	 91, 93, 94, 95, 97, 98, 99,100,102,103,105,106,107,109,110,111,
+	113,114,116,117,119,120,121,123,124,126,127,129,130,132,133,135,
+	137,138,140,141,143,145,146,148,149,151,153,154,156,158,159,161,
+	163,165,166,168,170,172,173,175,177,179,181,182,184,186,188,190,
+	192,194,196,197,199,201,203,205,207,209,211,213,215,217,219,221,
+	223,225,227,229,231,234,236,238,240,242,244,246,248,251,253,255,
+};
+
+void key_fx_set_brightness(key_fx_t *fx, uint8_t brightness){
+	for(int i=0;i<256;i++)fx->lut[i]=(gamma8[i]*brightness+127)/255;
+}
+
+void key_fx_init(key_fx_t *fx, uint16_t num_leds, uint8_t brightness){
+	memset(fx,0,sizeof(*fx));
+	fx->num_leds=num_leds<KEY_FX_MAX_LEDS?num_leds:KEY_FX_MAX_LEDS;
+	key_fx_set_brightness(fx,brightness);
+}
+
+void key_fx_key(key_fx_t *fx, uint16_t led, bool down, uint32_t now_ms){
+	if(led>=fx->num_leds)return;
+	if(!down){
+		fx->held[led/8]&=~(1<<(led%8));
+		return;
+	}
+	fx->held[led/8]|=1<<(led%8);
+	fx->heat[led]=255;
+	// Oldest ripple makes room for the new one.
+	key_fx_ripple_t *r=&fx->ripple[fx->next_ripple];
+	fx->next_ripple=(fx->next_ripple+1)%KEY_FX_RIPPLES;
+	r->origin=led;
+	r->start_ms=now_ms;
+	r->active=true;
+}
+
+void key_fx_locks(key_fx_t *fx, uint8_t locks){
+	fx->locks=locks;
+}
+
+static inline uint8_t key_fx_scale(uint8_t v, uint8_t w){
+	return (v*w+255)>>8;
+}
+
+static inline uint8_t key_fx_add(uint8_t a, uint8_t b){
+	return a+b>255?255:a+b;
+}
+
+bool key_fx_render(key_fx_t *fx, uint8_t *frame, uint32_t now_ms){
+	// Frames stop while idle, the time since then is not fade time. A key
+	// released after being held through it starts fading now.
+	uint32_t dt=fx->idle?0:now_ms-fx->last_ms;
+	fx->last_ms=now_ms;
+	uint32_t decay=dt*255/KEY_FX_FADE_MS;
+	if(decay>255)decay=255;
+	bool moving=false;
+
+	// Per ripple: ring radius and fade in 1/256 LED, worked out once.
+	int32_t radius[KEY_FX_RIPPLES];
+	uint8_t fade[KEY_FX_RIPPLES];
+	for(int k=0;k<KEY_FX_RIPPLES;k++){
+		key_fx_ripple_t *r=&fx->ripple[k];
+		uint32_t age=now_ms-r->start_ms;
+		if(r->active && age>=KEY_FX_RIPPLE_MS)r->active=false;
+		if(!r->active)continue;
+		radius[k]=age*KEY_FX_RIPPLE_LEDS_PER_S*256/1000;
+		fade[k]=255-age*255/KEY_FX_RIPPLE_MS;
+		moving=true;
+	}
+
+	uint16_t lock_base=fx->num_leds>=KEY_FX_LOCK_LEDS?fx->num_leds-KEY_FX_LOCK_LEDS:0;
+	for(uint16_t i=0;i<fx->num_leds;i++){
+		uint8_t r=0, g=0, b=0;
+
+		uint8_t h=fx->heat[i];
+		if(h && !(fx->held[i/8]&(1<<(i%8)))){
+			fx->heat[i]=h=h>decay?h-decay:0;
+			moving|=h!=0;
+		}
+		if(h){
+			r=key_fx_scale(h,key_colour.r);
+			g=key_fx_scale(h,key_colour.g);
+			b=key_fx_scale(h,key_colour.b);
+		}
+
+		for(int k=0;k<KEY_FX_RIPPLES;k++){
+			if(!fx->ripple[k].active)continue;
+			int32_t d=((int32_t)i-fx->ripple[k].origin)*256;
+			int32_t diff=(d<0?-d:d)-radius[k];
+			if(diff<0)diff=-diff;
+			if(diff>=(256<<KEY_FX_RIPPLE_WIDTH_SHIFT))continue;
+			uint8_t a=key_fx_scale(255-(diff>>KEY_FX_RIPPLE_WIDTH_SHIFT),fade[k]);
+			r=key_fx_add(r,key_fx_scale(a,ripple_colour.r));
+			g=key_fx_add(g,key_fx_scale(a,ripple_colour.g));
+			b=key_fx_add(b,key_fx_scale(a,ripple_colour.b));
+		}
+
+		if(i>=lock_base && (fx->locks&(1<<(i-lock_base)))){
+			r=key_fx_add(r,lock_colour.r);
+			g=key_fx_add(g,lock_colour.g);
+			b=key_fx_add(b,lock_colour.b);
+		}
+
+		apa102_frame_set(frame,i,fx->lut[r],fx->lut[g],fx->lut[b],APA102_BRIGHTNESS_MAX);
+	}
+	fx->idle=!moving;
+	return moving;
+}
@@ -0,0 +1,51 @@
+#ifndef KEY_FX_H__
+#define KEY_FX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Reactive lighting, rendered straight into an APA102 frame. Everything is
+// 8 bit fixed point and the per LED work is bounded by KEY_FX_RIPPLES, so
+// the cost of a frame only depends on the number of LEDs.
+#define KEY_FX_MAX_LEDS    256
+#define KEY_FX_RIPPLES     4
+#define KEY_FX_FADE_MS     500   // glow of a released key
+#define KEY_FX_RIPPLE_MS   800   // lifetime of a ripple
+#define KEY_FX_RIPPLE_LEDS_PER_S 24
+#define KEY_FX_RIPPLE_WIDTH_SHIFT 1 // ring is 2 LEDs wide on either side
+// Lock indicators take the last LEDs of the strip: Num, Caps, Scroll.
+#define KEY_FX_LOCK_LEDS   3
+
+typedef struct {
+	uint16_t origin;
+	uint32_t start_ms;
+	bool active;
+} key_fx_ripple_t;
+
+typedef struct {
+	uint16_t num_leds;
+	uint8_t locks;                    // KBD_LED_* bits of the active host
+	uint32_t last_ms;
+	bool idle;                        // last frame had nothing moving
+	uint8_t heat[KEY_FX_MAX_LEDS];    // 255 while held, then fades
+	uint8_t held[KEY_FX_MAX_LEDS/8];
+	key_fx_ripple_t ripple[KEY_FX_RIPPLES];
+	uint8_t next_ripple;
+	uint8_t lut[256];                 // gamma then master brightness
+} key_fx_t;
+
+void key_fx_init(key_fx_t *fx, uint16_t num_leds, uint8_t brightness);
+
+// Master brightness 0-255, folded into the output lookup table.
+void key_fx_set_brightness(key_fx_t *fx, uint8_t brightness);
+
+// A key under LED led went down or up. A press also starts a ripple.
+void key_fx_key(key_fx_t *fx, uint16_t led, bool down, uint32_t now_ms);
+
+void key_fx_locks(key_fx_t *fx, uint8_t locks);
+
+// Render every LED into an APA102 frame of fx->num_leds. Returns false once
+// nothing is moving any more, the frame then stays valid until new input.
+bool key_fx_render(key_fx_t *fx, uint8_t *frame, uint32_t now_ms);
+
+#endif /* KEY_FX_H__ */
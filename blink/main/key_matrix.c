@@ -0,0 +1,190 @@
+#include "key_matrix.h"
+#include "hid_usage.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "soc/gpio_struct.h"
+#include "esp32/rom/ets_sys.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "sdkconfig.h"
+#include "key_ulp.h"
+
+#define LOG_NAME "key_matrix"
+
+// Rows are driven high one at a time, columns read back through the key
+// and its diode. All of them are RTC capable so the matrix keeps working
+// while the main cores sleep. Rows have to sit below GPIO32 for out_w1ts.
+static const uint8_t row_gpio[KEY_MATRIX_ROWS]={13,14,15,4};
+static const uint8_t col_gpio[KEY_MATRIX_COLS]={25,26,27,33};
+
+static const uint8_t keymap[KEY_MATRIX_ROWS][KEY_MATRIX_COLS]={
+	{HID_KEY_ESCAPE,     HID_KEY_1,        HID_KEY_2,      HID_KEY_3},
+	{HID_KEY_TAB,        HID_KEY_Q,        HID_KEY_W,      HID_KEY_E},
+	{HID_KEY_LEFT_SHIFT, HID_KEY_A,        HID_KEY_S,      HID_KEY_D},
+	{HID_KEY_LEFT_CTRL,  HID_KEY_SPACEBAR, HID_KEY_DELETE, HID_KEY_RETURN},
+};
+
+static key_matrix_row_t rows[KEY_MATRIX_ROWS];
+static key_matrix_event_cb_t event_cb;
+static esp_timer_handle_t scan_timer;
+static uint32_t row_mask;
+static uint64_t col_mask;
+
+static key_matrix_stats_t stats;
+static uint32_t window_scans;
+static int64_t window_start;
+
+static void IRAM_ATTR key_matrix_wake_isr(void *arg);
+
+// All rows high, so any press pulls a column up and raises the wake ISR.
+static void key_matrix_idle(void){
+	GPIO.out_w1ts=row_mask;
+	for(int c=0;c<KEY_MATRIX_COLS;c++)gpio_intr_enable(col_gpio[c]);
+}
+
+static void IRAM_ATTR key_matrix_wake_isr(void *arg){
+	for(int c=0;c<KEY_MATRIX_COLS;c++)gpio_intr_disable(col_gpio[c]);
+	esp_timer_start_periodic(scan_timer,1000000/KEY_MATRIX_SCAN_HZ);
+}
+
+// Gather the column bits out of one read of both input registers.
+static uint32_t key_matrix_cols(uint64_t in){
+	uint32_t cols=0;
+	for(int c=0;c<KEY_MATRIX_COLS;c++)
+		cols|=((in>>col_gpio[c])&1)<<c;
+	return cols;
+}
+
+static void key_matrix_scan(void *arg){
+	int64_t start=esp_timer_get_time();
+	bool any=false;
+	GPIO.out_w1tc=row_mask;
+	for(int r=0;r<KEY_MATRIX_ROWS;r++){
+		GPIO.out_w1ts=1<<row_gpio[r];
+		ets_delay_us(1);
+		uint64_t in=GPIO.in|((uint64_t)GPIO.in1.data<<32);
+		GPIO.out_w1tc=1<<row_gpio[r];
+
+		uint32_t toggle=key_matrix_debounce(&rows[r],key_matrix_cols(in));
+		for(int c=0;toggle;c++,toggle>>=1)
+			if(toggle&1)event_cb(keymap[r][c],(rows[r].state>>c)&1);
+		any|=rows[r].state|rows[r].cnt0|rows[r].cnt1;
+	}
+
+	int64_t now=esp_timer_get_time();
+	if(now-start>stats.scan_us)stats.scan_us=now-start;
+	window_scans++;
+	if(now-window_start>=1000000){
+		stats.scans=window_scans;
+		if(window_scans<KEY_MATRIX_SCAN_HZ*9/10)
+			ESP_LOGW(LOG_NAME,"scan rate %u Hz, target %u Hz",window_scans,KEY_MATRIX_SCAN_HZ);
+		window_scans=0;
+		window_start=now;
+	}
+
+	// Everything released and settled, stop scanning until the next press.
+	if(!any){
+		esp_timer_stop(scan_timer);
+		key_matrix_idle();
+		window_scans=0;
+		window_start=now;
+	}
+}
+
+esp_err_t key_matrix_start(key_matrix_event_cb_t cb){
+	event_cb=cb;
+	for(int r=0;r<KEY_MATRIX_ROWS;r++){
+		if(row_gpio[r]>=32)return ESP_ERR_INVALID_ARG;
+		row_mask|=1<<row_gpio[r];
+		// Take the pins back from the RTC domain after a deep sleep.
+		rtc_gpio_hold_dis(row_gpio[r]);
+		rtc_gpio_deinit(row_gpio[r]);
+	}
+	for(int c=0;c<KEY_MATRIX_COLS;c++)rtc_gpio_deinit(col_gpio[c]);
+	gpio_config_t rows_cfg={
+		.pin_bit_mask=row_mask,
+		.mode=GPIO_MODE_OUTPUT,
+	};
+	esp_err_t ret=gpio_config(&rows_cfg);
+	if(ret)return ret;
+
+	for(int c=0;c<KEY_MATRIX_COLS;c++)col_mask|=1ULL<<col_gpio[c];
+	gpio_config_t cols_cfg={
+		.pin_bit_mask=col_mask,
+		.mode=GPIO_MODE_INPUT,
+		.pull_down_en=1,
+		.intr_type=GPIO_INTR_POSEDGE,
+	};
+	if((ret=gpio_config(&cols_cfg)))return ret;
+
+	esp_timer_create_args_t timer_args={
+		.callback=key_matrix_scan,
+		.name="key_matrix",
+	};
+	if((ret=esp_timer_create(&timer_args,&scan_timer)))return ret;
+
+	// The button capture may have installed the shared ISR service already.
+	ret=gpio_install_isr_service(0);
+	if(ret && ret!=ESP_ERR_INVALID_STATE)return ret;
+	for(int c=0;c<KEY_MATRIX_COLS;c++){
+		gpio_intr_disable(col_gpio[c]);
+		if((ret=gpio_isr_handler_add(col_gpio[c],key_matrix_wake_isr,NULL)))return ret;
+	}
+	window_start=esp_timer_get_time();
+	key_matrix_idle();
+
+	// Start from the press the ULP confirmed, so it is reported even if
+	// the key was let go before the first scan here.
+	uint32_t woke[KEY_MATRIX_ROWS];
+	bool pressed=false;
+	if(key_ulp_take(col_gpio,woke)){
+		for(int r=0;r<KEY_MATRIX_ROWS;r++){
+			rows[r].state=woke[r];
+			for(int c=0;c<KEY_MATRIX_COLS;c++)
+				if(woke[r]&(1<<c))event_cb(keymap[r][c],true);
+			pressed|=woke[r];
+		}
+	}else{
+		// A key held since before boot raises no edge either.
+		ets_delay_us(1);
+		pressed=key_matrix_cols(GPIO.in|((uint64_t)GPIO.in1.data<<32));
+	}
+	if(pressed)key_matrix_wake_isr(NULL);
+	return ESP_OK;
+}
+
+esp_err_t key_matrix_sleep_prepare(void){
+	esp_timer_stop(scan_timer);
+	for(int c=0;c<KEY_MATRIX_COLS;c++)gpio_intr_disable(col_gpio[c]);
+#ifdef CONFIG_ESP32_ULP_COPROC_ENABLED
+	// The ULP scans and debounces, we only wake for a real press.
+	return key_ulp_start(row_gpio,col_gpio);
+#else
+	// Without the ULP hold every row high, any press raises a column.
+	for(int c=0;c<KEY_MATRIX_COLS;c++){
+		rtc_gpio_pullup_dis(col_gpio[c]);
+		rtc_gpio_pulldown_en(col_gpio[c]);
+	}
+	for(int r=0;r<KEY_MATRIX_ROWS;r++){
+		rtc_gpio_init(row_gpio[r]);
+		rtc_gpio_set_direction(row_gpio[r],RTC_GPIO_MODE_OUTPUT_ONLY);
+		rtc_gpio_set_level(row_gpio[r],1);
+		rtc_gpio_hold_en(row_gpio[r]);
+	}
+	return esp_sleep_enable_ext1_wakeup(col_mask,ESP_EXT1_WAKEUP_ANY_HIGH);
+#endif
+}
+
+void key_matrix_get_stats(key_matrix_stats_t *out){
+	// Only the scan writes them, one word at a time.
+	*out=stats;
+}
+
+int key_matrix_index(uint8_t key){
+	for(int r=0;r<KEY_MATRIX_ROWS;r++)
+		for(int c=0;c<KEY_MATRIX_COLS;c++)
+			if(keymap[r][c]==key)return r*KEY_MATRIX_COLS+c;
+	return -1;
+}
@@ -0,0 +1,50 @@
+#ifndef KEY_MATRIX_H__
+#define KEY_MATRIX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define KEY_MATRIX_ROWS 4
+#define KEY_MATRIX_COLS 4
+#define KEY_MATRIX_SCAN_HZ 1000
+
+// Debounce state of one row, one bit per column. cnt1:cnt0 is a 2 bit
+// vertical counter per key, a key only flips after 4 scans in a row
+// disagree with its debounced state (4 ms at KEY_MATRIX_SCAN_HZ).
+typedef struct {
+	uint32_t state;
+	uint32_t cnt0;
+	uint32_t cnt1;
+} key_matrix_row_t;
+
+typedef struct {
+	uint32_t scans;      // scans during the last full second of activity
+	uint32_t scan_us;    // longest single matrix scan seen
+} key_matrix_stats_t;
+
+// Called from the scan timer for every debounced change.
+typedef void (*key_matrix_event_cb_t)(uint8_t key, bool down);
+
+// Feed one raw sample of a row, returns the columns whose debounced state flipped.
+static inline uint32_t key_matrix_debounce(key_matrix_row_t *row, uint32_t sample){
+	uint32_t delta=sample^row->state;
+	row->cnt1=(row->cnt1^row->cnt0)&delta;
+	row->cnt0=~row->cnt0&delta;
+	uint32_t toggle=delta&~(row->cnt0|row->cnt1);
+	row->state^=toggle;
+	return toggle;
+}
+
+esp_err_t key_matrix_start(key_matrix_event_cb_t cb);
+
+// Stop scanning and arm the matrix as the deep sleep wake source, through
+// the ULP when it is enabled or else ext1 on the columns.
+esp_err_t key_matrix_sleep_prepare(void);
+
+void key_matrix_get_stats(key_matrix_stats_t *stats);
+
+// Position of a key in the matrix, row*KEY_MATRIX_COLS+col, -1 if not on it.
+int key_matrix_index(uint8_t key);
+
+#endif /* KEY_MATRIX_H__ */
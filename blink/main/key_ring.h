@@ -0,0 +1,65 @@
+#ifndef KEY_RING_H__
+#define KEY_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define KEY_EVENT_DOWN 0x01 // press, otherwise release
+#define KEY_EVENT_TEXT 0x02 // key indexes a text macro instead of a usage
+
+typedef struct {
+	uint32_t time_us; // low half of esp_timer_get_time() at capture
+	uint8_t key;
+	uint8_t flags;
+	uint16_t reserved;
+} key_event_t;
+
+#define KEY_RING_SIZE 128 // power of two
+
+// Single producer / single consumer ring. head is only written by the
+// producer and tail only by the consumer, so the two sides can run on
+// different cores without a lock. The release store of an index
+// publishes the slots behind it to the acquire load on the other side.
+typedef struct {
+	_Atomic uint32_t head;
+	_Atomic uint32_t tail;
+	_Atomic uint32_t overflows; // events the producer had to drop
+	key_event_t buf[KEY_RING_SIZE];
+} key_ring_t;
+
+static inline bool key_ring_push(key_ring_t *ring, const key_event_t *ev){
+	uint32_t head=atomic_load_explicit(&ring->head,memory_order_relaxed);
+	uint32_t tail=atomic_load_explicit(&ring->tail,memory_order_acquire);
+	if(head-tail==KEY_RING_SIZE){
+		atomic_fetch_add_explicit(&ring->overflows,1,memory_order_relaxed);
+		return false;
+	}
+	ring->buf[head&(KEY_RING_SIZE-1)]=*ev;
+	atomic_store_explicit(&ring->head,head+1,memory_order_release);
+	return true;
+}
+
+// Take up to max pending events in one go, returns how many were taken.
+static inline size_t key_ring_pop(key_ring_t *ring, key_event_t *out, size_t max){
+	uint32_t tail=atomic_load_explicit(&ring->tail,memory_order_relaxed);
+	uint32_t head=atomic_load_explicit(&ring->head,memory_order_acquire);
+	size_t n=head-tail;
+	if(n>max)n=max;
+	for(size_t i=0;i<n;i++)
+		out[i]=ring->buf[(tail+i)&(KEY_RING_SIZE-1)];
+	atomic_store_explicit(&ring->tail,tail+n,memory_order_release);
+	return n;
+}
+
+static inline bool key_ring_empty(key_ring_t *ring){
+	return atomic_load_explicit(&ring->head,memory_order_acquire)==
+	       atomic_load_explicit(&ring->tail,memory_order_relaxed);
+}
+
+static inline uint32_t key_ring_overflows(key_ring_t *ring){
+	return atomic_load_explicit(&ring->overflows,memory_order_relaxed);
+}
+
+#endif /* KEY_RING_H__ */
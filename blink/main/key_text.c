@@ -0,0 +1,134 @@
+#include "key_text.h"
+#include <string.h>
+#include "hid_usage.h"
+
+// US ANSI layout. Control characters map to the keys that produce them.
+const uint8_t key_text_layout_us[128] = {
+	['\b']   = HID_KEY_DELETE,
+	['\t']   = HID_KEY_TAB,
+	['\n']   = HID_KEY_RETURN,
+	['\x1b'] = HID_KEY_ESCAPE,
+	[' ']    = HID_KEY_SPACEBAR,
+	['!']    = HID_KEY_1|KEY_TEXT_SHIFT,
+	['"']    = HID_KEY_SGL_QUOTE|KEY_TEXT_SHIFT,
+	['#']    = HID_KEY_3|KEY_TEXT_SHIFT,
+	['$']    = HID_KEY_4|KEY_TEXT_SHIFT,
+	['%']    = HID_KEY_5|KEY_TEXT_SHIFT,
+	['&']    = HID_KEY_7|KEY_TEXT_SHIFT,
+	['\'']   = HID_KEY_SGL_QUOTE,
+	['(']    = HID_KEY_9|KEY_TEXT_SHIFT,
+	[')']    = HID_KEY_0|KEY_TEXT_SHIFT,
+	['*']    = HID_KEY_8|KEY_TEXT_SHIFT,
+	['+']    = HID_KEY_EQUAL|KEY_TEXT_SHIFT,
+	[',']    = HID_KEY_COMMA,
+	['-']    = HID_KEY_MINUS,
+	['.']    = HID_KEY_DOT,
+	['/']    = HID_KEY_FWD_SLASH,
+	['0']    = HID_KEY_0,
+	['1']    = HID_KEY_1,
+	['2']    = HID_KEY_2,
+	['3']    = HID_KEY_3,
+	['4']    = HID_KEY_4,
+	['5']    = HID_KEY_5,
+	['6']    = HID_KEY_6,
+	['7']    = HID_KEY_7,
+	['8']    = HID_KEY_8,
+	['9']    = HID_KEY_9,
+	[':']    = HID_KEY_SEMI_COLON|KEY_TEXT_SHIFT,
+	[';']    = HID_KEY_SEMI_COLON,
+	['<']    = HID_KEY_COMMA|KEY_TEXT_SHIFT,
+	['=']    = HID_KEY_EQUAL,
+	['>']    = HID_KEY_DOT|KEY_TEXT_SHIFT,
+	['?']    = HID_KEY_FWD_SLASH|KEY_TEXT_SHIFT,
+	['@']    = HID_KEY_2|KEY_TEXT_SHIFT,
+	['A']    = HID_KEY_A|KEY_TEXT_SHIFT,
+	['B']    = HID_KEY_B|KEY_TEXT_SHIFT,
+	['C']    = HID_KEY_C|KEY_TEXT_SHIFT,
+	['D']    = HID_KEY_D|KEY_TEXT_SHIFT,
+	['E']    = HID_KEY_E|KEY_TEXT_SHIFT,
+	['F']    = HID_KEY_F|KEY_TEXT_SHIFT,
+	['G']    = HID_KEY_G|KEY_TEXT_SHIFT,
+	['H']    = HID_KEY_H|KEY_TEXT_SHIFT,
+	['I']    = HID_KEY_I|KEY_TEXT_SHIFT,
+	['J']    = HID_KEY_J|KEY_TEXT_SHIFT,
+	['K']    = HID_KEY_K|KEY_TEXT_SHIFT,
+	['L']    = HID_KEY_L|KEY_TEXT_SHIFT,
+	['M']    = HID_KEY_M|KEY_TEXT_SHIFT,
+	['N']    = HID_KEY_N|KEY_TEXT_SHIFT,
+	['O']    = HID_KEY_O|KEY_TEXT_SHIFT,
+	['P']    = HID_KEY_P|KEY_TEXT_SHIFT,
+	['Q']    = HID_KEY_Q|KEY_TEXT_SHIFT,
+	['R']    = HID_KEY_R|KEY_TEXT_SHIFT,
+	['S']    = HID_KEY_S|KEY_TEXT_SHIFT,
+	['T']    = HID_KEY_T|KEY_TEXT_SHIFT,
+	['U']    = HID_KEY_U|KEY_TEXT_SHIFT,
+	['V']    = HID_KEY_V|KEY_TEXT_SHIFT,
+	['W']    = HID_KEY_W|KEY_TEXT_SHIFT,
+	['X']    = HID_KEY_X|KEY_TEXT_SHIFT,
+	['Y']    = HID_KEY_Y|KEY_TEXT_SHIFT,
+	['Z']    = HID_KEY_Z|KEY_TEXT_SHIFT,
+	['[']    = HID_KEY_LEFT_BRKT,
+	['\\']   = HID_KEY_BACK_SLASH,
+	[']']    = HID_KEY_RIGHT_BRKT,
+	['^']    = HID_KEY_6|KEY_TEXT_SHIFT,
+	['_']    = HID_KEY_MINUS|KEY_TEXT_SHIFT,
+	['`']    = HID_KEY_GRV_ACCENT,
+	['a']    = HID_KEY_A,
+	['b']    = HID_KEY_B,
+	['c']    = HID_KEY_C,
+	['d']    = HID_KEY_D,
+	['e']    = HID_KEY_E,
+	['f']    = HID_KEY_F,
+	['g']    = HID_KEY_G,
+	['h']    = HID_KEY_H,
+	['i']    = HID_KEY_I,
+	['j']    = HID_KEY_J,
+	['k']    = HID_KEY_K,
+	['l']    = HID_KEY_L,
+	['m']    = HID_KEY_M,
+	['n']    = HID_KEY_N,
+	['o']    = HID_KEY_O,
+	['p']    = HID_KEY_P,
+	['q']    = HID_KEY_Q,
+	['r']    = HID_KEY_R,
+	['s']    = HID_KEY_S,
+	['t']    = HID_KEY_T,
+	['u']    = HID_KEY_U,
+	['v']    = HID_KEY_V,
+	['w']    = HID_KEY_W,
+	['x']    = HID_KEY_X,
+	['y']    = HID_KEY_Y,
+	['z']    = HID_KEY_Z,
+	['{']    = HID_KEY_LEFT_BRKT|KEY_TEXT_SHIFT,
+	['|']    = HID_KEY_BACK_SLASH|KEY_TEXT_SHIFT,
+	['}']    = HID_KEY_RIGHT_BRKT|KEY_TEXT_SHIFT,
+	['~']    = HID_KEY_GRV_ACCENT|KEY_TEXT_SHIFT,
+	['\x7f'] = HID_KEY_DELETE_FWD,
+};
+
+void key_text_type(kbd_report_t *r, const uint8_t *layout, const char *text){
+	// Type from nothing pressed, or a held Shift or Ctrl changes the
+	// characters and a held key the text also has would be released.
+	kbd_state_t held=r->cur;
+	bool restore=held.mods||held.num_keys;
+	if(restore){
+		kbd_report_flush(r);
+		memset(&r->cur,0,sizeof(r->cur));
+	}
+	for(;*text;text++){
+		if(*text&0x80)continue;
+		uint8_t code=layout[(uint8_t)*text];
+		if(!code)continue;
+		uint8_t key=code&~KEY_TEXT_SHIFT;
+		bool shift=code&KEY_TEXT_SHIFT;
+		if(shift)kbd_report_apply(r,HID_KEY_LEFT_SHIFT,true);
+		kbd_report_apply(r,key,true);
+		kbd_report_apply(r,key,false);
+		if(shift)kbd_report_apply(r,HID_KEY_LEFT_SHIFT,false);
+	}
+	if(restore){
+		// Let the last release out, then press the held keys again.
+		kbd_report_flush(r);
+		r->cur=held;
+	}
+}
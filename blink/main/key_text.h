@@ -0,0 +1,19 @@
+#ifndef KEY_TEXT_H__
+#define KEY_TEXT_H__
+
+#include <stdint.h>
+#include "kbd_report.h"
+
+// Layout tables map 7 bit ASCII to a HID usage, with this bit set when
+// the character needs Shift. Zero means the character cannot be typed.
+#define KEY_TEXT_SHIFT 0x80
+
+extern const uint8_t key_text_layout_us[128];
+
+// Type a string through the report builder, straight from flash.
+// Characters the layout has no key for are skipped. Keys and modifiers
+// held on the keyboard are released for the text and pressed again after
+// it, on the next flush.
+void key_text_type(kbd_report_t *r, const uint8_t *layout, const char *text);
+
+#endif /* KEY_TEXT_H__ */
@@ -0,0 +1,127 @@
+#include "key_trace.h"
+
+#if KEY_TRACE_ENABLED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+
+typedef struct {
+	uint32_t us[KEY_TRACE_SAMPLES];
+	uint32_t count;
+} key_trace_hist_t;
+
+static const char *const stage_names[KEY_TRACE_STAGES]={
+	[KEY_TRACE_DEQUEUE]="dequeue",
+	[KEY_TRACE_REPORT]="report",
+	[KEY_TRACE_SEND]="send",
+	[KEY_TRACE_CONF]="conf",
+};
+
+static key_trace_hist_t hist[KEY_TRACE_STAGES];
+
+// Capture time of the oldest event in the report being built, and of the
+// report between building and queueing. Both only touched by bluetooth_task,
+// from then on the origin travels with the queued report.
+static uint32_t origin_building;
+static bool building;
+static uint32_t origin_built;
+static bool built;
+
+// Sent but unconfirmed reports. Sends are serialized by hid_dev, whichever
+// task drains the link, and confirms arrive in send order on the BTC task,
+// so this is a small SPSC ring like key_ring.
+#define INFLIGHT 16
+static uint32_t inflight[INFLIGHT];
+static _Atomic uint32_t inflight_head, inflight_tail;
+
+static inline uint32_t now_us(void){
+	return (uint32_t)esp_timer_get_time();
+}
+
+static void record(key_trace_stage_t stage, uint32_t origin){
+	key_trace_hist_t *h=&hist[stage];
+	h->us[h->count++%KEY_TRACE_SAMPLES]=now_us()-origin;
+}
+
+void key_trace_event(uint32_t capture_us){
+	record(KEY_TRACE_DEQUEUE,capture_us);
+	if(!building){
+		origin_building=capture_us;
+		building=true;
+	}
+}
+
+void key_trace_report(void){
+	if(!building)return;
+	record(KEY_TRACE_REPORT,origin_building);
+	origin_built=origin_building;
+	built=true;
+	building=false;
+}
+
+uint32_t key_trace_origin(void){
+	if(!built)return 0;
+	built=false;
+	return origin_built;
+}
+
+void key_trace_sent(uint32_t origin){
+	if(!origin)return;
+	record(KEY_TRACE_SEND,origin);
+	uint32_t head=atomic_load_explicit(&inflight_head,memory_order_relaxed);
+	if(head-atomic_load_explicit(&inflight_tail,memory_order_acquire)==INFLIGHT)return;
+	inflight[head%INFLIGHT]=origin;
+	atomic_store_explicit(&inflight_head,head+1,memory_order_release);
+}
+
+void key_trace_confirmed(void){
+	uint32_t tail=atomic_load_explicit(&inflight_tail,memory_order_relaxed);
+	if(tail==atomic_load_explicit(&inflight_head,memory_order_acquire))return;
+	record(KEY_TRACE_CONF,inflight[tail%INFLIGHT]);
+	atomic_store_explicit(&inflight_tail,tail+1,memory_order_release);
+}
+
+static int cmp_u32(const void *a, const void *b){
+	uint32_t x=*(const uint32_t*)a, y=*(const uint32_t*)b;
+	return x<y?-1:x>y;
+}
+
+void key_trace_dump(void){
+	static uint32_t sorted[KEY_TRACE_SAMPLES];
+	printf("key_trace: stage      n      p50_us   p99_us   max_us\n");
+	for(int s=0;s<KEY_TRACE_STAGES;s++){
+		uint32_t n=hist[s].count<KEY_TRACE_SAMPLES?hist[s].count:KEY_TRACE_SAMPLES;
+		if(!n){
+			printf("key_trace: %-8s %6u\n",stage_names[s],0u);
+			continue;
+		}
+		memcpy(sorted,hist[s].us,n*sizeof(uint32_t));
+		qsort(sorted,n,sizeof(uint32_t),cmp_u32);
+		printf("key_trace: %-8s %6u %8u %8u %8u\n",stage_names[s],hist[s].count,
+		       sorted[n/2],sorted[(n*99)/100],sorted[n-1]);
+	}
+}
+
+static void key_trace_console(void *arg){
+	uint8_t c;
+	while(1){
+		if(uart_read_bytes(UART_NUM_0,&c,1,portMAX_DELAY)!=1)continue;
+		if(c=='t')key_trace_dump();
+		else if(c=='r')memset(hist,0,sizeof(hist));
+	}
+}
+
+void key_trace_start_console(void){
+	ESP_ERROR_CHECK(uart_driver_install(UART_NUM_0,256,0,0,NULL,0));
+	xTaskCreate(key_trace_console,"key_trace",2048,NULL,1,NULL);
+}
+
+#endif
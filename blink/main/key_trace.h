@@ -0,0 +1,57 @@
+#ifndef KEY_TRACE_H__
+#define KEY_TRACE_H__
+
+#include <stdint.h>
+
+// Keystroke latency tracing, from the GPIO edge to the GATT confirm.
+// Build with -DKEY_TRACE_ENABLED=1 to turn it on, otherwise every hook
+// below compiles to nothing.
+#ifndef KEY_TRACE_ENABLED
+#define KEY_TRACE_ENABLED 0
+#endif
+
+// Every stage is measured as time since the key was captured.
+typedef enum {
+	KEY_TRACE_DEQUEUE, // bluetooth_task took the event off its ring
+	KEY_TRACE_REPORT,  // a keyboard report carrying it was built
+	KEY_TRACE_SEND,    // esp_ble_gatts_send_indicate() returned
+	KEY_TRACE_CONF,    // ESP_GATTS_CONF_EVT for that report
+	KEY_TRACE_STAGES,
+} key_trace_stage_t;
+
+#define KEY_TRACE_SAMPLES 128 // per stage, oldest samples are overwritten
+
+#if KEY_TRACE_ENABLED
+
+void key_trace_event(uint32_t capture_us);
+void key_trace_report(void);
+// Origin of the report just built, for hid_dev to keep with it while it is
+// queued. 0 if none or already taken.
+uint32_t key_trace_origin(void);
+void key_trace_sent(uint32_t origin);
+void key_trace_confirmed(void);
+
+// Print p50/p99/max per stage. The console task does this on 't' over
+// UART0, and clears the samples on 'r'.
+void key_trace_dump(void);
+void key_trace_start_console(void);
+
+#define KEY_TRACE_EVENT(capture_us) key_trace_event(capture_us)
+#define KEY_TRACE_REPORT()          key_trace_report()
+#define KEY_TRACE_ORIGIN()          key_trace_origin()
+#define KEY_TRACE_SENT(origin)      key_trace_sent(origin)
+#define KEY_TRACE_CONFIRMED()       key_trace_confirmed()
+#define KEY_TRACE_START_CONSOLE()   key_trace_start_console()
+
+#else
+
+#define KEY_TRACE_EVENT(capture_us) do{}while(0)
+#define KEY_TRACE_REPORT()          do{}while(0)
+#define KEY_TRACE_ORIGIN()          0
+#define KEY_TRACE_SENT(origin)      do{}while(0)
+#define KEY_TRACE_CONFIRMED()       do{}while(0)
+#define KEY_TRACE_START_CONSOLE()   do{}while(0)
+
+#endif
+
+#endif /* KEY_TRACE_H__ */
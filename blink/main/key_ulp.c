@@ -0,0 +1,120 @@
+#include "key_ulp.h"
+#include "esp32/ulp.h"
+#include "driver/rtc_io.h"
+#include "soc/rtc_io_reg.h"
+#include "esp_sleep.h"
+#include "esp_log.h"
+
+#define LOG_NAME "key_ulp"
+
+enum { L_SAME_0, L_SAME=L_SAME_0+KEY_MATRIX_ROWS, L_WAIT, L_RELEASED };
+
+// The columns are read in one go as a 16 bit field of RTC_GPIO_IN
+// starting at the lowest column's RTC pin.
+static int key_ulp_col_base(const uint8_t col_gpio[KEY_MATRIX_COLS]){
+	int lo=99, hi=-1;
+	for(int c=0;c<KEY_MATRIX_COLS;c++){
+		int n=rtc_io_number_get(col_gpio[c]);
+		if(n<0)return -1;
+		if(n<lo)lo=n;
+		if(n>hi)hi=n;
+	}
+	return hi-lo<16?lo:-1;
+}
+
+esp_err_t key_ulp_start(const uint8_t row_gpio[KEY_MATRIX_ROWS], const uint8_t col_gpio[KEY_MATRIX_COLS]){
+	int base=key_ulp_col_base(col_gpio);
+	if(base<0)return ESP_ERR_INVALID_ARG;
+	int top=RTC_GPIO_IN_NEXT_S+base+15>31?31:RTC_GPIO_IN_NEXT_S+base+15;
+	uint32_t col_bits=0;
+	for(int c=0;c<KEY_MATRIX_COLS;c++){
+		col_bits|=1<<(rtc_io_number_get(col_gpio[c])-base);
+		rtc_gpio_init(col_gpio[c]);
+		rtc_gpio_set_direction(col_gpio[c],RTC_GPIO_MODE_INPUT_ONLY);
+		rtc_gpio_pullup_dis(col_gpio[c]);
+		rtc_gpio_pulldown_en(col_gpio[c]);
+	}
+	int row[KEY_MATRIX_ROWS];
+	for(int r=0;r<KEY_MATRIX_ROWS;r++){
+		if((row[r]=rtc_io_number_get(row_gpio[r]))<0)return ESP_ERR_INVALID_ARG;
+		rtc_gpio_hold_dis(row_gpio[r]);
+		rtc_gpio_init(row_gpio[r]);
+		rtc_gpio_set_direction(row_gpio[r],RTC_GPIO_MODE_OUTPUT_ONLY);
+		rtc_gpio_set_level(row_gpio[r],0);
+	}
+
+	// R3 data base, R2 OR of all rows, R0/R1 scratch. Loads do not set
+	// the ALU flags, so values are moved through the ALU before a branch.
+	#define ROW_SCAN(r) \
+		I_WR_REG(RTC_GPIO_OUT_W1TS_REG,RTC_GPIO_OUT_DATA_W1TS_S+row[r],RTC_GPIO_OUT_DATA_W1TS_S+row[r],1), \
+		I_DELAY(16), \
+		I_RD_REG(RTC_GPIO_IN_REG,RTC_GPIO_IN_NEXT_S+base,top), \
+		I_WR_REG(RTC_GPIO_OUT_W1TC_REG,RTC_GPIO_OUT_DATA_W1TC_S+row[r],RTC_GPIO_OUT_DATA_W1TC_S+row[r],1), \
+		I_ANDI(R0,R0,col_bits), \
+		I_ORR(R2,R2,R0), \
+		I_LD(R1,R3,KEY_ULP_ROWS+r), \
+		I_ST(R0,R3,KEY_ULP_ROWS+r), \
+		I_SUBR(R1,R1,R0), \
+		M_BXZ(L_SAME_0+r), \
+		I_MOVI(R1,1), \
+		I_ST(R1,R3,KEY_ULP_CHANGED), \
+		M_LABEL(L_SAME_0+r)
+	const ulp_insn_t program[]={
+		I_MOVI(R3,KEY_ULP_DATA),
+		I_MOVI(R2,0),
+		I_ST(R2,R3,KEY_ULP_CHANGED),
+		ROW_SCAN(0),
+		ROW_SCAN(1),
+		ROW_SCAN(2),
+		ROW_SCAN(3),
+		// Nothing down, start over.
+		I_MOVR(R0,R2),
+		M_BXZ(L_RELEASED),
+		// Keys down but not the same as last scan, still bouncing.
+		I_LD(R0,R3,KEY_ULP_CHANGED),
+		I_MOVR(R0,R0),
+		M_BXZ(L_SAME),
+		M_BX(L_RELEASED),
+		M_LABEL(L_SAME),
+		I_LD(R0,R3,KEY_ULP_COUNT),
+		I_ADDI(R0,R0,1),
+		I_ST(R0,R3,KEY_ULP_COUNT),
+		M_BL(L_WAIT,KEY_ULP_DEBOUNCE),
+		// Confirmed, wake the CPU and stop the ULP timer.
+		I_WAKE(),
+		I_END(),
+		M_LABEL(L_WAIT),
+		I_HALT(),
+		M_LABEL(L_RELEASED),
+		I_MOVI(R0,0),
+		I_ST(R0,R3,KEY_ULP_COUNT),
+		I_HALT(),
+	};
+	#undef ROW_SCAN
+	_Static_assert(KEY_MATRIX_ROWS==4,"ROW_SCAN is unrolled for 4 rows");
+
+	for(int i=0;i<KEY_ULP_ROWS+KEY_MATRIX_ROWS;i++)RTC_SLOW_MEM[KEY_ULP_DATA+i]=0;
+	size_t size=sizeof(program)/sizeof(ulp_insn_t);
+	esp_err_t ret=ulp_process_macros_and_load(0,program,&size);
+	if(ret)return ret;
+	if(size>KEY_ULP_DATA){
+		ESP_LOGE(LOG_NAME,"program is %u words, data starts at %u",(unsigned)size,KEY_ULP_DATA);
+		return ESP_ERR_NO_MEM;
+	}
+	if((ret=ulp_set_wakeup_period(0,KEY_ULP_SCAN_MS*1000)))return ret;
+	if((ret=esp_sleep_enable_ulp_wakeup()))return ret;
+	return ulp_run(0);
+}
+
+bool key_ulp_take(const uint8_t col_gpio[KEY_MATRIX_COLS], uint32_t cols[KEY_MATRIX_ROWS]){
+	int base=key_ulp_col_base(col_gpio);
+	if(esp_sleep_get_wakeup_cause()!=ESP_SLEEP_WAKEUP_ULP || base<0)return false;
+	for(int r=0;r<KEY_MATRIX_ROWS;r++){
+		// The ULP only writes the low half of each word.
+		uint32_t raw=RTC_SLOW_MEM[KEY_ULP_DATA+KEY_ULP_ROWS+r]&0xFFFF;
+		cols[r]=0;
+		for(int c=0;c<KEY_MATRIX_COLS;c++)
+			if(raw&(1<<(rtc_io_number_get(col_gpio[c])-base)))cols[r]|=1<<c;
+	}
+	return true;
+}
@@ -0,0 +1,30 @@
+#ifndef KEY_ULP_H__
+#define KEY_ULP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "key_matrix.h"
+
+// While the main cores deep sleep the ULP scans the matrix every
+// KEY_ULP_SCAN_MS and wakes them after KEY_ULP_DEBOUNCE more identical
+// scans with a key down, 20-30 ms of steady contact.
+#define KEY_ULP_SCAN_MS 10
+#define KEY_ULP_DEBOUNCE 2
+
+// Where the program keeps its state, in 32 bit words of RTC slow memory.
+// The code is loaded from word 0 and has to end before KEY_ULP_DATA.
+#define KEY_ULP_DATA 96
+#define KEY_ULP_COUNT 0   // identical non-empty scans so far
+#define KEY_ULP_CHANGED 1 // scratch, set when a row differs from the last scan
+#define KEY_ULP_ROWS 2    // last scan, one word per row
+
+// Hand the matrix pins to the RTC domain, load the scan program and arm
+// it as the deep sleep wake source.
+esp_err_t key_ulp_start(const uint8_t row_gpio[KEY_MATRIX_ROWS], const uint8_t col_gpio[KEY_MATRIX_COLS]);
+
+// After a ULP wake, the keys of the confirmed press as column bits per
+// row. Returns false when this boot was not a ULP wake.
+bool key_ulp_take(const uint8_t col_gpio[KEY_MATRIX_COLS], uint32_t cols[KEY_MATRIX_ROWS]);
+
+#endif /* KEY_ULP_H__ */
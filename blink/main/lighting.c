@@ -0,0 +1,75 @@
+#include "lighting.h"
+#include <stdatomic.h>
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "apa102.h"
+#include "key_ring.h"
+
+#define LOG_NAME "lighting"
+
+static key_ring_t fx_keys;
+static key_fx_t fx;
+static volatile uint8_t locks;
+static atomic_bool running;
+static bool started;
+
+// Frames only run while something is moving, an idle strip costs no
+// wakeups and lets the CPU light sleep.
+static void lighting_wake(void){
+	if(!started || atomic_exchange(&running,true))return;
+	apa102_set_fps(LIGHTING_FPS);
+}
+
+static void lighting_render(uint8_t *frame, uint16_t num_leds, uint32_t frame_no, void *arg){
+	uint32_t now=esp_timer_get_time()/1000;
+	key_event_t ev[16];
+	size_t n;
+	while((n=key_ring_pop(&fx_keys,ev,sizeof(ev)/sizeof(ev[0]))))
+		for(size_t i=0;i<n;i++){
+			int led=key_matrix_index(ev[i].key);
+			if(led>=0)key_fx_key(&fx,led,ev[i].flags&KEY_EVENT_DOWN,now);
+		}
+	key_fx_locks(&fx,locks);
+	if(key_fx_render(&fx,frame,now))return;
+
+	// This frame is the last one needed, it stays on the strip. Stop
+	// first, then look for input that raced with the decision.
+	apa102_pause();
+	atomic_store(&running,false);
+	if(!key_ring_empty(&fx_keys) || locks!=fx.locks)lighting_wake();
+
+	apa102_stats_t stats;
+	apa102_get_stats(&stats);
+	ESP_LOGD(LOG_NAME,"idle after %u frames, render %u us (max %u), transfer %u us (max %u), %u late",
+		stats.frames,stats.render_us,stats.render_max_us,stats.xfer_us,stats.xfer_max_us,stats.late);
+}
+
+esp_err_t lighting_start(void){
+	key_fx_init(&fx,LIGHTING_NUM_LEDS,LIGHTING_BRIGHTNESS);
+	const apa102_config_t cfg={
+		.host=VSPI_HOST,
+		.data_gpio=LIGHTING_DATA_GPIO,
+		.clock_gpio=LIGHTING_CLOCK_GPIO,
+		.clock_hz=LIGHTING_CLOCK_HZ,
+		.num_leds=LIGHTING_NUM_LEDS,
+		.fps=LIGHTING_FPS,
+		.core=LIGHTING_CORE,
+		.priority=LIGHTING_PRIORITY,
+		.render=lighting_render,
+	};
+	atomic_store(&running,true);
+	esp_err_t err=apa102_start(&cfg);
+	started=err==ESP_OK;
+	return err;
+}
+
+void lighting_key(uint8_t key, bool down){
+	key_event_t ev={.key=key,.flags=down?KEY_EVENT_DOWN:0};
+	key_ring_push(&fx_keys,&ev);
+	lighting_wake();
+}
+
+void lighting_locks(uint8_t l){
+	locks=l;
+	lighting_wake();
+}
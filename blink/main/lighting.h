@@ -0,0 +1,31 @@
+#ifndef LIGHTING_H__
+#define LIGHTING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "key_matrix.h"
+#include "key_fx.h"
+
+// APA102 strip on VSPI: one LED under every matrix key, in matrix order,
+// then the lock indicators.
+#define LIGHTING_DATA_GPIO  23
+#define LIGHTING_CLOCK_GPIO 18
+#define LIGHTING_CLOCK_HZ   4000000
+#define LIGHTING_NUM_LEDS   (KEY_MATRIX_ROWS*KEY_MATRIX_COLS+KEY_FX_LOCK_LEDS)
+#define LIGHTING_FPS        60
+#define LIGHTING_BRIGHTNESS 64
+// Rendered on the app core below the HID tasks, the protocol core and the
+// report path never wait for it.
+#define LIGHTING_CORE       1
+#define LIGHTING_PRIORITY   2
+
+esp_err_t lighting_start(void);
+
+// Key event from the matrix scan. Only queues it, single producer.
+void lighting_key(uint8_t key, bool down);
+
+// Lock LED state of the active host.
+void lighting_locks(uint8_t locks);
+
+#endif /* LIGHTING_H__ */
@@ -0,0 +1,38 @@
+#include "mouse_accum.h"
+#include <string.h>
+
+void mouse_accum_init(mouse_accum_t *m){
+	memset(m,0,sizeof(*m));
+}
+
+void mouse_accum_move(mouse_accum_t *m, const int32_t delta[MOUSE_AXES]){
+	for(int i=0;i<MOUSE_AXES;i++)m->acc[i]+=delta[i];
+}
+
+bool mouse_accum_buttons(mouse_accum_t *m, uint8_t buttons){
+	m->buttons=buttons;
+	return m->buttons!=m->sent_buttons;
+}
+
+bool mouse_accum_take(mouse_accum_t *m, mouse_state_t *out){
+	bool any=m->buttons!=m->sent_buttons;
+	out->buttons=m->buttons;
+	for(int i=0;i<MOUSE_AXES;i++){
+		// Division truncates towards zero, so the remainder keeps the sign
+		// of the motion and nothing is lost on the way back through zero.
+		int32_t whole=m->acc[i]/(1<<MOUSE_ACCUM_SHIFT);
+		if(whole>MOUSE_ACCUM_MAX)whole=MOUSE_ACCUM_MAX;
+		if(whole<-MOUSE_ACCUM_MAX)whole=-MOUSE_ACCUM_MAX;
+		m->acc[i]-=whole*(1<<MOUSE_ACCUM_SHIFT);
+		out->axis[i]=whole;
+		any|=whole!=0;
+	}
+	if(any)m->sent_buttons=m->buttons;
+	return any;
+}
+
+bool mouse_accum_pending(const mouse_accum_t *m){
+	for(int i=0;i<MOUSE_AXES;i++)
+		if(m->acc[i]>=(1<<MOUSE_ACCUM_SHIFT) || m->acc[i]<=-(1<<MOUSE_ACCUM_SHIFT))return true;
+	return m->buttons!=m->sent_buttons;
+}
@@ -0,0 +1,48 @@
+#ifndef MOUSE_ACCUM_H__
+#define MOUSE_ACCUM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Motion is accumulated in 1/256 of a report count, so sensors with a
+// finer resolution than the report keep their fractions between reports.
+#define MOUSE_ACCUM_SHIFT 8
+#define MOUSE_ACCUM_MAX   127
+
+enum {
+	MOUSE_X,
+	MOUSE_Y,
+	MOUSE_WHEEL,
+	MOUSE_PAN,
+	MOUSE_AXES,
+};
+
+// Mouse state in the layout of the 5 byte input report.
+typedef struct {
+	uint8_t buttons;
+	int8_t axis[MOUSE_AXES];
+} mouse_state_t;
+
+typedef struct {
+	int32_t acc[MOUSE_AXES]; // motion not reported yet, in 1/256 counts
+	uint8_t buttons;         // current button state
+	uint8_t sent_buttons;    // button state the host last saw
+} mouse_accum_t;
+
+void mouse_accum_init(mouse_accum_t *m);
+
+// Add relative motion in 1/256 counts.
+void mouse_accum_move(mouse_accum_t *m, const int32_t delta[MOUSE_AXES]);
+
+// Returns true if the buttons changed, the caller should take a report
+// right away instead of waiting for the next connection event.
+bool mouse_accum_buttons(mouse_accum_t *m, uint8_t buttons);
+
+// Move up to MOUSE_ACCUM_MAX whole counts per axis into a report, the rest
+// stays for the next one. Returns false if there is nothing to report.
+bool mouse_accum_take(mouse_accum_t *m, mouse_state_t *out);
+
+// True while whole counts are left over for another report.
+bool mouse_accum_pending(const mouse_accum_t *m);
+
+#endif /* MOUSE_ACCUM_H__ */
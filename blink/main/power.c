@@ -0,0 +1,141 @@
+#include "power.h"
+#include "key_matrix.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#define LOG_NAME "power"
+
+static power_sm_t sm;
+// Held across a transition and its side effects, so two tasks feeding
+// events cannot take and give the PM lock out of order.
+static SemaphoreHandle_t lock;
+static esp_timer_handle_t tick_timer;
+#ifdef CONFIG_PM_ENABLE
+// Held while active, so key scanning and reports run at full clock.
+static esp_pm_lock_handle_t active_lock;
+#endif
+static bool from_deep_sleep;
+static uint32_t wake_to_report_ms;
+
+static uint32_t power_now(void){
+	return esp_timer_get_time()/1000;
+}
+
+static void power_deep_sleep(void){
+	uint32_t now=power_now();
+	ESP_LOGI(LOG_NAME,"deep sleep after %u ms, estimated average %u uA",now,power_sm_avg_ua(&sm,now));
+	// RTC IO keeps the matrix pulls and row levels while we are gone.
+	esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH,ESP_PD_OPTION_ON);
+	esp_err_t ret=key_matrix_sleep_prepare();
+	if(ret){
+		ESP_LOGE(LOG_NAME,"no key wake source (%s), staying up",esp_err_to_name(ret));
+		return;
+	}
+	// Hosts see the link close rather than time out, and the controller
+	// is not cut off mid-event.
+	if(esp_bluedroid_get_status()==ESP_BLUEDROID_STATUS_ENABLED)esp_bluedroid_disable();
+	if(esp_bt_controller_get_status()==ESP_BT_CONTROLLER_STATUS_ENABLED)esp_bt_controller_disable();
+	esp_deep_sleep_start();
+}
+
+static void power_enter(power_state_t prev, power_state_t next){
+	ESP_LOGI(LOG_NAME,"%s -> %s",power_state_name(prev),power_state_name(next));
+#ifdef CONFIG_PM_ENABLE
+	if(next==POWER_ACTIVE)esp_pm_lock_acquire(active_lock);
+	if(prev==POWER_ACTIVE)esp_pm_lock_release(active_lock);
+#endif
+}
+
+// Run one event through the state machine. Input only moves the deadline
+// further out, so it leaves the timer alone and the tick re-arms itself.
+static void power_feed(power_event_t ev){
+	xSemaphoreTake(lock,portMAX_DELAY);
+	uint32_t now=power_now();
+	power_state_t prev=sm.state;
+	power_state_t next=power_sm_event(&sm,ev,now);
+	uint32_t deadline=power_sm_deadline(&sm,now);
+	if(next!=prev)power_enter(prev,next);
+	if(next!=prev || ev!=POWER_EV_INPUT){
+		esp_timer_stop(tick_timer);
+		if(deadline)esp_timer_start_once(tick_timer,deadline*1000ULL);
+	}
+	xSemaphoreGive(lock);
+	// Deep sleep is final, no event changes the state after it. Shutting
+	// Bluetooth down waits on the BTC task, which may be waiting on the
+	// lock with a host event.
+	if(next!=prev && next==POWER_DEEP_SLEEP)power_deep_sleep();
+}
+
+static void power_tick(void *arg){
+	power_feed(POWER_EV_TICK);
+}
+
+esp_err_t power_init(void){
+	esp_err_t ret;
+	esp_sleep_wakeup_cause_t cause=esp_sleep_get_wakeup_cause();
+	if(cause==ESP_SLEEP_WAKEUP_EXT1){
+		from_deep_sleep=true;
+		ESP_LOGI(LOG_NAME,"woke from deep sleep on pins 0x%llx",esp_sleep_get_ext1_wakeup_status());
+	}else if(cause==ESP_SLEEP_WAKEUP_ULP){
+		from_deep_sleep=true;
+		ESP_LOGI(LOG_NAME,"woke from deep sleep on a key the ULP confirmed");
+	}
+
+#ifdef CONFIG_PM_ENABLE
+	esp_pm_config_esp32_t pm_config={
+		.max_freq_mhz=CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+		.min_freq_mhz=40,
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+		.light_sleep_enable=true,
+#endif
+	};
+	if((ret=esp_pm_configure(&pm_config)))return ret;
+	if((ret=esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX,0,"power_active",&active_lock)))return ret;
+#endif
+	if(!POWER_LIGHT_SLEEP)
+		ESP_LOGI(LOG_NAME,"no light sleep while Bluetooth runs on the main XTAL clock, idle estimated at %u uA",POWER_IDLE_UA);
+
+	if(!(lock=xSemaphoreCreateMutex()))return ESP_ERR_NO_MEM;
+	esp_timer_create_args_t timer_args={
+		.callback=power_tick,
+		.name="power",
+	};
+	if((ret=esp_timer_create(&timer_args,&tick_timer)))return ret;
+
+	power_sm_init(&sm,power_now());
+	power_feed(POWER_EV_TICK);
+	return ESP_OK;
+}
+
+void power_input(void){
+	power_feed(POWER_EV_INPUT);
+}
+
+void power_connected(bool connected){
+	power_feed(connected?POWER_EV_CONNECTED:POWER_EV_DISCONNECTED);
+}
+
+void power_report_sent(void){
+	if(!from_deep_sleep || wake_to_report_ms)return;
+	// esp_timer starts with the app, ROM and bootloader time is not included.
+	wake_to_report_ms=power_now()?:1;
+	ESP_LOGI(LOG_NAME,"first report %u ms after deep sleep wake",wake_to_report_ms);
+}
+
+void power_get_stats(power_stats_t *out){
+	xSemaphoreTake(lock,portMAX_DELAY);
+	uint32_t now=power_now();
+	out->state=sm.state;
+	for(unsigned i=0;i<POWER_STATES;i++)
+		out->residency_ms[i]=sm.residency[i]+(i==sm.state?now-sm.entered:0);
+	out->avg_ua=power_sm_avg_ua(&sm,now);
+	xSemaphoreGive(lock);
+	out->wake_to_report_ms=wake_to_report_ms;
+}
@@ -0,0 +1,31 @@
+#ifndef POWER_H__
+#define POWER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "power_state.h"
+
+typedef struct {
+	power_state_t state;
+	uint32_t residency_ms[POWER_STATES];
+	uint32_t avg_ua;            // estimated average current since boot, see POWER_*_UA
+	uint32_t wake_to_report_ms; // deep sleep wake to first key report, 0 until then
+} power_stats_t;
+
+// Configure dynamic frequency scaling and light sleep, as far as the
+// Bluetooth clock allows, and start tracking activity. Logs what
+// woke us if this boot came out of deep sleep.
+esp_err_t power_init(void);
+
+// Key or mouse input, keeps the CPU at full clock for POWER_IDLE_MS.
+void power_input(void);
+
+void power_connected(bool connected);
+
+// A keyboard report went to the stack, closes the wake-to-report metric.
+void power_report_sent(void);
+
+void power_get_stats(power_stats_t *out);
+
+#endif /* POWER_H__ */
@@ -0,0 +1,85 @@
+#include "power_state.h"
+
+static const uint32_t state_ua[POWER_STATES]={
+	[POWER_ACTIVE]=POWER_ACTIVE_UA,
+	[POWER_IDLE]=POWER_IDLE_UA,
+	[POWER_ADVERTISING]=POWER_ADVERTISING_UA,
+	[POWER_DEEP_SLEEP]=POWER_DEEP_SLEEP_UA,
+};
+
+static const char *const state_names[POWER_STATES]={
+	[POWER_ACTIVE]="active",
+	[POWER_IDLE]="idle",
+	[POWER_ADVERTISING]="advertising",
+	[POWER_DEEP_SLEEP]="deep sleep",
+};
+
+void power_sm_init(power_sm_t *sm, uint32_t now){
+	*sm=(power_sm_t){.state=POWER_ADVERTISING,.last_input=now,.entered=now};
+}
+
+static void power_sm_enter(power_sm_t *sm, power_state_t state, uint32_t now){
+	sm->residency[sm->state]+=now-sm->entered;
+	sm->entered=now;
+	sm->state=state;
+}
+
+// How long the current state may last without input.
+static uint32_t power_sm_timeout(power_state_t state){
+	switch(state){
+	case POWER_ACTIVE: return POWER_IDLE_MS;
+	case POWER_IDLE: return POWER_DEEP_SLEEP_MS;
+	case POWER_ADVERTISING: return POWER_ADV_TIMEOUT_MS;
+	default: return 0;
+	}
+}
+
+power_state_t power_sm_event(power_sm_t *sm, power_event_t ev, uint32_t now){
+	power_state_t next=sm->state;
+	if(sm->state==POWER_DEEP_SLEEP)return next;
+	switch(ev){
+	case POWER_EV_INPUT:
+		sm->last_input=now;
+		next=sm->connected?POWER_ACTIVE:POWER_ADVERTISING;
+		break;
+	case POWER_EV_CONNECTED:
+		sm->connected=true;
+		sm->last_input=now;
+		next=POWER_ACTIVE;
+		break;
+	case POWER_EV_DISCONNECTED:
+		sm->connected=false;
+		sm->last_input=now;
+		next=POWER_ADVERTISING;
+		break;
+	case POWER_EV_TICK:
+		// Idle counts from the last input, not from entering idle, so
+		// POWER_DEEP_SLEEP_MS is the whole quiet time.
+		if(now-sm->last_input<power_sm_timeout(sm->state))break;
+		next=sm->state==POWER_ACTIVE?POWER_IDLE:POWER_DEEP_SLEEP;
+		break;
+	}
+	if(next!=sm->state)power_sm_enter(sm,next,now);
+	return next;
+}
+
+uint32_t power_sm_deadline(const power_sm_t *sm, uint32_t now){
+	uint32_t timeout=power_sm_timeout(sm->state);
+	if(!timeout)return 0;
+	uint32_t quiet=now-sm->last_input;
+	return quiet>=timeout?1:timeout-quiet;
+}
+
+uint32_t power_sm_avg_ua(const power_sm_t *sm, uint32_t now){
+	uint64_t total=0, charge=0;
+	for(unsigned i=0;i<POWER_STATES;i++){
+		uint64_t ms=sm->residency[i]+(i==sm->state?now-sm->entered:0);
+		total+=ms;
+		charge+=ms*state_ua[i];
+	}
+	return total?charge/total:state_ua[sm->state];
+}
+
+const char *power_state_name(power_state_t state){
+	return state<POWER_STATES?state_names[state]:"?";
+}
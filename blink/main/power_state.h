@@ -0,0 +1,81 @@
+#ifndef POWER_STATE_H__
+#define POWER_STATE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+// Inactivity before the CPU may drop its clock and light sleep.
+#ifndef POWER_IDLE_MS
+#define POWER_IDLE_MS 2000
+#endif
+// Inactivity before deep sleep while a host is connected.
+#ifndef POWER_DEEP_SLEEP_MS
+#define POWER_DEEP_SLEEP_MS (10*60*1000)
+#endif
+// Time spent advertising to nobody before giving up and deep sleeping.
+#ifndef POWER_ADV_TIMEOUT_MS
+#define POWER_ADV_TIMEOUT_MS (2*60*1000)
+#endif
+
+// Light sleep with Bluetooth running needs the controller on a 32 kHz
+// crystal. On the main XTAL low power clock, the shipped sdkconfig, the
+// controller keeps it off and idle only drops the CPU clock.
+#if defined(CONFIG_PM_ENABLE) && defined(CONFIG_FREERTOS_USE_TICKLESS_IDLE) && \
+	defined(CONFIG_BTDM_LPCLK_SEL_EXT_32K_XTAL)
+#define POWER_LIGHT_SLEEP 1
+#else
+#define POWER_LIGHT_SLEEP 0
+#endif
+
+// Estimated average draw per state in uA, ESP32 datasheet figures with
+// the BLE controller in modem sleep between events.
+#define POWER_ACTIVE_UA 45000
+#if POWER_LIGHT_SLEEP
+#define POWER_IDLE_UA 2500
+#define POWER_ADVERTISING_UA 4000
+#else
+#define POWER_IDLE_UA 20000        // CPU at 40 MHz, XTAL and RF clocks on
+#define POWER_ADVERTISING_UA 23000
+#endif
+#define POWER_DEEP_SLEEP_UA 150    // RTC domain watching keys
+
+typedef enum {
+	POWER_ACTIVE,      // input in flight, full clock
+	POWER_IDLE,        // connected and quiet, slowest clock or light sleep
+	POWER_ADVERTISING, // no host, as idle between advertising events
+	POWER_DEEP_SLEEP,  // final, the glue turns this into esp_deep_sleep_start
+	POWER_STATES,
+} power_state_t;
+
+typedef enum {
+	POWER_EV_INPUT,
+	POWER_EV_CONNECTED,
+	POWER_EV_DISCONNECTED,
+	POWER_EV_TICK,
+} power_event_t;
+
+// Pure state machine, times are in ms from any monotonic clock.
+typedef struct {
+	power_state_t state;
+	bool connected;
+	uint32_t last_input;
+	uint32_t entered;
+	uint32_t residency[POWER_STATES]; // ms spent in each state
+} power_sm_t;
+
+void power_sm_init(power_sm_t *sm, uint32_t now);
+
+// Apply one event and return the new state.
+power_state_t power_sm_event(power_sm_t *sm, power_event_t ev, uint32_t now);
+
+// ms from now until a TICK can change the state, 0 if it never will.
+uint32_t power_sm_deadline(const power_sm_t *sm, uint32_t now);
+
+// Average current in uA over the residency so far, an estimate from the
+// POWER_*_UA draw of each state.
+uint32_t power_sm_avg_ua(const power_sm_t *sm, uint32_t now);
+
+const char *power_state_name(power_state_t state);
+
+#endif /* POWER_STATE_H__ */
@@ -0,0 +1,211 @@
+#include "reconnect.h"
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#define LOG_NAME "reconnect"
+#define NVS_NAMESPACE "hid_peer"
+#define NVS_KEY_LAST "last"
+
+typedef struct {
+	esp_bd_addr_t bda;
+	uint8_t addr_type;
+} reconnect_peer_t;
+
+static esp_ble_adv_params_t *open_adv;
+static esp_timer_handle_t phase_timer;
+// Guards everything below. The phase timer runs on the esp_timer task,
+// host events on the BTC task and host switching on hid_task.
+static SemaphoreHandle_t lock;
+static reconnect_phase_t phase=RECONNECT_IDLE;
+static reconnect_peer_t peer;
+static bool have_peer;
+static esp_bd_addr_t connected[RECONNECT_MAX_CONN];
+static uint8_t num_connected;
+static int64_t adv_start;
+static reconnect_stats_t stats;
+
+static const char *const phase_names[]={
+	[RECONNECT_IDLE]="idle",
+	[RECONNECT_DIRECTED]="directed",
+	[RECONNECT_WHITELIST]="whitelist",
+	[RECONNECT_OPEN]="open",
+};
+
+static int reconnect_find_connected(const esp_bd_addr_t bda){
+	for(int i=0;i<num_connected;i++)
+		if(!memcmp(connected[i],bda,sizeof(esp_bd_addr_t)))return i;
+	return -1;
+}
+
+// Pick the host to call back, the last one if it is still bonded, else any
+// bonded host that is not connected already. Fills the whitelist with all
+// of them on the way.
+static bool reconnect_load_peers(void){
+	reconnect_peer_t last;
+	bool have_last=false;
+	nvs_handle_t nvs;
+	if(nvs_open(NVS_NAMESPACE,NVS_READONLY,&nvs)==ESP_OK){
+		size_t len=sizeof(last);
+		have_last=nvs_get_blob(nvs,NVS_KEY_LAST,&last,&len)==ESP_OK && len==sizeof(last);
+		nvs_close(nvs);
+	}
+
+	int num=esp_ble_get_bond_device_num();
+	if(num<=0)return false;
+	esp_ble_bond_dev_t *list=malloc(sizeof(esp_ble_bond_dev_t)*num);
+	if(!list)return false;
+	esp_ble_get_bond_device_list(&num,list);
+
+	// Identity addresses only, hosts with resolvable private addresses need
+	// controller privacy to match the whitelist.
+	esp_ble_gap_clear_whitelist();
+	have_peer=false;
+	for(int i=0;i<num;i++){
+		esp_ble_addr_type_t type=list[i].bond_key.pid_key.addr_type;
+		esp_ble_gap_update_whitelist(true,list[i].bd_addr,
+			type==BLE_ADDR_TYPE_PUBLIC?BLE_WL_ADDR_TYPE_PUBLIC:BLE_WL_ADDR_TYPE_RANDOM);
+		if(reconnect_find_connected(list[i].bd_addr)>=0)continue;
+		if(!have_peer || (have_last && !memcmp(last.bda,list[i].bd_addr,sizeof(esp_bd_addr_t)))){
+			memcpy(peer.bda,list[i].bd_addr,sizeof(esp_bd_addr_t));
+			peer.addr_type=type;
+			have_peer=true;
+		}
+	}
+	free(list);
+	return have_peer;
+}
+
+static void reconnect_advertise(reconnect_phase_t next){
+	esp_ble_adv_params_t params=*open_adv;
+	uint32_t ms=0;
+	switch(next){
+	case RECONNECT_DIRECTED:
+		params.adv_type=ADV_TYPE_DIRECT_IND_HIGH;
+		memcpy(params.peer_addr,peer.bda,sizeof(esp_bd_addr_t));
+		params.peer_addr_type=peer.addr_type;
+		ms=RECONNECT_DIRECTED_MS;
+		break;
+	case RECONNECT_WHITELIST:
+		// 160-200 ms, scans and connects from bonded hosts only.
+		params.adv_int_min=0x100;
+		params.adv_int_max=0x140;
+		params.adv_filter_policy=ADV_FILTER_ALLOW_SCAN_WLST_CON_WLST;
+		ms=RECONNECT_WHITELIST_MS;
+		break;
+	case RECONNECT_OPEN:
+		if(num_connected)ms=RECONNECT_OPEN_MS;
+		break;
+	default:
+		break;
+	}
+	// Commands run in order in the BTC task, the stop lands before the
+	// new parameters are set.
+	if(phase!=RECONNECT_IDLE)esp_ble_gap_stop_advertising();
+	phase=next;
+	ESP_LOGI(LOG_NAME,"advertising %s",phase_names[next]);
+	esp_ble_gap_start_advertising(&params);
+	if(ms)esp_timer_start_once(phase_timer,ms*1000ULL);
+}
+
+static void reconnect_next(void *arg){
+	xSemaphoreTake(lock,portMAX_DELAY);
+	if(phase==RECONNECT_DIRECTED)reconnect_advertise(RECONNECT_WHITELIST);
+	else if(phase==RECONNECT_WHITELIST)reconnect_advertise(RECONNECT_OPEN);
+	else if(phase==RECONNECT_OPEN){
+		// Nobody new showed up, stop paying for advertising next to the
+		// hosts already connected.
+		ESP_LOGI(LOG_NAME,"advertising stopped");
+		esp_ble_gap_stop_advertising();
+		phase=RECONNECT_IDLE;
+	}
+	xSemaphoreGive(lock);
+}
+
+esp_err_t reconnect_init(esp_ble_adv_params_t *open_params){
+	open_adv=open_params;
+	if(!lock && !(lock=xSemaphoreCreateMutex()))return ESP_ERR_NO_MEM;
+	esp_timer_create_args_t timer_args={
+		.callback=reconnect_next,
+		.name="reconnect",
+	};
+	return esp_timer_create(&timer_args,&phase_timer);
+}
+
+void reconnect_start(void){
+	xSemaphoreTake(lock,portMAX_DELAY);
+	esp_timer_stop(phase_timer);
+	// The controller refuses whitelist changes while advertising uses it.
+	if(phase!=RECONNECT_IDLE){
+		esp_ble_gap_stop_advertising();
+		phase=RECONNECT_IDLE;
+	}
+	adv_start=esp_timer_get_time();
+	stats.first_report_ms=0;
+	reconnect_advertise(reconnect_load_peers()?RECONNECT_DIRECTED:RECONNECT_OPEN);
+	xSemaphoreGive(lock);
+}
+
+void reconnect_connected(const esp_bd_addr_t bda){
+	xSemaphoreTake(lock,portMAX_DELAY);
+	esp_timer_stop(phase_timer);
+	if(reconnect_find_connected(bda)<0 && num_connected<RECONNECT_MAX_CONN)
+		memcpy(connected[num_connected++],bda,sizeof(esp_bd_addr_t));
+	stats.phase=phase;
+	stats.connect_ms=(esp_timer_get_time()-adv_start)/1000;
+	ESP_LOGI(LOG_NAME,"connected after %u ms (%s)",stats.connect_ms,phase_names[phase]);
+	phase=RECONNECT_IDLE;
+	xSemaphoreGive(lock);
+}
+
+void reconnect_disconnected(const esp_bd_addr_t bda){
+	xSemaphoreTake(lock,portMAX_DELAY);
+	int i=reconnect_find_connected(bda);
+	if(i>=0)memmove(connected[i],connected[i+1],(--num_connected-i)*sizeof(esp_bd_addr_t));
+	xSemaphoreGive(lock);
+}
+
+void reconnect_save_peer(const esp_bd_addr_t bda, esp_ble_addr_type_t addr_type){
+	reconnect_peer_t last={.addr_type=addr_type};
+	memcpy(last.bda,bda,sizeof(esp_bd_addr_t));
+	nvs_handle_t nvs;
+	if(nvs_open(NVS_NAMESPACE,NVS_READWRITE,&nvs)!=ESP_OK)return;
+	// Skip the flash write when the same host comes back.
+	reconnect_peer_t old;
+	size_t len=sizeof(old);
+	if(nvs_get_blob(nvs,NVS_KEY_LAST,&old,&len)!=ESP_OK || len!=sizeof(old) || memcmp(&old,&last,sizeof(last))){
+		nvs_set_blob(nvs,NVS_KEY_LAST,&last,sizeof(last));
+		nvs_commit(nvs);
+	}
+	nvs_close(nvs);
+}
+
+bool reconnect_is_last_peer(const esp_bd_addr_t bda){
+	reconnect_peer_t last;
+	size_t len=sizeof(last);
+	nvs_handle_t nvs;
+	if(nvs_open(NVS_NAMESPACE,NVS_READONLY,&nvs)!=ESP_OK)return false;
+	bool same=nvs_get_blob(nvs,NVS_KEY_LAST,&last,&len)==ESP_OK && len==sizeof(last)
+		&& !memcmp(last.bda,bda,sizeof(esp_bd_addr_t));
+	nvs_close(nvs);
+	return same;
+}
+
+void reconnect_report_sent(void){
+	xSemaphoreTake(lock,portMAX_DELAY);
+	if(!stats.first_report_ms && adv_start){
+		stats.first_report_ms=((esp_timer_get_time()-adv_start)/1000)?:1;
+		ESP_LOGI(LOG_NAME,"first report %u ms after advertising started",stats.first_report_ms);
+	}
+	xSemaphoreGive(lock);
+}
+
+void reconnect_get_stats(reconnect_stats_t *out){
+	xSemaphoreTake(lock,portMAX_DELAY);
+	*out=stats;
+	xSemaphoreGive(lock);
+}
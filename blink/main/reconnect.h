@@ -0,0 +1,55 @@
+#ifndef RECONNECT_H__
+#define RECONNECT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_gap_ble_api.h"
+
+// High duty directed advertising is capped at 1.28 s by the spec.
+#define RECONNECT_DIRECTED_MS 1280
+// Low duty advertising to bonded hosts only, before opening up to pairing.
+#define RECONNECT_WHITELIST_MS 30000
+// Open advertising while other hosts stay connected, to pair another one.
+// Without any host it runs until someone connects.
+#define RECONNECT_OPEN_MS 60000
+// Hosts tracked as connected, skipped when picking one to call back.
+#define RECONNECT_MAX_CONN 3
+
+typedef enum {
+	RECONNECT_IDLE,      // connected, or advertising not started yet
+	RECONNECT_DIRECTED,  // high duty directed to the last host
+	RECONNECT_WHITELIST, // low duty, bonded hosts only
+	RECONNECT_OPEN,      // anyone may connect and pair
+} reconnect_phase_t;
+
+typedef struct {
+	reconnect_phase_t phase;        // phase the last connection came in on
+	uint32_t connect_ms;            // advertising start to connect
+	uint32_t first_report_ms;       // advertising start to first key report, 0 until sent
+} reconnect_stats_t;
+
+// open_params are used once the bonded hosts had their chance.
+esp_err_t reconnect_init(esp_ble_adv_params_t *open_params);
+
+// Start advertising, on boot, after a disconnect and to add another host.
+void reconnect_start(void);
+
+// A host connected, stop advertising phases.
+void reconnect_connected(const esp_bd_addr_t bda);
+
+// A host went away, it may be called back again.
+void reconnect_disconnected(const esp_bd_addr_t bda);
+
+// Pairing finished, remember the host for directed advertising.
+void reconnect_save_peer(const esp_bd_addr_t bda, esp_ble_addr_type_t addr_type);
+
+// True if bda is the host reconnect_save_peer() last saved.
+bool reconnect_is_last_peer(const esp_bd_addr_t bda);
+
+// A keyboard report went to the stack, closes the time-to-first-report.
+void reconnect_report_sent(void);
+
+void reconnect_get_stats(reconnect_stats_t *out);
+
+#endif /* RECONNECT_H__ */